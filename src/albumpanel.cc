@@ -0,0 +1,108 @@
+// project
+#include "albumpanel.hh"
+
+AlbumPanel::AlbumPanel() {
+    // rows setup
+    rows.set_orientation(Gtk::Orientation::VERTICAL);
+    rows.set_spacing(2);
+
+    // save box setup
+    entry_name.set_placeholder_text("Album name");
+    entry_name.set_hexpand(true);
+    entry_name.signal_activate().connect(
+            sigc::mem_fun(*this, &AlbumPanel::on_save));
+    btn_save.set_icon_name("document-save-symbolic");
+    btn_save.set_tooltip_text("Save the query as an album");
+    btn_save.signal_clicked().connect(
+            sigc::mem_fun(*this, &AlbumPanel::on_save));
+    save_box.set_orientation(Gtk::Orientation::HORIZONTAL);
+    save_box.set_spacing(5);
+    save_box.append(entry_name);
+    save_box.append(btn_save);
+
+    // box setup (self)
+    set_orientation(Gtk::Orientation::VERTICAL);
+    set_spacing(5);
+    append(rows);
+    append(save_box);
+}
+
+void AlbumPanel::set_albums(const std::vector<std::pair<Glib::ustring, size_t>> &albums) {
+    bool same_albums = albums.size() == names.size();
+    for (size_t idx = 0; same_albums && idx < albums.size(); idx++) {
+        same_albums = albums[idx].first == names[idx];
+    }
+
+    // the counts change with almost every edit, the albums rarely do
+    if (same_albums) {
+        for (size_t idx = 0; idx < albums.size(); idx++) {
+            count_labels[idx]->set_markup("<small>" + std::to_string(albums[idx].second) + "</small>");
+        }
+        return;
+    }
+
+    // the children are managed, removing them frees them
+    while (Gtk::Widget *child = rows.get_first_child()) {
+        rows.remove(*child);
+    }
+    names.clear();
+    count_labels.clear();
+
+    for (const auto &album : albums) {
+        Glib::ustring name = album.first;
+
+        Gtk::Label *label = Gtk::make_managed<Gtk::Label>(name);
+        label->set_halign(Gtk::Align::START);
+        label->set_hexpand(true);
+        Gtk::Label *count = Gtk::make_managed<Gtk::Label>();
+        count->set_markup("<small>" + std::to_string(album.second) + "</small>");
+        Gtk::Box *content = Gtk::make_managed<Gtk::Box>(Gtk::Orientation::HORIZONTAL, 10);
+        content->append(*label);
+        content->append(*count);
+
+        Gtk::Button *btn_open = Gtk::make_managed<Gtk::Button>();
+        btn_open->set_has_frame(false);
+        btn_open->set_hexpand(true);
+        btn_open->set_child(*content);
+        btn_open->set_tooltip_text("Open " + name);
+        btn_open->signal_clicked().connect([this, name](){ private_album_chosen.emit(name); });
+
+        Gtk::Button *btn_remove = Gtk::make_managed<Gtk::Button>();
+        btn_remove->set_has_frame(false);
+        btn_remove->set_icon_name("edit-delete-symbolic");
+        btn_remove->set_tooltip_text("Remove " + name);
+        btn_remove->signal_clicked().connect([this, name](){ private_album_removed.emit(name); });
+
+        Gtk::Box *row = Gtk::make_managed<Gtk::Box>(Gtk::Orientation::HORIZONTAL);
+        row->append(*btn_open);
+        row->append(*btn_remove);
+        rows.append(*row);
+
+        names.push_back(name);
+        count_labels.push_back(count);
+    }
+}
+
+sigc::signal<void (const Glib::ustring &)> AlbumPanel::signal_album_chosen() {
+    return private_album_chosen;
+}
+
+sigc::signal<void (const Glib::ustring &)> AlbumPanel::signal_album_saved() {
+    return private_album_saved;
+}
+
+sigc::signal<void (const Glib::ustring &)> AlbumPanel::signal_album_removed() {
+    return private_album_removed;
+}
+
+void AlbumPanel::on_save() {
+    Glib::ustring name = entry_name.get_text();
+
+    // the name is a line of the database file
+    size_t begin = name.find_first_not_of("\t \n");
+    if (begin == Glib::ustring::npos) { return; }
+    name = name.substr(begin, name.find_last_not_of("\t \n") - begin + 1);
+
+    entry_name.set_text("");
+    private_album_saved.emit(name);
+}
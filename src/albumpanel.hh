@@ -0,0 +1,49 @@
+#pragma once
+
+// standard library
+#include <vector>
+#include <utility>
+
+// gtkmm
+#include <gtkmm/box.h>
+#include <gtkmm/entry.h>
+#include <gtkmm/button.h>
+#include <gtkmm/label.h>
+#include <glibmm/ustring.h>
+#include <sigc++/signal.h>
+
+// Lists the saved queries of the database as albums with the number of
+// items in each. Choosing an album opens it, and the current query of
+// the tag picker can be saved as a new album under a name.
+class AlbumPanel : public Gtk::Box {
+    public:
+        AlbumPanel();
+
+        // names of the albums with their number of items, only the
+        // counts are updated if the albums are the same as before
+        void set_albums(const std::vector<std::pair<Glib::ustring, size_t>> &albums);
+
+        // signal forwarding
+        sigc::signal<void (const Glib::ustring &)> signal_album_chosen();
+        sigc::signal<void (const Glib::ustring &)> signal_album_saved();
+        sigc::signal<void (const Glib::ustring &)> signal_album_removed();
+
+    private:
+        // widgets
+        Gtk::Box rows;
+        Gtk::Box save_box;
+        Gtk::Entry entry_name;
+        Gtk::Button btn_save;
+
+        // the shown albums and the labels of their counts
+        std::vector<Glib::ustring> names;
+        std::vector<Gtk::Label *> count_labels;
+
+        // signal handlers
+        void on_save();
+
+        // signals
+        sigc::signal<void (const Glib::ustring &)> private_album_chosen;
+        sigc::signal<void (const Glib::ustring &)> private_album_saved;
+        sigc::signal<void (const Glib::ustring &)> private_album_removed;
+};
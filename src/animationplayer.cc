@@ -0,0 +1,64 @@
+// glib
+#include <glib.h>
+#include <glibmm/main.h>
+
+// project
+#include "animationplayer.hh"
+
+namespace {
+    // shorter delays are what browsers treat as unset
+    const int min_delay = 20;
+    const int default_delay = 100;
+}
+
+AnimationPlayer::AnimationPlayer()
+:
+    animation_time(0)
+{}
+
+AnimationPlayer::~AnimationPlayer() {
+    stop();
+}
+
+Glib::RefPtr<Gdk::Pixbuf> AnimationPlayer::play(const Glib::RefPtr<Gdk::PixbufAnimation> &animation) {
+    stop();
+
+    // iterators take the time in microseconds, 0 would mean now
+    animation_time = g_get_real_time();
+    iter = animation->get_iter(animation_time);
+    schedule();
+
+    return iter->get_pixbuf();
+}
+
+void AnimationPlayer::stop() {
+    timer.disconnect();
+    iter.reset();
+}
+
+sigc::signal<void (const Glib::RefPtr<Gdk::Pixbuf> &)> AnimationPlayer::signal_frame() {
+    return private_frame;
+}
+
+void AnimationPlayer::schedule() {
+    // the last frame of an animation that does not loop stays
+    int delay = iter->get_delay_time();
+    if (delay < 0) { return; }
+
+    // files written for browsers rely on them slowing down such frames
+    if (delay < min_delay) { delay = default_delay; }
+
+    animation_time += (gint64)delay * 1000;
+    timer = Glib::signal_timeout().connect(sigc::mem_fun(*this, &AnimationPlayer::on_timeout), delay);
+}
+
+bool AnimationPlayer::on_timeout() {
+    if (!iter) { return false; }
+
+    // the iterator composites the frame into a pixbuf of its own
+    iter->advance(animation_time);
+    schedule();
+    private_frame.emit(iter->get_pixbuf());
+
+    return false;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+// gtkmm
+#include <gdkmm/pixbuf.h>
+#include <gdkmm/pixbufanimation.h>
+#include <gdkmm/pixbufanimationiter.h>
+#include <sigc++/signal.h>
+#include <sigc++/connection.h>
+
+// Plays animated images such as GIF and WebP. The animation holds what
+// the gdk-pixbuf loader parsed from the file, the player only steps an
+// iterator over it on a timer and hands out the frame it composited,
+// without keeping copies of any frames.
+class AnimationPlayer {
+    public:
+        AnimationPlayer();
+        ~AnimationPlayer();
+
+        // returns the first frame, the following ones are
+        // emitted by signal_frame until stop is called
+        Glib::RefPtr<Gdk::Pixbuf> play(const Glib::RefPtr<Gdk::PixbufAnimation> &animation);
+        void stop();
+
+        // signal forwarding
+        sigc::signal<void (const Glib::RefPtr<Gdk::Pixbuf> &)> signal_frame();
+
+    private:
+        // members
+        Glib::RefPtr<Gdk::PixbufAnimationIter> iter;
+
+        // the iterator is advanced by the delays of the frames rather
+        // than the clock, so slow ticks do not skip frames
+        gint64 animation_time;
+
+        sigc::connection timer;
+
+        // functions
+        void schedule();
+
+        // signal handlers
+        bool on_timeout();
+
+        // signals
+        sigc::signal<void (const Glib::RefPtr<Gdk::Pixbuf> &)> private_frame;
+};
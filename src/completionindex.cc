@@ -0,0 +1,363 @@
+// standard library
+#include <algorithm>
+
+// project
+#include "completionindex.hh"
+
+namespace {
+    enum MatchClass { EXACT, PREFIX, WORD_PREFIX, SUBSTRING, FUZZY };
+
+    uint32_t trigram_at(const std::string &str, size_t pos) {
+        return ((uint32_t)(unsigned char)str[pos] << 16) |
+               ((uint32_t)(unsigned char)str[pos + 1] << 8) |
+               (uint32_t)(unsigned char)str[pos + 2];
+    }
+
+    // distinct trigrams of a string, in no particular order
+    std::vector<uint32_t> get_trigrams(const std::string &str) {
+        std::vector<uint32_t> result;
+        for (size_t pos = 0; pos + 3 <= str.size(); pos++) {
+            result.push_back(trigram_at(str, pos));
+        }
+
+        std::sort(result.begin(), result.end());
+        result.erase(std::unique(result.begin(), result.end()), result.end());
+        return result;
+    }
+
+    bool is_word_separator(char c) {
+        return c == ' ' || c == '_' || c == '-' || c == ':' || c == '/' || c == '.';
+    }
+
+    // the smallest number of edits turning the key into any substring
+    // of the text, or more than max_errors if there is no such substring
+    int substring_distance(const std::string &key, const std::string &text, int max_errors) {
+        std::vector<int> row(text.size() + 1, 0);
+        std::vector<int> next(text.size() + 1);
+
+        for (size_t i = 1; i <= key.size(); i++) {
+            next[0] = i;
+            int row_min = next[0];
+            for (size_t j = 1; j <= text.size(); j++) {
+                int cost = key[i - 1] == text[j - 1] ? 0 : 1;
+                next[j] = std::min({row[j - 1] + cost, row[j] + 1, next[j - 1] + 1});
+                row_min = std::min(row_min, next[j]);
+            }
+
+            // every substring already needs too many edits
+            if (row_min > max_errors) { return max_errors + 1; }
+            row.swap(next);
+        }
+
+        return *std::min_element(row.begin(), row.end());
+    }
+}
+
+CompletionIndex::CompletionIndex()
+:
+    generation(0),
+    removed_count(0)
+{}
+
+void CompletionIndex::set_tags(const std::vector<std::pair<Glib::ustring, size_t>> &tags) {
+    entries.clear();
+    ids.clear();
+    folded_ids.clear();
+    trigrams.clear();
+    generation += 1;
+    removed_count = 0;
+
+    entries.reserve(tags.size());
+    for (const auto &tag : tags) {
+        ids.emplace(tag.first.raw(), entries.size());
+        entries.push_back(Entry{tag.first, normalize(tag.first), tag.second});
+        folded_ids.emplace(entries.back().folded, entries.size() - 1);
+    }
+
+    // ids are added in ascending order, so the lists stay sorted
+    for (size_t id = 0; id < entries.size(); id++) {
+        for (uint32_t trigram : get_trigrams(entries[id].folded)) {
+            trigrams[trigram].push_back(id);
+        }
+    }
+}
+
+void CompletionIndex::update_tags(const std::vector<std::pair<Glib::ustring, size_t>> &changes) {
+    bool tags_changed = false;
+    for (const auto &change : changes) {
+        auto iter = ids.find(change.first.raw());
+        if (iter == ids.end()) {
+            if (change.second != 0) {
+                add_tag(change.first, change.second);
+                tags_changed = true;
+            }
+        }
+        else if (change.second == 0) {
+            remove_tag(iter->second);
+            tags_changed = true;
+        }
+        else {
+            entries[iter->second].count = change.second;
+        }
+    }
+
+    if (tags_changed) {
+        generation += 1;
+    }
+
+    // once most entries are gaps, rebuilding is cheaper than skipping them
+    if (removed_count > 1024 && removed_count > entries.size() / 2) {
+        std::vector<std::pair<Glib::ustring, size_t>> tags;
+        tags.reserve(entries.size() - removed_count);
+        for (const Entry &entry : entries) {
+            if (!entry.folded.empty()) {
+                tags.push_back(std::make_pair(entry.tag, entry.count));
+            }
+        }
+        set_tags(tags);
+    }
+}
+
+size_t CompletionIndex::size() const {
+    return entries.size();
+}
+
+size_t CompletionIndex::get_generation() const {
+    return generation;
+}
+
+const Glib::ustring &CompletionIndex::get_tag(size_t id) const {
+    return entries.at(id).tag;
+}
+
+size_t CompletionIndex::get_count(size_t id) const {
+    return entries.at(id).count;
+}
+
+size_t CompletionIndex::find_id(const Glib::ustring &tag) const {
+    auto iter = ids.find(tag.raw());
+    return iter == ids.end() ? npos : iter->second;
+}
+
+size_t CompletionIndex::find_typed_id(const Glib::ustring &text) const {
+    size_t id = find_id(text);
+    if (id != npos) { return id; }
+
+    std::string folded = normalize(text);
+    auto range = folded_ids.equal_range(folded);
+    if (range.first == range.second) { return npos; }
+
+    // several spellings of the tag, prefer the one that is used most
+    id = range.first->second;
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (entries[iter->second].count > entries[id].count) {
+            id = iter->second;
+        }
+    }
+
+    return id;
+}
+
+std::vector<size_t> CompletionIndex::find(const Glib::ustring &key, size_t max_results,
+                                          const std::unordered_map<size_t, size_t> *context) const
+{
+    std::vector<size_t> result;
+
+    std::string folded = normalize(key);
+    if (folded.empty() || max_results == 0) { return result; }
+
+    // tags containing the key
+    std::vector<Candidate> candidates;
+    std::vector<bool> found(entries.size(), false);
+    for (uint32_t id : find_substring_candidates(folded)) {
+        const std::string &tag = entries[id].folded;
+        size_t pos = tag.find(folded);
+        if (pos == std::string::npos) { continue; }
+
+        int match_class = SUBSTRING;
+        if (tag.size() == folded.size()) {
+            match_class = EXACT;
+        }
+        else if (pos == 0) {
+            match_class = PREFIX;
+        }
+        else {
+            // a later occurrence may start a word
+            for (; pos != std::string::npos; pos = tag.find(folded, pos + 1)) {
+                if (is_word_separator(tag[pos - 1])) {
+                    match_class = WORD_PREFIX;
+                    break;
+                }
+            }
+        }
+
+        candidates.push_back(Candidate{id, match_class, 0, npos});
+        found[id] = true;
+    }
+
+    // only look for typos if there are not enough exact matches
+    if (candidates.size() < max_results) {
+        add_fuzzy_candidates(folded, found, candidates);
+    }
+
+    if (context != nullptr) {
+        for (Candidate &candidate : candidates) {
+            auto iter = context->find(candidate.id);
+            if (iter != context->end()) {
+                candidate.context_rank = iter->second;
+            }
+        }
+    }
+
+    size_t count = std::min(max_results, candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end(),
+                      [this](const Candidate &a, const Candidate &b){ return is_better(a, b); });
+
+    result.reserve(count);
+    for (size_t idx = 0; idx < count; idx++) {
+        result.push_back(candidates[idx].id);
+    }
+
+    return result;
+}
+
+std::string CompletionIndex::normalize(const Glib::ustring &tag) {
+    std::string folded = tag.casefold().raw();
+
+    size_t begin = folded.find_first_not_of("\t \n");
+    if (begin == std::string::npos) { return std::string(); }
+    size_t end = folded.find_last_not_of("\t \n");
+
+    return folded.substr(begin, end - begin + 1);
+}
+
+void CompletionIndex::add_tag(const Glib::ustring &tag, size_t count) {
+    size_t id = entries.size();
+    ids.emplace(tag.raw(), id);
+    entries.push_back(Entry{tag, normalize(tag), count});
+    folded_ids.emplace(entries[id].folded, id);
+
+    // the new id is the largest, so the lists stay sorted
+    for (uint32_t trigram : get_trigrams(entries[id].folded)) {
+        trigrams[trigram].push_back(id);
+    }
+}
+
+void CompletionIndex::remove_tag(size_t id) {
+    Entry &entry = entries[id];
+    for (uint32_t trigram : get_trigrams(entry.folded)) {
+        auto iter = trigrams.find(trigram);
+        if (iter == trigrams.end()) { continue; }
+
+        std::vector<uint32_t> &list = iter->second;
+        auto pos = std::lower_bound(list.begin(), list.end(), (uint32_t)id);
+        if (pos != list.end() && *pos == id) {
+            list.erase(pos);
+        }
+        if (list.empty()) {
+            trigrams.erase(iter);
+        }
+    }
+
+    auto range = folded_ids.equal_range(entry.folded);
+    for (auto iter = range.first; iter != range.second; ++iter) {
+        if (iter->second == id) {
+            folded_ids.erase(iter);
+            break;
+        }
+    }
+
+    // an empty folded tag never contains a key, so lookups skip the entry
+    ids.erase(entry.tag.raw());
+    entry.tag.clear();
+    entry.folded.clear();
+    entry.count = 0;
+    removed_count += 1;
+}
+
+std::vector<uint32_t> CompletionIndex::find_substring_candidates(const std::string &folded) const {
+    std::vector<uint32_t> result;
+
+    // too short for a trigram, every tag is a candidate
+    if (folded.size() < 3) {
+        result.resize(entries.size());
+        for (size_t id = 0; id < entries.size(); id++) {
+            result[id] = id;
+        }
+        return result;
+    }
+
+    // a tag containing the key contains all of its trigrams,
+    // intersecting the shortest lists first keeps the work small
+    std::vector<const std::vector<uint32_t> *> lists;
+    for (uint32_t trigram : get_trigrams(folded)) {
+        auto iter = trigrams.find(trigram);
+        if (iter == trigrams.end()) { return result; }
+        lists.push_back(&iter->second);
+    }
+    std::sort(lists.begin(), lists.end(),
+              [](const std::vector<uint32_t> *a, const std::vector<uint32_t> *b){ return a->size() < b->size(); });
+
+    result = *lists.front();
+    std::vector<uint32_t> intersection;
+    for (size_t idx = 1; idx < lists.size() && result.size() > 0; idx++) {
+        intersection.clear();
+        std::set_intersection(result.begin(), result.end(),
+                              lists[idx]->begin(), lists[idx]->end(),
+                              std::back_inserter(intersection));
+        result.swap(intersection);
+    }
+
+    return result;
+}
+
+void CompletionIndex::add_fuzzy_candidates(const std::string &folded,
+                                           std::vector<bool> &found,
+                                           std::vector<CompletionIndex::Candidate> &candidates) const
+{
+    // short keys match too many tags with a typo
+    if (folded.size() < 4) { return; }
+    int max_errors = folded.size() < 8 ? 1 : 2;
+
+    // every edit destroys at most three trigrams of the key, so a tag
+    // containing the key with few edits still shares most of its trigrams
+    std::vector<uint32_t> key_trigrams = get_trigrams(folded);
+    int min_shared = (int)key_trigrams.size() - 3 * max_errors;
+    if (min_shared < 1) { min_shared = 1; }
+
+    std::unordered_map<uint32_t, int> shared;
+    for (uint32_t trigram : key_trigrams) {
+        auto iter = trigrams.find(trigram);
+        if (iter == trigrams.end()) { continue; }
+
+        for (uint32_t id : iter->second) {
+            if (!found[id]) {
+                shared[id] += 1;
+            }
+        }
+    }
+
+    for (const auto &entry : shared) {
+        if (entry.second < min_shared) { continue; }
+
+        int errors = substring_distance(folded, entries[entry.first].folded, max_errors);
+        if (errors <= max_errors) {
+            candidates.push_back(Candidate{entry.first, FUZZY, errors, npos});
+            found[entry.first] = true;
+        }
+    }
+}
+
+bool CompletionIndex::is_better(const CompletionIndex::Candidate &a, const CompletionIndex::Candidate &b) const {
+    if (a.match_class != b.match_class) { return a.match_class < b.match_class; }
+    if (a.errors != b.errors) { return a.errors < b.errors; }
+    if (a.context_rank != b.context_rank) { return a.context_rank < b.context_rank; }
+
+    // more frequently used tags first, then shorter ones
+    const Entry &entry_a = entries[a.id];
+    const Entry &entry_b = entries[b.id];
+    if (entry_a.count != entry_b.count) { return entry_a.count > entry_b.count; }
+    if (entry_a.folded.size() != entry_b.folded.size()) { return entry_a.folded.size() < entry_b.folded.size(); }
+
+    return a.id < b.id;
+}
@@ -0,0 +1,100 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <utility>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+// gtkmm
+#include <glibmm/ustring.h>
+
+// Finds the tags that complete what was typed into a tag entry. Tags are
+// casefolded once when they are set and indexed by their trigrams, so a
+// lookup only visits tags that share the trigrams of the typed text.
+// Tags that contain the text rank first, then tags that contain it with a
+// typo, each ordered by their rank in a context, such as the tags that
+// co-occur with a query, and then by how often the tag is used.
+class CompletionIndex {
+    public:
+        CompletionIndex();
+
+        // pairs of tags and the number of items they are on
+        // the ids of the tags are their positions in this vector
+        void set_tags(const std::vector<std::pair<Glib::ustring, size_t>> &tags);
+
+        // applies pairs of tags and their new number of items, in any order
+        // tags with a count of zero are removed, unknown tags are added
+        // the ids of the other tags stay the same
+        void update_tags(const std::vector<std::pair<Glib::ustring, size_t>> &changes);
+
+        // one more than the largest id, removed tags leave gaps
+        size_t size() const;
+
+        // changes whenever tags are added or removed
+        size_t get_generation() const;
+
+        const Glib::ustring &get_tag(size_t id) const;
+        size_t get_count(size_t id) const;
+
+        // id of the tag or npos if there is no such tag
+        size_t find_id(const Glib::ustring &tag) const;
+
+        // id of the tag that was typed, ignoring case and surrounding white space,
+        // the tag spelled exactly like the text wins over other spellings
+        size_t find_typed_id(const Glib::ustring &text) const;
+
+        // ids of the best matching tags, best first
+        // the context maps ids to ranks, lower ranks come first
+        std::vector<size_t> find(const Glib::ustring &key,
+                                 size_t max_results = std::numeric_limits<size_t>::max(),
+                                 const std::unordered_map<size_t, size_t> *context = nullptr) const;
+
+        static const size_t npos = std::numeric_limits<size_t>::max();
+
+        // the form tags are compared in, casefolded without surrounding white space
+        static std::string normalize(const Glib::ustring &tag);
+
+    private: class Entry {
+                 public:
+                     Glib::ustring tag;
+                     std::string folded;
+                     size_t count;
+             };
+
+    private: class Candidate {
+                 public:
+                     size_t id;
+
+                     // exact, prefix, word prefix, substring or a match with typos
+                     int match_class;
+                     int errors;
+
+                     // rank in the context, npos if the tag is not in it
+                     size_t context_rank;
+             };
+
+    private:
+        std::vector<Entry> entries;
+        std::unordered_map<std::string, size_t> ids;
+        std::unordered_multimap<std::string, size_t> folded_ids;
+        size_t generation;
+
+        // entries of removed tags, cleared but kept so the ids stay the same
+        size_t removed_count;
+
+        // ids of the tags containing each trigram of folded bytes, ascending
+        std::unordered_map<uint32_t, std::vector<uint32_t>> trigrams;
+
+        // functions
+        void add_tag(const Glib::ustring &tag, size_t count);
+        void remove_tag(size_t id);
+        std::vector<uint32_t> find_substring_candidates(const std::string &folded) const;
+        void add_fuzzy_candidates(const std::string &folded,
+                                  std::vector<bool> &found,
+                                  std::vector<Candidate> &candidates) const;
+        bool is_better(const Candidate &a, const Candidate &b) const;
+};
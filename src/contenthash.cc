@@ -0,0 +1,196 @@
+// standard library
+#include <cstring>
+#include <vector>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+
+// project
+#include "contenthash.hh"
+
+namespace {
+    const uint64_t prime_1 = 0x9E3779B185EBCA87ULL;
+    const uint64_t prime_2 = 0xC2B2AE3D27D4EB4FULL;
+    const uint64_t prime_3 = 0x165667B19E3779F9ULL;
+    const uint64_t prime_4 = 0x85EBCA77C2B2AE63ULL;
+    const uint64_t prime_5 = 0x27D4EB2F165667C5ULL;
+
+    // large reads keep the number of system calls low
+    const size_t read_size = 1 << 22;
+
+    uint64_t rotate_left(uint64_t value, int bits) {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    // xxHash is defined on little endian input
+    uint64_t read_64(const unsigned char *data) {
+        uint64_t value = 0;
+        for (int idx = 7; idx >= 0; idx--) {
+            value = (value << 8) | data[idx];
+        }
+        return value;
+    }
+
+    uint32_t read_32(const unsigned char *data) {
+        return (uint32_t)data[0] | ((uint32_t)data[1] << 8) |
+               ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
+    }
+
+    uint64_t round(uint64_t accumulator, uint64_t input) {
+        accumulator += input * prime_2;
+        accumulator = rotate_left(accumulator, 31);
+        return accumulator * prime_1;
+    }
+
+    uint64_t merge_round(uint64_t hash, uint64_t accumulator) {
+        hash ^= round(0, accumulator);
+        return hash * prime_1 + prime_4;
+    }
+}
+
+// ContentHash::Hasher implementation
+ContentHash::Hasher::Hasher(uint64_t seed)
+:
+    accumulators{seed + prime_1 + prime_2, seed + prime_2, seed, seed - prime_1},
+    total_length(0),
+    buffered(0),
+    seed(seed)
+{}
+
+void ContentHash::Hasher::update(const void *data, size_t length) {
+    const unsigned char *pos = static_cast<const unsigned char *>(data);
+    const unsigned char *end = pos + length;
+    total_length += length;
+
+    // complete a stripe started by a previous update
+    if (buffered > 0) {
+        size_t missing = sizeof(buffer) - buffered;
+        if (length < missing) {
+            std::memcpy(buffer + buffered, pos, length);
+            buffered += length;
+            return;
+        }
+
+        std::memcpy(buffer + buffered, pos, missing);
+        pos += missing;
+        for (int lane = 0; lane < 4; lane++) {
+            accumulators[lane] = round(accumulators[lane], read_64(buffer + lane * 8));
+        }
+        buffered = 0;
+    }
+
+    // whole stripes of 32 bytes
+    while (end - pos >= 32) {
+        for (int lane = 0; lane < 4; lane++) {
+            accumulators[lane] = round(accumulators[lane], read_64(pos + lane * 8));
+        }
+        pos += 32;
+    }
+
+    std::memcpy(buffer, pos, end - pos);
+    buffered = end - pos;
+}
+
+uint64_t ContentHash::Hasher::digest() const {
+    uint64_t hash;
+    if (total_length >= 32) {
+        hash = rotate_left(accumulators[0], 1) + rotate_left(accumulators[1], 7) +
+               rotate_left(accumulators[2], 12) + rotate_left(accumulators[3], 18);
+        for (int lane = 0; lane < 4; lane++) {
+            hash = merge_round(hash, accumulators[lane]);
+        }
+    }
+    else {
+        hash = seed + prime_5;
+    }
+
+    hash += total_length;
+
+    // the remaining bytes that do not fill a stripe
+    const unsigned char *pos = buffer;
+    const unsigned char *end = buffer + buffered;
+    for (; end - pos >= 8; pos += 8) {
+        hash ^= round(0, read_64(pos));
+        hash = rotate_left(hash, 27) * prime_1 + prime_4;
+    }
+    if (end - pos >= 4) {
+        hash ^= (uint64_t)read_32(pos) * prime_1;
+        hash = rotate_left(hash, 23) * prime_2 + prime_3;
+        pos += 4;
+    }
+    for (; pos < end; pos++) {
+        hash ^= (*pos) * prime_5;
+        hash = rotate_left(hash, 11) * prime_1;
+    }
+
+    // final mix so that every input bit affects every output bit
+    hash ^= hash >> 33;
+    hash *= prime_2;
+    hash ^= hash >> 29;
+    hash *= prime_3;
+    hash ^= hash >> 32;
+
+    return hash;
+}
+
+// ContentHash implementation
+bool ContentHash::hash_file(const std::string &file_path, uint64_t &hash,
+                            std::atomic<uint64_t> *bytes_read)
+{
+    int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) { return false; }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    Hasher hasher;
+    std::vector<unsigned char> data(read_size);
+    ssize_t length;
+    while ((length = read(fd, data.data(), data.size())) > 0) {
+        hasher.update(data.data(), length);
+        if (bytes_read != nullptr) {
+            *bytes_read += length;
+        }
+    }
+
+    close(fd);
+    if (length == -1) { return false; }
+
+    hash = hasher.digest();
+    return true;
+}
+
+uint64_t ContentHash::hash(const void *data, size_t length) {
+    Hasher hasher;
+    hasher.update(data, length);
+    return hasher.digest();
+}
+
+std::string ContentHash::to_string(uint64_t hash) {
+    const char digits[] = "0123456789abcdef";
+
+    std::string result(16, '0');
+    for (int idx = 15; idx >= 0; idx--) {
+        result[idx] = digits[hash & 0xf];
+        hash >>= 4;
+    }
+
+    return result;
+}
+
+bool ContentHash::from_string(std::string_view str, uint64_t &hash) {
+    if (str.size() != 16) { return false; }
+
+    uint64_t result = 0;
+    for (char c : str) {
+        int value;
+        if (c >= '0' && c <= '9') { value = c - '0'; }
+        else if (c >= 'a' && c <= 'f') { value = c - 'a' + 10; }
+        else { return false; }
+
+        result = (result << 4) | value;
+    }
+
+    hash = result;
+    return true;
+}
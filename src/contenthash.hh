@@ -0,0 +1,40 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <string_view>
+#include <atomic>
+#include <cstdint>
+#include <cstddef>
+
+// The 64 bit xxHash (XXH64) of file contents. Identical files have the same
+// hash, so it is used to find duplicates and files that were moved. Files
+// are read in large blocks and hashed as they are read.
+class ContentHash {
+    public: class Hasher {
+        public:
+            Hasher(uint64_t seed = 0);
+
+            void update(const void *data, size_t length);
+            uint64_t digest() const;
+
+        private:
+            uint64_t accumulators[4];
+            uint64_t total_length;
+            unsigned char buffer[32];
+            size_t buffered;
+            uint64_t seed;
+    };
+
+    public:
+        // returns false if the file cannot be read
+        // the number of bytes read so far is added to the counter, if there is one
+        static bool hash_file(const std::string &file_path, uint64_t &hash,
+                              std::atomic<uint64_t> *bytes_read = nullptr);
+
+        static uint64_t hash(const void *data, size_t length);
+
+        // hashes are stored as 16 lowercase hexadecimal digits
+        static std::string to_string(uint64_t hash);
+        static bool from_string(std::string_view str, uint64_t &hash);
+};
@@ -0,0 +1,378 @@
+// standard library
+#include <cstring>
+#include <algorithm>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// glib
+#include <glib.h>
+
+// project
+#include "dbfile.hh"
+#include "tagtokenizer.hh"
+#include "tagdictionary.hh"
+#include "contenthash.hh"
+
+namespace {
+    // sections smaller than this are not worth a thread of their own
+    const size_t min_section_size = 1 << 20;
+
+    const std::string_view header = "[TagView database file]";
+    const std::string_view item_boundary = "\n[item]\n";
+
+    bool starts_with(std::string_view str, std::string_view argument) {
+        return str.compare(0, argument.size(), argument) == 0;
+    }
+
+    Glib::ustring to_ustring(std::string_view str) {
+        return Glib::ustring(str.data(), str.data() + str.size());
+    }
+}
+
+// DbFile::ParseResult implementation
+DbFile::ParseResult::ParseResult()
+:
+    line_count(0),
+    error_line(0)
+{}
+
+// DbFile implementation
+DbFile::DbFile(const std::string &db_file_path)
+:
+    data(nullptr),
+    length(0),
+    body(nullptr),
+    end(nullptr)
+{
+    int fd = open(db_file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        throw TagDb::FileErrorException(db_file_path);
+    }
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == -1) {
+        close(fd);
+        throw TagDb::FileErrorException(db_file_path);
+    }
+
+    length = file_stat.st_size;
+
+    // an empty file cannot be mapped and has no header either
+    if (length == 0) {
+        close(fd);
+        throw TagDb::FileParseException(1);
+    }
+
+    data = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+
+    // the mapping stays valid after closing the descriptor
+    close(fd);
+
+    if (data == MAP_FAILED) {
+        data = nullptr;
+        throw TagDb::FileErrorException(db_file_path);
+    }
+
+    // the whole file is going to be read, let the kernel read ahead
+    madvise(data, length, MADV_WILLNEED);
+
+    // check first line for header
+    const char *begin = static_cast<const char *>(data);
+    end = begin + length;
+    const char *eol = static_cast<const char *>(std::memchr(begin, '\n', length));
+    if (eol == nullptr) { eol = end; }
+
+    if (std::string_view(begin, eol - begin) != header) {
+        munmap(data, length);
+        throw TagDb::FileParseException(1);
+    }
+
+    body = (eol == end) ? end : eol + 1;
+}
+
+DbFile::~DbFile() {
+    if (data != nullptr) {
+        munmap(data, length);
+    }
+}
+
+std::vector<DbFile::Section> DbFile::split(size_t section_count) const {
+    std::vector<DbFile::Section> result;
+
+    size_t body_size = get_body_size();
+    if (section_count > body_size / min_section_size) {
+        section_count = body_size / min_section_size;
+    }
+
+    // every boundary is moved forward to the start of the next
+    // [item] line, so that an item never spans two sections
+    const char *section_begin = body;
+    for (size_t idx = 1; idx < section_count; idx++) {
+        const char *target = body + (body_size / section_count) * idx - 1;
+        if (target < section_begin) { continue; }
+
+        const char *boundary = static_cast<const char *>(memmem(
+                    target, end - target, item_boundary.data(), item_boundary.size()));
+        if (boundary == nullptr) { break; }
+
+        // the section starts after the newline
+        boundary += 1;
+
+        result.push_back({section_begin, boundary});
+        section_begin = boundary;
+    }
+    result.push_back({section_begin, end});
+
+    return result;
+}
+
+size_t DbFile::get_body_size() const {
+    return end - body;
+}
+
+DbFile::ParseResult DbFile::parse(const DbFile::Section &section) {
+    DbFile::ParseResult result;
+
+    // validate the whole section once so that tags
+    // can be taken as they are when parsing the lines
+    const gchar *invalid = nullptr;
+    if (!g_utf8_validate(section.begin, section.end - section.begin, &invalid)) {
+        result.error_line = std::count(section.begin, static_cast<const char *>(invalid), '\n') + 1;
+        return result;
+    }
+
+    // tags seen in this section, the keys point into the mapped file
+    // so a tag only needs to be looked up in the dictionary once
+    std::unordered_map<std::string_view, const Glib::ustring *> seen_tags;
+
+    // buffer variables
+    std::string_view file_path;
+    TagDb::Item::Type type = TagDb::Item::Type::image;
+    std::vector<const Glib::ustring *> tags;
+    bool favorite = false;
+    bool hashed = false;
+    uint64_t hash = 0;
+    bool perceptual_hashed = false;
+    uint64_t perceptual_hash = 0;
+    size_t metadata_row = MetadataTable::npos;
+
+    const char *pos = section.begin;
+    while (pos < section.end) {
+        // find the end of the current line without copying it
+        const char *eol = static_cast<const char *>(std::memchr(pos, '\n', section.end - pos));
+        if (eol == nullptr) { eol = section.end; }
+
+        std::string_view line(pos, eol - pos);
+        pos = (eol == section.end) ? section.end : eol + 1;
+        result.line_count += 1;
+
+        // ignore empty lines
+        if (line.length() == 0) continue;
+
+        // use the # character for comments
+        if (line[0] == '#') continue;
+
+        // otherwise, if the line does not
+        // start with a [ character, report error
+        if (line[0] != '[') {
+            result.error_line = result.line_count;
+            return result;
+        }
+
+        // beginning a new item
+        // submit current buffer if viable
+        // clear buffer variables
+        if (line == "[item]") {
+            if (file_path.length() != 0 && tags.size() != 0) {
+                // add new item
+                result.items.push_back(TagDb::Item(to_ustring(file_path), type));
+                result.items.back().tags = std::move(tags);
+                result.items.back().favorite = favorite;
+                if (hashed) { result.items.back().set_hash(hash); }
+                if (perceptual_hashed) { result.items.back().set_perceptual_hash(perceptual_hash); }
+                result.items.back().metadata_row = metadata_row;
+
+                // reset buffer variables
+                file_path = std::string_view();
+                type = TagDb::Item::Type::image;
+                tags.clear();
+                favorite = false;
+                hashed = false;
+                perceptual_hashed = false;
+                metadata_row = MetadataTable::npos;
+            }
+        }
+
+        // check all possible entry types
+        else if (starts_with(line, "[path]")) {
+            file_path = line.substr(6);
+        }
+
+        else if (starts_with(line, "[type]")) {
+            if (line.substr(6) == "image") {
+                type = TagDb::Item::Type::image;
+            }
+            else if (line.substr(6) == "video") {
+                type = TagDb::Item::Type::video;
+            }
+            else {
+                result.error_line = result.line_count;
+                return result;
+            }
+        }
+
+        else if (starts_with(line, "[tags]")) {
+            tags = parse_tags(line.substr(6), seen_tags);
+        }
+
+        else if (starts_with(line, "[fave]")) {
+            if (line.substr(6) == "yes") {
+                favorite = true;
+            }
+            else if (line.substr(6) == "no") {
+                favorite = false;
+            }
+            else {
+                result.error_line = result.line_count;
+                return result;
+            }
+        }
+
+        else if (starts_with(line, "[hash]")) {
+            if (!ContentHash::from_string(line.substr(6), hash)) {
+                result.error_line = result.line_count;
+                return result;
+            }
+            hashed = true;
+        }
+
+        else if (starts_with(line, "[phash]")) {
+            if (!ContentHash::from_string(line.substr(7), perceptual_hash)) {
+                result.error_line = result.line_count;
+                return result;
+            }
+            perceptual_hashed = true;
+        }
+
+        else if (starts_with(line, "[meta]")) {
+            MetadataTable::Record record;
+            if (!MetadataTable::Record::from_string(line.substr(6), record)) {
+                result.error_line = result.line_count;
+                return result;
+            }
+            metadata_row = result.metadata.add(record);
+        }
+
+        else if (starts_with(line, "[dir]")) {
+            result.directories.insert(to_ustring(line.substr(5)));
+        }
+
+        else if (starts_with(line, "[exclude]")) {
+            for (const Glib::ustring *tag : parse_tags(line.substr(9), seen_tags)) {
+                result.default_excluded_tags.insert(*tag);
+            }
+        }
+
+        // rules are a tag followed by the tag it implies or stands for
+        else if (starts_with(line, "[implies]") || starts_with(line, "[alias]")) {
+            // the order of the tags matters, so they are not parsed as a tag list
+            bool implies = starts_with(line, "[implies]");
+            TagTokenizer tokenizer(line.substr(implies ? 9 : 7));
+            std::vector<std::string_view> rule_tags;
+            std::string_view tag;
+            while (tokenizer.next(tag)) {
+                rule_tags.push_back(tag);
+            }
+            if (rule_tags.size() != 2) {
+                result.error_line = result.line_count;
+                return result;
+            }
+
+            TagRules::Rule rule;
+            rule.type = implies ? TagRules::Rule::Type::IMPLIES : TagRules::Rule::Type::ALIAS;
+            rule.tag = to_ustring(rule_tags[0]);
+            rule.target = to_ustring(rule_tags[1]);
+            result.rules.push_back(rule);
+        }
+
+        // an album starts with its name, the lines after it belong to it
+        else if (starts_with(line, "[album]")) {
+            if (line.length() == 7) {
+                result.error_line = result.line_count;
+                return result;
+            }
+            result.albums.push_back(TagDb::Album());
+            result.albums.back().name = to_ustring(line.substr(7));
+        }
+
+        else if (starts_with(line, "[album-type]") && !result.albums.empty()) {
+            if (line.substr(12) == "or") {
+                result.albums.back().query_type = TagDb::QueryType::OR;
+            }
+            else if (line.substr(12) == "and") {
+                result.albums.back().query_type = TagDb::QueryType::AND;
+            }
+            else {
+                result.error_line = result.line_count;
+                return result;
+            }
+        }
+
+        else if (starts_with(line, "[album-include]") && !result.albums.empty()) {
+            for (const Glib::ustring *tag : parse_tags(line.substr(15), seen_tags)) {
+                result.albums.back().tags_include.insert(*tag);
+            }
+        }
+
+        else if (starts_with(line, "[album-exclude]") && !result.albums.empty()) {
+            for (const Glib::ustring *tag : parse_tags(line.substr(15), seen_tags)) {
+                result.albums.back().tags_exclude.insert(*tag);
+            }
+        }
+
+        else {
+            result.error_line = result.line_count;
+            return result;
+        }
+    }
+
+    // at the end of the section, if buffer variables are valid
+    // add last entry to the result
+    if (file_path.length() != 0 && tags.size() != 0) {
+        result.items.push_back(TagDb::Item(to_ustring(file_path), type));
+        result.items.back().tags = std::move(tags);
+        result.items.back().favorite = favorite;
+        if (hashed) { result.items.back().set_hash(hash); }
+        if (perceptual_hashed) { result.items.back().set_perceptual_hash(perceptual_hash); }
+        result.items.back().metadata_row = metadata_row;
+    }
+
+    return result;
+}
+
+std::vector<const Glib::ustring *> DbFile::parse_tags(
+        std::string_view str,
+        std::unordered_map<std::string_view, const Glib::ustring *> &seen_tags)
+{
+    std::vector<const Glib::ustring *> result;
+
+    TagTokenizer tokenizer(str);
+    std::string_view tag;
+    while (tokenizer.next(tag)) {
+        const Glib::ustring *&interned = seen_tags[tag];
+        if (interned == nullptr) {
+            interned = TagDictionary::intern(tag);
+        }
+        result.push_back(interned);
+    }
+
+    // items keep their tags sorted and without duplicates
+    std::sort(result.begin(), result.end(), TagDictionary::less);
+    result.erase(std::unique(result.begin(), result.end()), result.end());
+
+    return result;
+}
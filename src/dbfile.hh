@@ -0,0 +1,73 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+#include <unordered_map>
+
+// gtkmm
+#include <glibmm/ustring.h>
+
+// project
+#include "tagdb.hh"
+
+// A read-only memory mapping of a database file. The body of the file
+// can be split into sections at [item] boundaries which are then parsed
+// independently of each other, so that large files can be loaded in parallel.
+class DbFile {
+    // a range of complete lines within the mapped file
+    public: class Section {
+        public:
+            const char *begin;
+            const char *end;
+    };
+
+    // everything found while parsing a single section
+    public: class ParseResult {
+        public:
+            ParseResult();
+
+            std::vector<TagDb::Item> items;
+            std::set<Glib::ustring> directories;
+            std::set<Glib::ustring> default_excluded_tags;
+            std::vector<TagRules::Rule> rules;
+            std::vector<TagDb::Album> albums;
+
+            // the rows the items of the section refer to
+            MetadataTable metadata;
+
+            // number of lines in the section and the line of the
+            // first error relative to the start of the section
+            // an error line of 0 means that parsing was successful
+            size_t line_count;
+            size_t error_line;
+    };
+
+    public:
+        // throws TagDb::FileErrorException if the file cannot be mapped and
+        // TagDb::FileParseException if the header line is missing
+        DbFile(const std::string &db_file_path);
+        ~DbFile();
+
+        DbFile(const DbFile &) = delete;
+        DbFile &operator=(const DbFile &) = delete;
+
+        std::vector<Section> split(size_t section_count) const;
+        size_t get_body_size() const;
+
+        static ParseResult parse(const Section &section);
+
+    private:
+        // members
+        void *data;
+        size_t length;
+        const char *body;
+        const char *end;
+
+        // functions
+        static std::vector<const Glib::ustring *> parse_tags(
+                std::string_view str,
+                std::unordered_map<std::string_view, const Glib::ustring *> &seen_tags);
+};
@@ -0,0 +1,175 @@
+// standard library
+#include <future>
+
+// project
+#include "dbloader.hh"
+#include "workerpool.hh"
+
+DbLoader::DbLoader()
+:
+    cancelled(false),
+    loading(false),
+    dispatching(false),
+    generation(0)
+{
+    dispatcher.connect(sigc::mem_fun(*this, &DbLoader::on_dispatch));
+}
+
+DbLoader::~DbLoader() {
+    cancel();
+}
+
+void DbLoader::load(const std::string &db_file_path) {
+    cancel();
+
+    loading = true;
+    generation += 1;
+    thread = std::thread(&DbLoader::run, this, db_file_path);
+}
+
+void DbLoader::cancel() {
+    cancelled = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    cancelled = false;
+    generation += 1;
+
+    // drop whatever the cancelled load did not deliver yet
+    std::lock_guard<std::mutex> lock(mutex);
+    events.clear();
+    loading = false;
+}
+
+bool DbLoader::is_loading() const {
+    return loading;
+}
+
+sigc::signal<void (DbFile::ParseResult &)> DbLoader::signal_section_loaded() {
+    return private_section_loaded;
+}
+
+sigc::signal<void (double)> DbLoader::signal_progress() {
+    return private_progress;
+}
+
+sigc::signal<void ()> DbLoader::signal_finished() {
+    return private_finished;
+}
+
+sigc::signal<void (std::exception_ptr)> DbLoader::signal_failed() {
+    return private_failed;
+}
+
+void DbLoader::run(std::string db_file_path) {
+    try {
+        DbFile file(db_file_path);
+        WorkerPool pool;
+
+        // use more sections than threads, so that the
+        // results arrive in small steps from the start of the file
+        std::vector<DbFile::Section> sections = file.split(pool.size() * 8);
+        std::vector<std::future<DbFile::ParseResult>> futures;
+        for (const DbFile::Section &section : sections) {
+            futures.push_back(pool.submit([this, section](){
+                if (cancelled) { return DbFile::ParseResult(); }
+                return DbFile::parse(section);
+            }));
+        }
+
+        // deliver the sections in file order
+        // the header is the first line of the file
+        size_t line_number = 1;
+        size_t bytes_done = 0;
+        for (size_t idx = 0; idx < sections.size(); idx++) {
+            Event event;
+            event.type = Event::Type::SECTION;
+            event.section = futures.at(idx).get();
+
+            if (cancelled) { return; }
+
+            if (event.section.error_line != 0) {
+                throw TagDb::FileParseException(line_number + event.section.error_line);
+            }
+            line_number += event.section.line_count;
+
+            bytes_done += sections.at(idx).end - sections.at(idx).begin;
+            event.progress = file.get_body_size() == 0 ? 1.0 :
+                             (double)bytes_done / (double)file.get_body_size();
+
+            push_event(std::move(event));
+        }
+
+        Event event;
+        event.type = Event::Type::FINISHED;
+        event.progress = 1.0;
+        push_event(std::move(event));
+    }
+    catch (...) {
+        if (cancelled) { return; }
+
+        Event event;
+        event.type = Event::Type::FAILED;
+        event.progress = 1.0;
+        event.error = std::current_exception();
+        push_event(std::move(event));
+    }
+}
+
+void DbLoader::push_event(DbLoader::Event event) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        events.push_back(std::move(event));
+    }
+    dispatcher.emit();
+}
+
+void DbLoader::on_dispatch() {
+    // handlers may iterate the main loop, which can dispatch again
+    // the outer call keeps draining the queue so the order is kept
+    if (dispatching) { return; }
+    dispatching = true;
+
+    size_t current_generation = generation;
+    while (true) {
+        std::deque<Event> current_events;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current_events.swap(events);
+        }
+
+        if (current_events.empty()) { break; }
+
+        for (Event &event : current_events) {
+            switch (event.type) {
+                case Event::Type::SECTION: {
+                    private_progress.emit(event.progress);
+                    private_section_loaded.emit(event.section);
+                    break;
+                }
+                case Event::Type::FINISHED: {
+                    thread.join();
+                    loading = false;
+                    private_progress.emit(event.progress);
+                    private_finished.emit();
+                    break;
+                }
+                case Event::Type::FAILED: {
+                    thread.join();
+                    loading = false;
+                    private_failed.emit(event.error);
+                    break;
+                }
+            }
+
+            // a handler started a new load or cancelled this one,
+            // the remaining events belong to the old load
+            if (generation != current_generation) {
+                current_generation = generation;
+                break;
+            }
+        }
+    }
+
+    dispatching = false;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <exception>
+
+// gtkmm
+#include <glibmm/dispatcher.h>
+#include <sigc++/signal.h>
+
+// project
+#include "dbfile.hh"
+
+// Loads a database file on a background thread. Sections of the file are
+// handed to the GUI thread in file order as soon as they are parsed, so
+// the items at the beginning of the file can be shown before the rest
+// of the file is read. All signals are emitted on the GUI thread.
+class DbLoader {
+    public:
+        DbLoader();
+        ~DbLoader();
+
+        // a load that is still running is cancelled first
+        void load(const std::string &db_file_path);
+        void cancel();
+        bool is_loading() const;
+
+        // signal forwarding
+        sigc::signal<void (DbFile::ParseResult &)> signal_section_loaded();
+        sigc::signal<void (double)> signal_progress();
+        sigc::signal<void ()> signal_finished();
+
+        // the exception is a TagDb::FileErrorException or TagDb::FileParseException
+        sigc::signal<void (std::exception_ptr)> signal_failed();
+
+    private: class Event {
+                 public:
+                     enum class Type { SECTION, FINISHED, FAILED };
+
+                     Type type;
+                     DbFile::ParseResult section;
+                     double progress;
+                     std::exception_ptr error;
+             };
+
+    private:
+        // members
+        std::thread thread;
+        std::atomic<bool> cancelled;
+        bool loading;
+        bool dispatching;
+
+        // incremented whenever a load is started or cancelled
+        size_t generation;
+
+        // events passed from the loading thread to the GUI thread
+        Glib::Dispatcher dispatcher;
+        std::mutex mutex;
+        std::deque<Event> events;
+
+        // functions
+        void run(std::string db_file_path);
+        void push_event(Event event);
+
+        // signal handlers
+        void on_dispatch();
+
+        // signals
+        sigc::signal<void (DbFile::ParseResult &)> private_section_loaded;
+        sigc::signal<void (double)> private_progress;
+        sigc::signal<void ()> private_finished;
+        sigc::signal<void (std::exception_ptr)> private_failed;
+};
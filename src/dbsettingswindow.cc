@@ -3,7 +3,8 @@
 
 DbSettingsWindow::DbSettingsWindow(Gtk::Window &parent)
 :
-    dirs(ItemList::Type::INSIDE)
+    dirs(ItemList::Type::INSIDE),
+    rules(ItemList::Type::INSIDE)
 {
     // label setup
     lbl_dirs.set_markup("<span weight=\"bold\" size=\"large\">Directories</span>");
@@ -13,6 +14,18 @@ DbSettingsWindow::DbSettingsWindow(Gtk::Window &parent)
     lbl_default_exclude.set_halign(Gtk::Align::START);
     lbl_default_exclude.set_margin_top(30);
 
+    lbl_edit_tags.set_markup("<span weight=\"bold\" size=\"large\">Edit Tags</span>");
+    lbl_edit_tags.set_halign(Gtk::Align::START);
+    lbl_edit_tags.set_margin_top(30);
+
+    lbl_rules.set_markup("<span weight=\"bold\" size=\"large\">Tag Rules</span>");
+    lbl_rules.set_halign(Gtk::Align::START);
+    lbl_rules.set_margin_top(30);
+
+    lbl_keywords.set_markup("<span weight=\"bold\" size=\"large\">Keywords</span>");
+    lbl_keywords.set_halign(Gtk::Align::START);
+    lbl_keywords.set_margin_top(30);
+
     // button setup
     btn_add_dir.set_label("Add Directory");
     btn_add_dir.set_halign(Gtk::Align::START);
@@ -23,6 +36,66 @@ DbSettingsWindow::DbSettingsWindow(Gtk::Window &parent)
     // tag picker setup
     tp_exclude.set_label_markup("<span weight=\"bold\" size=\"large\">Tags</span>");
 
+    // only tags that are in the database can be edited
+    tp_edit_tags.set_label_markup("<span weight=\"bold\" size=\"large\">Tags</span>");
+    tp_edit_tags.set_allow_create_new_tag(false);
+
+    // bulk tag editing setup
+    entry_new_tag.set_placeholder_text("New tag");
+    entry_new_tag.set_hexpand(true);
+    btn_merge.set_label("Rename");
+    btn_merge.signal_clicked().connect(
+            sigc::mem_fun(*this, &DbSettingsWindow::on_merge));
+    merge_box.set_orientation(Gtk::Orientation::HORIZONTAL);
+    merge_box.set_spacing(10);
+    merge_box.append(entry_new_tag);
+    merge_box.append(btn_merge);
+
+    btn_add_to_gallery.set_label("Add To Gallery Items");
+    btn_add_to_gallery.signal_clicked().connect(
+            sigc::bind(sigc::mem_fun(*this, &DbSettingsWindow::on_retag_gallery_items), true));
+    btn_remove_from_gallery.set_label("Remove From Gallery Items");
+    btn_remove_from_gallery.signal_clicked().connect(
+            sigc::bind(sigc::mem_fun(*this, &DbSettingsWindow::on_retag_gallery_items), false));
+    retag_box.set_orientation(Gtk::Orientation::HORIZONTAL);
+    retag_box.set_spacing(10);
+    retag_box.append(btn_add_to_gallery);
+    retag_box.append(btn_remove_from_gallery);
+
+    // rules setup
+    entry_rule.set_placeholder_text("cat => animal or kitty = cat");
+    entry_rule.set_hexpand(true);
+    entry_rule.signal_activate().connect(
+            sigc::mem_fun(*this, &DbSettingsWindow::on_add_rule));
+    btn_add_rule.set_label("Add Rule");
+    btn_add_rule.signal_clicked().connect(
+            sigc::mem_fun(*this, &DbSettingsWindow::on_add_rule));
+    rule_box.set_orientation(Gtk::Orientation::HORIZONTAL);
+    rule_box.set_spacing(10);
+    rule_box.append(entry_rule);
+    rule_box.append(btn_add_rule);
+    rules.signal_contents_changed().connect(
+            sigc::mem_fun(*this, &DbSettingsWindow::on_rules_changed));
+
+    // keyword setup
+    btn_import_gallery_keywords.set_label("Import For Gallery Items");
+    btn_import_gallery_keywords.set_tooltip_text("Add the XMP and IPTC keywords of the files as tags");
+    btn_import_gallery_keywords.signal_clicked().connect(
+            [this](){ private_import_keywords.emit(true); });
+    btn_import_dir_keywords.set_label("Import For Directories");
+    btn_import_dir_keywords.set_tooltip_text("Add the XMP and IPTC keywords of the items in the directories as tags");
+    btn_import_dir_keywords.signal_clicked().connect(
+            [this](){ private_import_keywords.emit(false); });
+    btn_write_sidecars.set_label("Write Sidecars");
+    btn_write_sidecars.set_tooltip_text("Write the tags of the gallery items to XMP sidecar files");
+    btn_write_sidecars.signal_clicked().connect(
+            [this](){ private_write_sidecars.emit(); });
+    keyword_box.set_orientation(Gtk::Orientation::HORIZONTAL);
+    keyword_box.set_spacing(10);
+    keyword_box.append(btn_import_gallery_keywords);
+    keyword_box.append(btn_import_dir_keywords);
+    keyword_box.append(btn_write_sidecars);
+
     // warning dialog setup
     subdir_warning = std::make_unique<Gtk::MessageDialog>(*this, "Error Adding Directory",
             false, Gtk::MessageType::WARNING);
@@ -43,6 +116,15 @@ DbSettingsWindow::DbSettingsWindow(Gtk::Window &parent)
     box.append(btn_add_dir);
     box.append(lbl_default_exclude);
     box.append(tp_exclude);
+    box.append(lbl_edit_tags);
+    box.append(tp_edit_tags);
+    box.append(merge_box);
+    box.append(retag_box);
+    box.append(lbl_rules);
+    box.append(rules);
+    box.append(rule_box);
+    box.append(lbl_keywords);
+    box.append(keyword_box);
 
     // window setup (self)
     set_child(box);
@@ -53,13 +135,15 @@ DbSettingsWindow::DbSettingsWindow(Gtk::Window &parent)
     set_modal(true);
 }
 
-void DbSettingsWindow::set_completer_model(Glib::RefPtr<Gtk::ListStore> completer_list) {
-    tp_exclude.set_completer_model(completer_list);
+void DbSettingsWindow::set_completion_index(std::shared_ptr<const CompletionIndex> completion_index) {
+    tp_exclude.set_completion_index(completion_index);
+    tp_edit_tags.set_completion_index(completion_index);
 }
 
 void DbSettingsWindow::setup(const Glib::ustring &db_path,
                              const std::set<Glib::ustring> &directories,
                              const std::set<Glib::ustring> &default_exclude_tags,
+                             const std::set<TagRules::Rule> &tag_rules,
                              const std::string &prefix)
 {
     lbl_db_path.set_text(db_path);
@@ -74,6 +158,16 @@ void DbSettingsWindow::setup(const Glib::ustring &db_path,
         tp_exclude.add_tag(tag);
     }
 
+    tp_edit_tags.clear();
+    entry_new_tag.set_text("");
+
+    std::set<Glib::ustring> rule_texts;
+    for (const TagRules::Rule &rule : tag_rules) {
+        rule_texts.insert(rule.to_string());
+    }
+    rules.set_content(rule_texts);
+    entry_rule.set_text("");
+
     this->prefix = prefix;
 }
 
@@ -86,6 +180,37 @@ sigc::signal<void (const std::set<Glib::ustring> &)> DbSettingsWindow::signal_di
     return dirs.signal_contents_changed();
 }
 
+sigc::signal<void (const std::set<Glib::ustring> &, const Glib::ustring &)> DbSettingsWindow::signal_merge_tags() {
+    return private_merge_tags;
+}
+
+sigc::signal<void (const std::set<Glib::ustring> &, bool)> DbSettingsWindow::signal_retag_gallery_items() {
+    return private_retag_gallery_items;
+}
+
+sigc::signal<void (bool)> DbSettingsWindow::signal_import_keywords() {
+    return private_import_keywords;
+}
+
+sigc::signal<void ()> DbSettingsWindow::signal_write_sidecars() {
+    return private_write_sidecars;
+}
+
+sigc::signal<void (const std::set<TagRules::Rule> &)> DbSettingsWindow::signal_rules_changed() {
+    return private_rules_changed;
+}
+
+void DbSettingsWindow::show_warning(Glib::ustring primary, Glib::ustring secondary) {
+        message = std::make_unique<Gtk::MessageDialog>(*this, primary,
+                                                       false, Gtk::MessageType::WARNING);
+        message->set_secondary_text(secondary);
+        message->set_modal(true);
+        message->set_hide_on_close(true);
+        message->signal_response().connect(
+                sigc::hide(sigc::mem_fun(*message, &Gtk::Widget::hide)));
+        message->show();
+}
+
 bool DbSettingsWindow::on_close_request() {
     hide();
     return true;
@@ -121,3 +246,62 @@ void DbSettingsWindow::on_file_chooser_response(int respone_id) {
         }
     }
 }
+
+void DbSettingsWindow::on_merge() {
+    Glib::ustring new_tag = entry_new_tag.get_text();
+
+    // same rules as entering a tag in a tag picker
+    if (new_tag.find_first_not_of("\t \n") == Glib::ustring::npos ||
+        new_tag.find_first_of(",") != Glib::ustring::npos) {
+        show_warning("Error Renaming Tags", "Provide a new tag without commas");
+        return;
+    }
+    new_tag = new_tag.substr(new_tag.find_first_not_of("\t \n"));
+    new_tag = new_tag.substr(0, new_tag.find_last_not_of("\t \n") + 1);
+
+    if (tp_edit_tags.size() == 0) {
+        show_warning("Error Renaming Tags", "Choose at least one tag to rename");
+        return;
+    }
+
+    // several tags are merged into the new one
+    std::set<Glib::ustring> tags = tp_edit_tags.get_content();
+    tp_edit_tags.clear();
+    entry_new_tag.set_text("");
+
+    private_merge_tags.emit(tags, new_tag);
+}
+
+void DbSettingsWindow::on_retag_gallery_items(bool add) {
+    if (tp_edit_tags.size() == 0) {
+        show_warning("Error Editing Tags", "Choose at least one tag");
+        return;
+    }
+
+    private_retag_gallery_items.emit(tp_edit_tags.get_content(), add);
+}
+
+void DbSettingsWindow::on_add_rule() {
+    TagRules::Rule rule;
+    if (!TagRules::Rule::parse(entry_rule.get_text(), rule)) {
+        show_warning("Error Adding Rule", "Enter a rule like cat => animal or kitty = cat");
+        return;
+    }
+
+    // the list shows rules in one form, so an existing rule is not added again
+    entry_rule.set_text("");
+    if (rules.contains(rule.to_string())) { return; }
+    rules.append_and_notify(rule.to_string());
+}
+
+void DbSettingsWindow::on_rules_changed(const std::set<Glib::ustring> &rule_texts) {
+    std::set<TagRules::Rule> tag_rules;
+    for (const Glib::ustring &text : rule_texts) {
+        TagRules::Rule rule;
+        if (TagRules::Rule::parse(text, rule)) {
+            tag_rules.insert(rule);
+        }
+    }
+
+    private_rules_changed.emit(tag_rules);
+}
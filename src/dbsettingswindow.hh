@@ -9,24 +9,43 @@
 #include <gtkmm/box.h>
 #include <gtkmm/button.h>
 #include <gtkmm/label.h>
+#include <gtkmm/entry.h>
 #include <gtkmm/messagedialog.h>
 #include <gtkmm/filechooserdialog.h>
 
 // project
 #include "tagutils.hh"
+#include "tagrules.hh"
 
 class DbSettingsWindow : public Gtk::Window {
     public:
         DbSettingsWindow(Gtk::Window &parent);
 
-        void set_completer_model(Glib::RefPtr<Gtk::ListStore> completer_list);
+        void set_completion_index(std::shared_ptr<const CompletionIndex> completion_index);
         void setup(const Glib::ustring &db_path,
                    const std::set<Glib::ustring> &directories,
                    const std::set<Glib::ustring> &default_exclude_tags,
+                   const std::set<TagRules::Rule> &tag_rules,
                    const std::string &prefix);
         sigc::signal<void (const std::set<Glib::ustring> &)> signal_exclude_tags_changed();
         sigc::signal<void (const std::set<Glib::ustring> &)> signal_directoires_changed();
 
+        // the chosen tags and the tag they are merged into
+        sigc::signal<void (const std::set<Glib::ustring> &, const Glib::ustring &)> signal_merge_tags();
+
+        // the chosen tags and whether they are added to or removed from the gallery items
+        sigc::signal<void (const std::set<Glib::ustring> &, bool)> signal_retag_gallery_items();
+
+        // all rules after one was added or removed
+        sigc::signal<void (const std::set<TagRules::Rule> &)> signal_rules_changed();
+
+        // whether the keywords of the gallery items or of the items
+        // in the registered directories are imported as tags
+        sigc::signal<void (bool)> signal_import_keywords();
+
+        // the tags of the gallery items are written to XMP sidecars
+        sigc::signal<void ()> signal_write_sidecars();
+
     private:
         // widgets
         Gtk::Box box;
@@ -37,17 +56,54 @@ class DbSettingsWindow : public Gtk::Window {
         Gtk::Label lbl_default_exclude;
         TagPickerBase tp_exclude;
 
+        // bulk tag editing
+        Gtk::Label lbl_edit_tags;
+        TagPickerBase tp_edit_tags;
+        Gtk::Box merge_box;
+        Gtk::Entry entry_new_tag;
+        Gtk::Button btn_merge;
+        Gtk::Box retag_box;
+        Gtk::Button btn_add_to_gallery;
+        Gtk::Button btn_remove_from_gallery;
+        std::unique_ptr<Gtk::MessageDialog> message;
+
+        // implication and alias rules, shown in the form they are entered in
+        Gtk::Label lbl_rules;
+        ItemList rules;
+        Gtk::Box rule_box;
+        Gtk::Entry entry_rule;
+        Gtk::Button btn_add_rule;
+
+        // keywords of other programs
+        Gtk::Label lbl_keywords;
+        Gtk::Box keyword_box;
+        Gtk::Button btn_import_gallery_keywords;
+        Gtk::Button btn_import_dir_keywords;
+        Gtk::Button btn_write_sidecars;
+
         // members for adding directories
         std::unique_ptr<Gtk::MessageDialog> subdir_warning;
         std::unique_ptr<Gtk::FileChooserDialog> file_chooser;
         std::string prefix;
 
+        // functions
+        void show_warning(Glib::ustring primary, Glib::ustring secondary);
+
         // signal handlers
         bool on_close_request() override;
+        void on_merge();
+        void on_retag_gallery_items(bool add);
+        void on_add_rule();
+        void on_rules_changed(const std::set<Glib::ustring> &rule_texts);
         void on_add_directory();
         void on_file_chooser_response(int respone_id);
 
         // signals
         sigc::signal<void (const std::set<Glib::ustring> &)> private_exclude_tags_changed;
         sigc::signal<void (const std::set<Glib::ustring> &)> private_directoires_changed;
+        sigc::signal<void (const std::set<Glib::ustring> &, const Glib::ustring &)> private_merge_tags;
+        sigc::signal<void (const std::set<Glib::ustring> &, bool)> private_retag_gallery_items;
+        sigc::signal<void (const std::set<TagRules::Rule> &)> private_rules_changed;
+        sigc::signal<void (bool)> private_import_keywords;
+        sigc::signal<void ()> private_write_sidecars;
 };
@@ -0,0 +1,417 @@
+// standard library
+#include <algorithm>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+// project
+#include "dirwatcher.hh"
+#include "fsscanner.hh"
+
+namespace {
+    // a batch is reported once nothing happened for this long,
+    // but never later than the maximum delay after its first event
+    const long quiet_period_ms = 250;
+    const long max_delay_ms = 2000;
+
+    // enough for a few hundred events per read
+    const size_t event_buffer_size = 1 << 16;
+
+    const uint32_t watch_mask = IN_CLOSE_WRITE | IN_MOVED_FROM | IN_MOVED_TO |
+                                IN_DELETE | IN_CREATE | IN_ONLYDIR;
+
+    std::string join_path(const std::string &dir, const std::string &name) {
+        return dir.empty() ? name : dir + "/" + name;
+    }
+
+    std::string parent_dir(const std::string &path) {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? std::string() : path.substr(0, slash);
+    }
+
+    bool is_inside(const std::string &path, const std::string &dir) {
+        return path.size() > dir.size() && path.compare(0, dir.size(), dir) == 0 && path[dir.size()] == '/';
+    }
+
+    bool is_item_path(const std::string &path) {
+        std::string name = path.substr(path.find_last_of('/') + 1);
+        return FsScanner::is_image_name(name) || FsScanner::is_video_name(name);
+    }
+}
+
+// DirWatcher::Changes implementation
+DirWatcher::Changes::Changes()
+:
+    overflowed(false)
+{}
+
+// DirWatcher implementation
+DirWatcher::DirWatcher()
+:
+    fd(-1),
+    overflowed(false)
+{}
+
+DirWatcher::~DirWatcher() {
+    stop();
+}
+
+void DirWatcher::watch(const std::string &prefix,
+                       const std::set<Glib::ustring> &directories,
+                       const std::vector<Glib::ustring> &tracked_items)
+{
+    stop();
+
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd == -1) { return; }
+
+    this->prefix = prefix;
+
+    add_watch("", false);
+    for (const Glib::ustring &dir : directories) {
+        add_watch(dir.raw(), true);
+    }
+
+    // items may also be outside of the registered directories
+    std::set<std::string> item_dirs;
+    for (const Glib::ustring &item : tracked_items) {
+        item_dirs.insert(parent_dir(item.raw()));
+    }
+    for (const std::string &dir : item_dirs) {
+        add_watch(dir, false);
+    }
+
+    io_connection = Glib::signal_io().connect(
+            sigc::mem_fun(*this, &DirWatcher::on_io), fd, Glib::IOCondition::IO_IN);
+}
+
+void DirWatcher::add_items(const std::vector<Glib::ustring> &items) {
+    if (fd == -1) { return; }
+
+    std::set<std::string> item_dirs;
+    for (const Glib::ustring &item : items) {
+        item_dirs.insert(parent_dir(item.raw()));
+    }
+    for (const std::string &dir : item_dirs) {
+        add_watch(dir, false);
+    }
+}
+
+void DirWatcher::stop() {
+    io_connection.disconnect();
+    flush_connection.disconnect();
+
+    if (fd != -1) {
+        close(fd);
+        fd = -1;
+    }
+
+    watches.clear();
+    pending_moves.clear();
+    moved_files.clear();
+    moved_dirs.clear();
+    removed.clear();
+    removed_dirs.clear();
+    modified.clear();
+    overflowed = false;
+}
+
+sigc::signal<void (const DirWatcher::Changes &)> DirWatcher::signal_changed() {
+    return private_changed;
+}
+
+void DirWatcher::add_watch(const std::string &dir, bool recursive) {
+    std::string full_path = prefix + dir;
+
+    // watching fails past the system's limit of watches,
+    // changes in such directories are only found by scanning
+    int wd = inotify_add_watch(fd, full_path.c_str(), watch_mask | (dir.empty() ? 0 : IN_DONT_FOLLOW));
+    if (wd == -1) { return; }
+
+    // a directory that is already watched gets the same descriptor
+    auto iter = watches.find(wd);
+    if (iter != watches.end()) {
+        if (iter->second.recursive || !recursive) { return; }
+        iter->second.recursive = true;
+    }
+    else {
+        watches[wd] = Watch{dir, recursive};
+    }
+
+    if (!recursive) { return; }
+
+    DIR *dir_stream = opendir(full_path.c_str());
+    if (dir_stream == nullptr) { return; }
+
+    // symbolic links to directories are not followed
+    std::vector<std::string> subdirs;
+    while (struct dirent *entry = readdir(dir_stream)) {
+        if (entry->d_name[0] == '.') { continue; }
+
+        bool is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat entry_stat;
+            is_dir = fstatat(dirfd(dir_stream), entry->d_name, &entry_stat, AT_SYMLINK_NOFOLLOW) == 0 &&
+                     S_ISDIR(entry_stat.st_mode);
+        }
+
+        if (is_dir) {
+            subdirs.push_back(join_path(dir, entry->d_name));
+        }
+    }
+    closedir(dir_stream);
+
+    for (const std::string &subdir : subdirs) {
+        add_watch(subdir, true);
+    }
+}
+
+void DirWatcher::remove_watches(const std::string &dir) {
+    for (auto iter = watches.begin(); iter != watches.end();) {
+        if (iter->second.dir == dir || is_inside(iter->second.dir, dir)) {
+            inotify_rm_watch(fd, iter->first);
+            iter = watches.erase(iter);
+        }
+        else {
+            ++iter;
+        }
+    }
+}
+
+void DirWatcher::file_moved(const std::string &old_path, const std::string &new_path) {
+    // a file moved twice in one batch only moves once
+    std::string original_path = old_path;
+    auto iter = moved_files.find(old_path);
+    if (iter != moved_files.end()) {
+        original_path = iter->second;
+        moved_files.erase(iter);
+    }
+
+    // a file moved over the destination earlier in the batch is gone
+    auto replaced = moved_files.find(new_path);
+    if (replaced != moved_files.end()) {
+        removed.insert(replaced->second);
+        moved_files.erase(replaced);
+    }
+
+    removed.erase(new_path);
+    if (original_path != new_path) {
+        moved_files[new_path] = original_path;
+    }
+
+    if (modified.erase(old_path) != 0) {
+        modified.insert(new_path);
+    }
+}
+
+void DirWatcher::dir_moved(const std::string &old_dir, const std::string &new_dir, bool recursive) {
+    if (recursive) {
+        for (auto &watch : watches) {
+            if (watch.second.dir == old_dir) {
+                watch.second.dir = new_dir;
+            }
+            else if (is_inside(watch.second.dir, old_dir)) {
+                watch.second.dir = new_dir + watch.second.dir.substr(old_dir.size());
+            }
+        }
+    }
+    else {
+        // the new location is not watched with its subdirectories
+        remove_watches(old_dir);
+    }
+
+    // files moved in this batch are now somewhere else
+    std::map<std::string, std::string> updated_files;
+    for (auto &entry : moved_files) {
+        if (is_inside(entry.first, old_dir)) {
+            updated_files[new_dir + entry.first.substr(old_dir.size())] = entry.second;
+        }
+        else {
+            updated_files[entry.first] = entry.second;
+        }
+    }
+    moved_files.swap(updated_files);
+
+    std::set<std::string> updated_modified;
+    for (const std::string &path : modified) {
+        if (is_inside(path, old_dir)) {
+            updated_modified.insert(new_dir + path.substr(old_dir.size()));
+        }
+        else {
+            updated_modified.insert(path);
+        }
+    }
+    modified.swap(updated_modified);
+
+    moved_dirs.push_back(std::make_pair(old_dir, new_dir));
+}
+
+void DirWatcher::file_removed(const std::string &path) {
+    auto iter = moved_files.find(path);
+    if (iter != moved_files.end()) {
+        removed.insert(iter->second);
+        moved_files.erase(iter);
+    }
+    else {
+        removed.insert(path);
+    }
+
+    modified.erase(path);
+}
+
+void DirWatcher::file_appeared(const std::string &path) {
+    // a file that is removed and written again, as some
+    // programs do when saving, is only modified
+    removed.erase(path);
+    modified.insert(path);
+}
+
+void DirWatcher::schedule_flush() {
+    auto now = std::chrono::steady_clock::now();
+    if (!flush_connection.connected()) {
+        first_event_time = now;
+    }
+    flush_connection.disconnect();
+
+    long waited = std::chrono::duration_cast<std::chrono::milliseconds>(now - first_event_time).count();
+    long delay = std::max(0L, std::min(quiet_period_ms, max_delay_ms - waited));
+
+    flush_connection = Glib::signal_timeout().connect(sigc::mem_fun(*this, &DirWatcher::on_flush), delay);
+}
+
+bool DirWatcher::on_io(Glib::IOCondition condition) {
+    alignas(struct inotify_event) char buffer[event_buffer_size];
+
+    ssize_t bytes_read;
+    while ((bytes_read = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < bytes_read;) {
+            const struct inotify_event *event = reinterpret_cast<const struct inotify_event *>(buffer + offset);
+            offset += sizeof(struct inotify_event) + event->len;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflowed = true;
+                continue;
+            }
+
+            auto watch = watches.find(event->wd);
+            if (watch == watches.end()) { continue; }
+
+            // the watched directory itself was removed
+            if (event->mask & IN_IGNORED) {
+                watches.erase(watch);
+                continue;
+            }
+
+            // events without a name are about the directory itself
+            if (event->len == 0 || event->name[0] == '.') { continue; }
+
+            std::string path = join_path(watch->second.dir, event->name);
+            bool is_dir = event->mask & IN_ISDIR;
+            bool recursive = watch->second.recursive;
+
+            if (event->mask & IN_MOVED_FROM) {
+                pending_moves[event->cookie] = PendingMove{path, is_dir};
+            }
+            else if (event->mask & IN_MOVED_TO) {
+                auto move = pending_moves.find(event->cookie);
+                if (move != pending_moves.end()) {
+                    if (is_dir) {
+                        dir_moved(move->second.path, path, recursive);
+                    }
+                    else {
+                        file_moved(move->second.path, path);
+                    }
+                    pending_moves.erase(move);
+                }
+                else if (is_dir) {
+                    // moved here from outside of the watched directories
+                    if (recursive) { add_watch(path, true); }
+                }
+                else {
+                    file_appeared(path);
+                }
+            }
+            else if (event->mask & IN_CLOSE_WRITE) {
+                file_appeared(path);
+            }
+            else if (event->mask & IN_DELETE) {
+                if (is_dir) {
+                    removed_dirs.insert(path);
+                }
+                else {
+                    file_removed(path);
+                }
+            }
+            else if ((event->mask & IN_CREATE) && is_dir && recursive) {
+                add_watch(path, true);
+            }
+        }
+    }
+
+    schedule_flush();
+    return true;
+}
+
+bool DirWatcher::on_flush() {
+    // moves without a destination left the watched directories
+    for (const auto &move : pending_moves) {
+        if (move.second.is_dir) {
+            remove_watches(move.second.path);
+            removed_dirs.insert(move.second.path);
+        }
+        else {
+            file_removed(move.second.path);
+        }
+    }
+    pending_moves.clear();
+
+    // only images and videos can be items, an item renamed to another
+    // name, such as the backup an editor keeps while saving, is missing
+    Changes changes;
+    for (const auto &entry : moved_files) {
+        if (is_item_path(entry.first)) {
+            if (is_item_path(entry.second)) {
+                changes.paths.moved.push_back(std::make_pair(entry.second, entry.first));
+            }
+            else {
+                modified.insert(entry.first);
+            }
+        }
+        else if (is_item_path(entry.second)) {
+            removed.insert(entry.second);
+        }
+    }
+    changes.paths.moved_dirs = moved_dirs;
+    for (const std::string &path : removed) {
+        if (is_item_path(path)) {
+            changes.paths.removed.push_back(path);
+        }
+    }
+    changes.paths.removed_dirs.assign(removed_dirs.begin(), removed_dirs.end());
+    for (const std::string &path : modified) {
+        if (is_item_path(path)) {
+            changes.modified.push_back(path);
+        }
+    }
+    changes.overflowed = overflowed;
+
+    moved_files.clear();
+    moved_dirs.clear();
+    removed.clear();
+    removed_dirs.clear();
+    modified.clear();
+    overflowed = false;
+
+    if (changes.paths.moved.size() > 0 || changes.paths.moved_dirs.size() > 0 ||
+        changes.paths.removed.size() > 0 || changes.paths.removed_dirs.size() > 0 ||
+        changes.modified.size() > 0 || changes.overflowed)
+    {
+        private_changed.emit(changes);
+    }
+
+    return false;
+}
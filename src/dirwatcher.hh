@@ -0,0 +1,109 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <vector>
+#include <set>
+#include <map>
+#include <unordered_map>
+#include <utility>
+#include <chrono>
+
+// gtkmm
+#include <glibmm/ustring.h>
+#include <glibmm/main.h>
+#include <sigc++/signal.h>
+
+// project
+#include "tagdb.hh"
+
+// Watches the database root and the registered directories with inotify.
+// Events are collected on the GUI thread and reported in batches once
+// the directories have been quiet for a moment, so that copying or moving
+// many files at once results in a single update of the database.
+class DirWatcher {
+    public: class Changes {
+        public:
+            Changes();
+
+            // changes to the paths of items, relative to the database prefix
+            TagDb::PathChanges paths;
+
+            // relative paths of images that were written or replaced
+            std::vector<std::string> modified;
+
+            // the kernel dropped events, the directories need to be scanned
+            bool overflowed;
+    };
+
+    public:
+        DirWatcher();
+        ~DirWatcher();
+
+        // registered directories are watched with their subdirectories,
+        // the root and the directories of tracked items without them
+        // watching again replaces the previous watches
+        void watch(const std::string &prefix,
+                   const std::set<Glib::ustring> &directories,
+                   const std::vector<Glib::ustring> &tracked_items);
+
+        // watches the directories of items that were added or
+        // moved after watch was called, relative to the prefix
+        void add_items(const std::vector<Glib::ustring> &items);
+        void stop();
+
+        // signal forwarding
+        sigc::signal<void (const Changes &)> signal_changed();
+
+    private: class Watch {
+                 public:
+                     // relative path of the watched directory
+                     std::string dir;
+                     bool recursive;
+             };
+
+    // the source of a move that did not see its destination yet
+    private: class PendingMove {
+                 public:
+                     std::string path;
+                     bool is_dir;
+             };
+
+    private:
+        // members
+        int fd;
+        std::string prefix;
+        sigc::connection io_connection;
+        sigc::connection flush_connection;
+        std::chrono::steady_clock::time_point first_event_time;
+
+        // watched directories by watch descriptor
+        std::unordered_map<int, Watch> watches;
+
+        // events collected since the last batch
+        std::unordered_map<uint32_t, PendingMove> pending_moves;
+
+        // current path of a moved file mapped to its path before the batch
+        std::map<std::string, std::string> moved_files;
+        std::vector<std::pair<std::string, std::string>> moved_dirs;
+        std::set<std::string> removed;
+        std::set<std::string> removed_dirs;
+        std::set<std::string> modified;
+        bool overflowed;
+
+        // functions
+        void add_watch(const std::string &dir, bool recursive);
+        void remove_watches(const std::string &dir);
+        void file_moved(const std::string &old_path, const std::string &new_path);
+        void dir_moved(const std::string &old_dir, const std::string &new_dir, bool recursive);
+        void file_removed(const std::string &path);
+        void file_appeared(const std::string &path);
+        void schedule_flush();
+
+        // signal handlers
+        bool on_io(Glib::IOCondition condition);
+        bool on_flush();
+
+        // signals
+        sigc::signal<void (const Changes &)> private_changed;
+};
@@ -0,0 +1,77 @@
+// gtkmm
+#include <gtkmm/expander.h>
+#include <gtkmm/button.h>
+#include <gtkmm/label.h>
+#include <glibmm/markup.h>
+
+// project
+#include "facetpanel.hh"
+
+FacetPanel::FacetPanel() {
+    // box setup
+    box.set_orientation(Gtk::Orientation::VERTICAL);
+    box.set_spacing(5);
+
+    // scrolled window setup
+    set_propagate_natural_height(true);
+    set_propagate_natural_width(true);
+    set_child(box);
+}
+
+void FacetPanel::set_facets(const std::vector<TagDb::Facet> &facets) {
+    clear();
+
+    for (const TagDb::Facet &facet : facets) {
+        Gtk::Expander *expander = Gtk::make_managed<Gtk::Expander>();
+        Gtk::Label *title = Gtk::make_managed<Gtk::Label>();
+        title->set_markup("<span weight=\"bold\">" + Glib::Markup::escape_text(facet.name) + "</span>  <small>" +
+                          std::to_string(facet.count) + "</small>");
+        expander->set_label_widget(*title);
+
+        Gtk::Box *values = Gtk::make_managed<Gtk::Box>(Gtk::Orientation::VERTICAL);
+        for (const auto &value : facet.values) {
+            // the namespace is already in the title
+            Glib::ustring tag = value.first;
+            Gtk::Label *label = Gtk::make_managed<Gtk::Label>();
+            label->set_markup(Glib::Markup::escape_text(tag.raw().substr(facet.name.size() + 1)) + "  <small>" +
+                              std::to_string(value.second) + "</small>");
+            label->set_halign(Gtk::Align::START);
+
+            Gtk::Button *button = Gtk::make_managed<Gtk::Button>();
+            button->set_has_frame(false);
+            button->set_child(*label);
+            button->set_tooltip_text("Include " + tag);
+            button->signal_clicked().connect([this, tag](){ private_tag_chosen.emit(tag); });
+            values->append(*button);
+        }
+        expander->set_child(*values);
+
+        std::string name = facet.name;
+        expander->set_expanded(expanded.count(name) != 0);
+        expander->property_expanded().signal_changed().connect([this, expander, name](){
+            on_expanded_changed(name, expander->get_expanded());
+        });
+
+        box.append(*expander);
+    }
+}
+
+void FacetPanel::clear() {
+    // the children are managed, removing them frees them
+    while (Gtk::Widget *child = box.get_first_child()) {
+        box.remove(*child);
+    }
+}
+
+sigc::signal<void (const Glib::ustring &)> FacetPanel::signal_tag_chosen() {
+    return private_tag_chosen;
+}
+
+void FacetPanel::on_expanded_changed(const std::string &name, bool is_expanded) {
+    if (is_expanded) {
+        expanded.insert(name);
+    }
+    else {
+        expanded.erase(name);
+    }
+}
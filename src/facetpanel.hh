@@ -0,0 +1,43 @@
+#pragma once
+
+// standard library
+#include <set>
+#include <string>
+#include <vector>
+
+// gtkmm
+#include <gtkmm/scrolledwindow.h>
+#include <gtkmm/box.h>
+#include <glibmm/ustring.h>
+#include <sigc++/signal.h>
+
+// project
+#include "tagdb.hh"
+
+// Shows the namespaces of the tags in the current result, such as person
+// or place for tags like person:alice, with the number of results in each.
+// Every namespace expands to its most common tags, choosing one of them
+// adds it to the query.
+class FacetPanel : public Gtk::ScrolledWindow {
+    public:
+        FacetPanel();
+
+        // replaces the shown facets, namespaces stay expanded if they still exist
+        void set_facets(const std::vector<TagDb::Facet> &facets);
+        void clear();
+
+        // signal forwarding
+        sigc::signal<void (const Glib::ustring &)> signal_tag_chosen();
+
+    private:
+        Gtk::Box box;
+
+        // names of the namespaces the user expanded
+        std::set<std::string> expanded;
+
+        // signal handlers
+        void on_expanded_changed(const std::string &name, bool is_expanded);
+
+        // signals
+        sigc::signal<void (const Glib::ustring &)> private_tag_chosen;
+};
@@ -0,0 +1,482 @@
+// standard library
+#include <algorithm>
+#include <cctype>
+#include <string_view>
+#include <future>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+// project
+#include "fsscanner.hh"
+#include "contenthash.hh"
+
+namespace {
+    // the layout used by the getdents64 system call
+    struct linux_dirent64 {
+        ino64_t d_ino;
+        off64_t d_off;
+        unsigned short d_reclen;
+        unsigned char d_type;
+        char d_name[];
+    };
+
+    // large enough to read most directories in a single call
+    const size_t dirent_buffer_size = 1 << 16;
+
+    // hidden files are never listed
+    bool is_listed_file(std::string_view name) {
+        return name.size() > 0 && name[0] != '.' &&
+               (FsScanner::is_image_name(name) || FsScanner::is_video_name(name));
+    }
+
+    std::string join_path(const std::string &dir, const std::string &name) {
+        return dir.empty() ? name : dir + "/" + name;
+    }
+
+    std::string parent_dir(const std::string &path) {
+        size_t slash = path.find_last_of('/');
+        return slash == std::string::npos ? std::string() : path.substr(0, slash);
+    }
+
+    std::string base_name(const std::string &path) {
+        return path.substr(path.find_last_of('/') + 1);
+    }
+}
+
+// FsScanner::DirSnapshot implementation
+FsScanner::DirSnapshot::DirSnapshot()
+:
+    device(0),
+    inode(0),
+    mtime_sec(0),
+    mtime_nsec(0)
+{}
+
+// FsScanner::Scan implementation
+FsScanner::Scan::Scan(WorkerPool &pool, int root_fd)
+:
+    pool(pool),
+    root_fd(root_fd),
+    pending(0)
+{}
+
+// FsScanner implementation
+FsScanner::FsScanner()
+:
+    cancelled(false),
+    finished(false),
+    scanning(false)
+{
+    dispatcher.connect(sigc::mem_fun(*this, &FsScanner::on_dispatch));
+}
+
+FsScanner::~FsScanner() {
+    cancel();
+}
+
+void FsScanner::scan(const std::string &prefix,
+                     const std::set<Glib::ustring> &directories,
+                     const std::vector<Glib::ustring> &tracked_items,
+                     const std::unordered_map<std::string, uint64_t> &item_hashes)
+{
+    cancel();
+
+    // the cached listings are relative to the previous prefix
+    if (prefix != snapshots_prefix) {
+        snapshots.clear();
+        snapshots_prefix = prefix;
+    }
+
+    std::vector<std::string> dirs;
+    for (const Glib::ustring &dir : directories) {
+        dirs.push_back(dir.raw());
+    }
+
+    std::vector<std::string> tracked;
+    tracked.reserve(tracked_items.size());
+    for (const Glib::ustring &item : tracked_items) {
+        tracked.push_back(item.raw());
+    }
+
+    scanning = true;
+    thread = std::thread(&FsScanner::run, this, prefix, std::move(dirs), std::move(tracked), item_hashes);
+}
+
+void FsScanner::cancel() {
+    cancelled = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    cancelled = false;
+    finished = false;
+    scanning = false;
+}
+
+bool FsScanner::is_scanning() const {
+    return scanning;
+}
+
+bool FsScanner::is_image_name(std::string_view name) {
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string_view::npos) { return false; }
+
+    std::string extension(name.substr(dot + 1));
+    for (char &c : extension) {
+        c = std::tolower(static_cast<unsigned char>(c));
+    }
+
+    return extension == "png" || extension == "jpg" || extension == "jpeg" ||
+           extension == "tif" || extension == "tiff" || extension == "gif" ||
+           extension == "webp" || extension == "bmp";
+}
+
+bool FsScanner::is_video_name(std::string_view name) {
+    size_t dot = name.find_last_of('.');
+    if (dot == std::string_view::npos) { return false; }
+
+    std::string extension(name.substr(dot + 1));
+    for (char &c : extension) {
+        c = std::tolower(static_cast<unsigned char>(c));
+    }
+
+    return extension == "mp4" || extension == "m4v" || extension == "mov" ||
+           extension == "mkv" || extension == "webm" || extension == "avi" ||
+           extension == "ogv" || extension == "mpg" || extension == "mpeg";
+}
+
+sigc::signal<void (const FsScanner::Result &)> FsScanner::signal_finished() {
+    return private_finished;
+}
+
+void FsScanner::run(std::string prefix,
+                    std::vector<std::string> directories,
+                    std::vector<std::string> tracked_items,
+                    std::unordered_map<std::string, uint64_t> item_hashes)
+{
+    result = Result();
+
+    int root_fd = open(prefix.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd == -1) {
+        finished = true;
+        dispatcher.emit();
+        return;
+    }
+
+    // the database root and the directories that contain tracked items
+    // are scanned without their subdirectories, unless they are
+    // inside one of the registered directories which are scanned fully
+    std::set<std::string> shallow_dirs;
+    shallow_dirs.insert("");
+    for (const std::string &item : tracked_items) {
+        shallow_dirs.insert(parent_dir(item));
+    }
+
+    std::unordered_set<std::string> found_files;
+    std::unordered_set<std::string> scanned_dirs;
+    {
+        WorkerPool pool;
+        Scan scan(pool, root_fd);
+
+        for (const std::string &dir : directories) {
+            submit_directory(scan, dir, true);
+        }
+
+        for (const std::string &dir : shallow_dirs) {
+            bool covered = false;
+            for (const std::string &recursive_dir : directories) {
+                if (dir == recursive_dir || dir.rfind(recursive_dir + "/", 0) == 0) {
+                    covered = true;
+                    break;
+                }
+            }
+            if (!covered) {
+                submit_directory(scan, dir, false);
+            }
+        }
+
+        // directories submit their subdirectories,
+        // so wait until nothing is pending anymore
+        std::unique_lock<std::mutex> lock(scan.mutex);
+        scan.done.wait(lock, [&scan](){ return scan.pending == 0; });
+
+        found_files.swap(scan.found_files);
+        scanned_dirs.swap(scan.scanned_dirs);
+    }
+
+    if (cancelled) {
+        close(root_fd);
+        return;
+    }
+
+    // compare the files on disk with the items in the database
+    std::unordered_set<std::string> tracked(tracked_items.begin(), tracked_items.end());
+
+    std::vector<std::string> untracked;
+    for (const std::string &file : found_files) {
+        if (tracked.count(file) == 0) {
+            untracked.push_back(file);
+        }
+    }
+
+    for (const std::string &item : tracked_items) {
+        if (found_files.count(item) != 0) { continue; }
+
+        // items that would not be listed, such as those outside of
+        // the scanned directories, are checked one by one
+        bool listed = scanned_dirs.count(parent_dir(item)) != 0 && is_listed_file(base_name(item));
+        if (listed || faccessat(root_fd, item.c_str(), F_OK, 0) != 0) {
+            result.missing.push_back(item);
+        }
+    }
+
+    close(root_fd);
+
+    std::vector<bool> missing_moved(result.missing.size(), false);
+    std::vector<bool> untracked_moved(untracked.size(), false);
+
+    // untracked files are only hashed if there are missing items to compare them with
+    bool compare_hashes = false;
+    for (const std::string &item : result.missing) {
+        if (item_hashes.count(item) != 0) {
+            compare_hashes = true;
+            break;
+        }
+    }
+
+    // a missing item and an untracked file with the same content are
+    // a move, the first of several identical files is taken
+    if (compare_hashes) {
+        std::vector<std::pair<bool, uint64_t>> untracked_hashes = hash_files(prefix, untracked);
+        if (cancelled) { return; }
+
+        std::unordered_map<uint64_t, size_t> untracked_by_hash;
+        for (size_t idx = 0; idx < untracked.size(); idx++) {
+            if (untracked_hashes.at(idx).first) {
+                untracked_by_hash.emplace(untracked_hashes.at(idx).second, idx);
+            }
+        }
+
+        for (size_t missing_idx = 0; missing_idx < result.missing.size(); missing_idx++) {
+            auto hash = item_hashes.find(result.missing.at(missing_idx));
+            if (hash == item_hashes.end()) { continue; }
+
+            auto iter = untracked_by_hash.find(hash->second);
+            if (iter == untracked_by_hash.end()) { continue; }
+
+            result.moved.push_back(std::make_pair(result.missing.at(missing_idx), untracked.at(iter->second)));
+            missing_moved.at(missing_idx) = true;
+            untracked_moved.at(iter->second) = true;
+            untracked_by_hash.erase(iter);
+        }
+    }
+
+    // otherwise a missing item and an untracked file with the same name
+    // are taken as a move, as long as the name is unique on both sides
+    std::unordered_map<std::string, std::vector<size_t>> missing_by_name;
+    for (size_t idx = 0; idx < result.missing.size(); idx++) {
+        if (!missing_moved.at(idx) && item_hashes.count(result.missing.at(idx)) == 0) {
+            missing_by_name[base_name(result.missing.at(idx))].push_back(idx);
+        }
+    }
+
+    std::unordered_map<std::string, std::vector<size_t>> untracked_by_name;
+    for (size_t idx = 0; idx < untracked.size(); idx++) {
+        if (!untracked_moved.at(idx)) {
+            untracked_by_name[base_name(untracked.at(idx))].push_back(idx);
+        }
+    }
+
+    for (const auto &entry : missing_by_name) {
+        auto iter = untracked_by_name.find(entry.first);
+        if (entry.second.size() != 1 || iter == untracked_by_name.end() || iter->second.size() != 1) {
+            continue;
+        }
+
+        size_t missing_idx = entry.second.at(0);
+        size_t untracked_idx = iter->second.at(0);
+        result.moved.push_back(std::make_pair(result.missing.at(missing_idx), untracked.at(untracked_idx)));
+        missing_moved.at(missing_idx) = true;
+        untracked_moved.at(untracked_idx) = true;
+    }
+
+    // items that were added before files were hashed get their hash
+    std::vector<std::string> unhashed;
+    for (const std::string &item : tracked_items) {
+        if (found_files.count(item) != 0 && item_hashes.count(item) == 0) {
+            unhashed.push_back(item);
+        }
+    }
+
+    std::vector<std::pair<bool, uint64_t>> item_file_hashes = hash_files(prefix, unhashed);
+    if (cancelled) { return; }
+
+    for (size_t idx = 0; idx < unhashed.size(); idx++) {
+        if (item_file_hashes.at(idx).first) {
+            result.hashed.push_back(std::make_pair(unhashed.at(idx), item_file_hashes.at(idx).second));
+        }
+    }
+
+    std::vector<std::string> missing;
+    for (size_t idx = 0; idx < result.missing.size(); idx++) {
+        if (!missing_moved.at(idx)) {
+            missing.push_back(result.missing.at(idx));
+        }
+    }
+    result.missing.swap(missing);
+
+    for (size_t idx = 0; idx < untracked.size(); idx++) {
+        if (!untracked_moved.at(idx)) {
+            result.untracked.push_back(prefix + untracked.at(idx));
+        }
+    }
+
+    std::sort(result.untracked.begin(), result.untracked.end());
+    std::sort(result.missing.begin(), result.missing.end());
+
+    finished = true;
+    dispatcher.emit();
+}
+
+std::vector<std::pair<bool, uint64_t>> FsScanner::hash_files(const std::string &prefix,
+                                                             const std::vector<std::string> &files)
+{
+    std::vector<std::pair<bool, uint64_t>> hashes(files.size(), std::make_pair(false, 0));
+    if (files.size() == 0) { return hashes; }
+
+    WorkerPool pool;
+    std::vector<std::future<void>> futures;
+    for (size_t idx = 0; idx < files.size(); idx++) {
+        futures.push_back(pool.submit([this, &prefix, &files, &hashes, idx](){
+            if (cancelled) { return; }
+            hashes.at(idx).first = ContentHash::hash_file(prefix + files.at(idx), hashes.at(idx).second);
+        }));
+    }
+    for (std::future<void> &future : futures) {
+        future.get();
+    }
+
+    return hashes;
+}
+
+void FsScanner::submit_directory(FsScanner::Scan &scan, const std::string &dir, bool recursive) {
+    {
+        std::lock_guard<std::mutex> lock(scan.mutex);
+        scan.pending += 1;
+    }
+
+    scan.pool.submit([this, &scan, dir, recursive](){ scan_directory(scan, dir, recursive); });
+}
+
+void FsScanner::scan_directory(FsScanner::Scan &scan, const std::string &dir, bool recursive) {
+    if (!cancelled) {
+        DirSnapshot snapshot = read_directory(scan.root_fd, dir);
+
+        {
+            std::lock_guard<std::mutex> lock(scan.mutex);
+            scan.scanned_dirs.insert(dir);
+            for (const std::string &file : snapshot.files) {
+                scan.found_files.insert(join_path(dir, file));
+            }
+        }
+
+        if (recursive) {
+            for (const std::string &subdir : snapshot.subdirs) {
+                submit_directory(scan, join_path(dir, subdir), true);
+            }
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(scan.mutex);
+    scan.pending -= 1;
+    if (scan.pending == 0) {
+        scan.done.notify_all();
+    }
+}
+
+FsScanner::DirSnapshot FsScanner::read_directory(int root_fd, const std::string &dir) {
+    DirSnapshot snapshot;
+
+    int fd = openat(root_fd, dir.empty() ? "." : dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1) { return snapshot; }
+
+    struct stat dir_stat;
+    if (fstat(fd, &dir_stat) == -1) {
+        close(fd);
+        return snapshot;
+    }
+
+    snapshot.device = dir_stat.st_dev;
+    snapshot.inode = dir_stat.st_ino;
+    snapshot.mtime_sec = dir_stat.st_mtim.tv_sec;
+    snapshot.mtime_nsec = dir_stat.st_mtim.tv_nsec;
+
+    // adding, removing or renaming an entry changes the modification
+    // time of the directory, if it is the same the old listing is valid
+    {
+        std::lock_guard<std::mutex> lock(snapshots_mutex);
+        auto iter = snapshots.find(dir);
+        if (iter != snapshots.end() &&
+            iter->second.device == snapshot.device &&
+            iter->second.inode == snapshot.inode &&
+            iter->second.mtime_sec == snapshot.mtime_sec &&
+            iter->second.mtime_nsec == snapshot.mtime_nsec)
+        {
+            close(fd);
+            return iter->second;
+        }
+    }
+
+    std::vector<char> buffer(dirent_buffer_size);
+    long bytes_read;
+    while ((bytes_read = syscall(SYS_getdents64, fd, buffer.data(), buffer.size())) > 0) {
+        for (long offset = 0; offset < bytes_read;) {
+            const linux_dirent64 *entry = reinterpret_cast<const linux_dirent64 *>(buffer.data() + offset);
+            offset += entry->d_reclen;
+
+            // skip . and .. as well as hidden entries
+            if (entry->d_name[0] == '.') { continue; }
+
+            // the type is only unknown on some file systems,
+            // symbolic links to directories are not followed
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                struct stat entry_stat;
+                bool is_link = (type == DT_LNK);
+                type = DT_UNKNOWN;
+                if (fstatat(fd, entry->d_name, &entry_stat, 0) == 0) {
+                    if (S_ISREG(entry_stat.st_mode)) { type = DT_REG; }
+                    else if (S_ISDIR(entry_stat.st_mode) && !is_link) { type = DT_DIR; }
+                }
+            }
+
+            if (type == DT_DIR) {
+                snapshot.subdirs.push_back(entry->d_name);
+            }
+            else if (type == DT_REG && is_listed_file(entry->d_name)) {
+                snapshot.files.push_back(entry->d_name);
+            }
+        }
+    }
+
+    close(fd);
+
+    std::lock_guard<std::mutex> lock(snapshots_mutex);
+    snapshots[dir] = snapshot;
+
+    return snapshot;
+}
+
+void FsScanner::on_dispatch() {
+    // a cancelled scan may still have notified
+    if (!scanning || !finished) { return; }
+
+    thread.join();
+    finished = false;
+    scanning = false;
+    private_finished.emit(result);
+}
@@ -0,0 +1,136 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <cstdint>
+
+// POSIX
+#include <sys/types.h>
+
+// gtkmm
+#include <glibmm/ustring.h>
+#include <glibmm/dispatcher.h>
+#include <sigc++/signal.h>
+
+// project
+#include "workerpool.hh"
+
+// Scans the database root and the registered directories on background
+// threads and compares the image files found there with the items in the
+// database. Directories that did not change since the previous scan are
+// not read again. Items are matched to untracked files by their content
+// hash, or by their name if they have none. Results are delivered on the
+// GUI thread.
+class FsScanner {
+    public: class Result {
+        public:
+            // absolute paths of images that are not in the database
+            std::vector<std::string> untracked;
+
+            // relative paths of items whose file was found at a new relative path
+            std::vector<std::pair<std::string, std::string>> moved;
+
+            // relative paths of items whose file could not be found
+            std::vector<std::string> missing;
+
+            // relative paths and content hashes of items that had no hash yet
+            std::vector<std::pair<std::string, uint64_t>> hashed;
+    };
+
+    public:
+        FsScanner();
+        ~FsScanner();
+
+        // the tracked items are the relative paths of all items in the database,
+        // the item hashes are those of the items that have a content hash
+        // a scan that is still running is cancelled first
+        void scan(const std::string &prefix,
+                  const std::set<Glib::ustring> &directories,
+                  const std::vector<Glib::ustring> &tracked_items,
+                  const std::unordered_map<std::string, uint64_t> &item_hashes);
+        void cancel();
+        bool is_scanning() const;
+
+        // whether a file name has the extension of a supported image format
+        static bool is_image_name(std::string_view name);
+
+        // whether a file name has the extension of a common video container,
+        // see VideoThumbnailer
+        static bool is_video_name(std::string_view name);
+
+        // signal forwarding
+        sigc::signal<void (const Result &)> signal_finished();
+
+    private: class DirSnapshot {
+                 public:
+                     DirSnapshot();
+
+                     // identity and modification time of the directory
+                     dev_t device;
+                     ino_t inode;
+                     long mtime_sec;
+                     long mtime_nsec;
+
+                     // names of image files and subdirectories
+                     std::vector<std::string> files;
+                     std::vector<std::string> subdirs;
+             };
+
+    // state shared by the threads of a single scan
+    private: class Scan {
+                 public:
+                     Scan(WorkerPool &pool, int root_fd);
+
+                     WorkerPool &pool;
+                     int root_fd;
+
+                     std::mutex mutex;
+                     std::condition_variable done;
+                     size_t pending;
+                     std::unordered_set<std::string> found_files;
+                     std::unordered_set<std::string> scanned_dirs;
+             };
+
+    private:
+        // members
+        std::thread thread;
+        std::atomic<bool> cancelled;
+        std::atomic<bool> finished;
+        bool scanning;
+
+        // directory listings of previous scans by relative path
+        std::unordered_map<std::string, DirSnapshot> snapshots;
+        std::string snapshots_prefix;
+        std::mutex snapshots_mutex;
+
+        // the result is passed from the scanning thread to the GUI thread
+        Glib::Dispatcher dispatcher;
+        Result result;
+
+        // functions
+        void run(std::string prefix,
+                 std::vector<std::string> directories,
+                 std::vector<std::string> tracked_items,
+                 std::unordered_map<std::string, uint64_t> item_hashes);
+        std::vector<std::pair<bool, uint64_t>> hash_files(const std::string &prefix,
+                                                          const std::vector<std::string> &files);
+        void submit_directory(Scan &scan, const std::string &dir, bool recursive);
+        void scan_directory(Scan &scan, const std::string &dir, bool recursive);
+        DirSnapshot read_directory(int root_fd, const std::string &dir);
+
+        // signal handlers
+        void on_dispatch();
+
+        // signals
+        sigc::signal<void (const Result &)> private_finished;
+};
@@ -0,0 +1,43 @@
+// project
+#include "imagehash.hh"
+
+namespace {
+    // one more column than bits per row, each bit compares two columns
+    const int hash_width = 9;
+    const int hash_height = 8;
+}
+
+uint64_t ImageHash::dhash(const Glib::RefPtr<Gdk::Pixbuf> &pixbuf) {
+    // the scaling integrates over the covered area when reducing
+    Glib::RefPtr<Gdk::Pixbuf> small = pixbuf->scale_simple(hash_width, hash_height, Gdk::InterpType::BILINEAR);
+
+    const guint8 *pixels = small->get_pixels();
+    int rowstride = small->get_rowstride();
+    int channels = small->get_n_channels();
+
+    // luma of every pixel, with transparent pixels taken as black
+    int grey[hash_height][hash_width];
+    for (int y = 0; y < hash_height; y++) {
+        for (int x = 0; x < hash_width; x++) {
+            const guint8 *pixel = pixels + y * rowstride + x * channels;
+            int value = channels >= 3 ? (pixel[0] * 299 + pixel[1] * 587 + pixel[2] * 114) / 1000 : pixel[0];
+            if (small->get_has_alpha()) {
+                value = value * pixel[channels - 1] / 255;
+            }
+            grey[y][x] = value;
+        }
+    }
+
+    uint64_t hash = 0;
+    for (int y = 0; y < hash_height; y++) {
+        for (int x = 0; x < hash_width - 1; x++) {
+            hash = (hash << 1) | (grey[y][x] > grey[y][x + 1] ? 1 : 0);
+        }
+    }
+
+    return hash;
+}
+
+int ImageHash::distance(uint64_t a, uint64_t b) {
+    return __builtin_popcountll(a ^ b);
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+// standard library
+#include <cstdint>
+
+// gtkmm
+#include <gdkmm/pixbuf.h>
+
+// Perceptual hashes of images (dHash). The image is reduced to 9x8 grey
+// pixels and every bit tells whether a pixel is brighter than its right
+// neighbour. Unlike content hashes, resized or re-encoded copies of an
+// image have hashes that differ in only a few bits.
+class ImageHash {
+    public:
+        // works on any decoded image, previews are large enough
+        static uint64_t dhash(const Glib::RefPtr<Gdk::Pixbuf> &pixbuf);
+
+        // number of differing bits
+        static int distance(uint64_t a, uint64_t b);
+};
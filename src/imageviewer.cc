@@ -1,21 +1,32 @@
 // gtkmm
+#include <giomm/file.h>
 #include "sigc++/functors/mem_fun.h"
 
 // project
 #include "imageviewer.hh"
+#include "fsscanner.hh"
 
 ImageViewer::ImageViewer()
 :
     // should use precise binary fractions for base, min, max, step
     zoom_adj(Gtk::Adjustment::create(1, 0.125, 3, 0.0625)),
     hadj(get_hadjustment()),
-    vadj(get_vadjustment())
+    vadj(get_vadjustment()),
+    showing_video(false)
 {
     // picture setup
     pic.set_keep_aspect_ratio(true);
     pic.set_expand(true);
     set_child(pic);
 
+    // video setup
+    video.set_autoplay(true);
+    video.set_loop(true);
+    video.set_expand(true);
+
+    // animation setup
+    animation_player.signal_frame().connect(sigc::mem_fun(*this, &ImageViewer::on_animation_frame));
+
     // scrolled window setup
     set_propagate_natural_height(true);
     set_propagate_natural_width(true);
@@ -42,11 +53,38 @@ ImageViewer::ImageViewer()
 }
 
 bool ImageViewer::set_image(const std::string &file_path) {
+    animation_player.stop();
+
+    // the media stream decodes the video while it plays
+    if (FsScanner::is_video_name(file_path)) {
+        video.set_filename(file_path);
+        if (!showing_video) {
+            set_child(video);
+            showing_video = true;
+        }
+
+        return true;
+    }
+
     try {
-        buf = Gdk::Pixbuf::create_from_file(file_path);
+        // static images are loaded as animations with a single frame
+        Glib::RefPtr<Gdk::PixbufAnimation> animation = Gdk::PixbufAnimation::create_from_file(file_path);
+        if (animation->is_static_image()) {
+            buf = animation->get_static_image();
+        }
+        else {
+            buf = animation_player.play(animation);
+        }
         pic.set_pixbuf(buf);
         pic.set_can_shrink(true);
 
+        // only the video is stopped, the animation already plays
+        if (showing_video) {
+            video.set_file(Glib::RefPtr<Gio::File>());
+            set_child(pic);
+            showing_video = false;
+        }
+
         return true;
     }
     catch (Glib::Error &error) {
@@ -54,7 +92,14 @@ bool ImageViewer::set_image(const std::string &file_path) {
     }
 }
 
+void ImageViewer::stop() {
+    animation_player.stop();
+    video.set_file(Glib::RefPtr<Gio::File>());
+}
+
 void ImageViewer::zoom_in() {
+    if (showing_video) { return; }
+
     if (pic.get_can_shrink()) {
         zoom_adj->set_value(calculate_shrunken_zoom());
     }
@@ -69,6 +114,8 @@ void ImageViewer::zoom_in() {
 }
 
 void ImageViewer::zoom_out() {
+    if (showing_video) { return; }
+
     if (pic.get_can_shrink()) {
         zoom_adj->set_value(calculate_shrunken_zoom());
     }
@@ -82,12 +129,16 @@ void ImageViewer::zoom_out() {
 }
 
 void ImageViewer::zoom_reset() {
+    if (showing_video) { return; }
+
     zoom_adj->set_value(1);
     pic.set_pixbuf(buf);
     pic.set_can_shrink(true);
 }
 
 void ImageViewer::zoom_original() {
+    if (showing_video) { return; }
+
     zoom_adj->set_value(1);
     pic.set_pixbuf(buf);
     pic.set_can_shrink(false);
@@ -210,3 +261,16 @@ void ImageViewer::on_released(int n_pressed, double x, double y) {
     // std::cout << "click released: n: " << n_pressed << " x: " << x << " y: " << y << std::endl;
     mouse_down = false;
 }
+
+void ImageViewer::on_animation_frame(const Glib::RefPtr<Gdk::Pixbuf> &frame) {
+    buf = frame;
+
+    // frames are shown at the zoom level of the one before
+    if (pic.get_can_shrink() || zoom_adj->get_value() == 1) {
+        pic.set_pixbuf(buf);
+    }
+    else {
+        buf_zoom = buf->scale_simple(buf_zoom->get_width(), buf_zoom->get_height(), Gdk::InterpType::BILINEAR);
+        pic.set_pixbuf(buf_zoom);
+    }
+}
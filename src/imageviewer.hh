@@ -6,6 +6,7 @@
 // gtkmm
 #include <gtkmm/scrolledwindow.h>
 #include <gtkmm/picture.h>
+#include <gtkmm/video.h>
 #include <gtkmm/eventcontrollermotion.h>
 #include <gtkmm/eventcontrollerscroll.h>
 #include <gtkmm/gestureclick.h>
@@ -13,6 +14,9 @@
 #include <gdk/gdkpixbuf.h>
 #include <glibmm/value.h>
 
+// project
+#include "animationplayer.hh"
+
 class ImageViewer : public Gtk::ScrolledWindow {
 
     public:
@@ -20,8 +24,12 @@ class ImageViewer : public Gtk::ScrolledWindow {
         ImageViewer();
 
         // image loading functions
+        // videos are played with the controls of a GtkVideo instead
         bool set_image(const std::string &file_path);
 
+        // stops a video that is playing, when the viewer is hidden
+        void stop();
+
         // zoom functions
         void zoom_in();
         void zoom_out();
@@ -34,6 +42,13 @@ class ImageViewer : public Gtk::ScrolledWindow {
         Glib::RefPtr<Gdk::Pixbuf> buf;
         Glib::RefPtr<Gdk::Pixbuf> buf_zoom;
 
+        // frames of animated images replace buf while they play
+        AnimationPlayer animation_player;
+
+        // video components, zooming does not apply to them
+        Gtk::Video video;
+        bool showing_video;
+
         // event controllers
         Glib::RefPtr<Gtk::EventControllerMotion> motion_controller;
         Glib::RefPtr<Gtk::EventControllerScroll> scroll_controller;
@@ -53,6 +68,7 @@ class ImageViewer : public Gtk::ScrolledWindow {
         double calculate_shrunken_zoom();
 
         // signal handlers
+        void on_animation_frame(const Glib::RefPtr<Gdk::Pixbuf> &frame);
         void on_motion(double x, double y);
         void on_pressed(int n_times, double x, double y);
         void on_released(int n_times, double x, double y);
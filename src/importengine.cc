@@ -0,0 +1,335 @@
+// standard library
+#include <algorithm>
+#include <future>
+#include <cerrno>
+#include <cstring>
+#include <cstdio>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+
+// project
+#include "importengine.hh"
+#include "workerpool.hh"
+#include "contenthash.hh"
+
+namespace {
+    // copying is bound by the disks, more threads do not help
+    const size_t max_import_threads = 4;
+
+    // cancelling and progress are checked between chunks
+    const size_t copy_chunk_size = 1 << 26;
+
+    // for copying through user space where copy_file_range is not possible
+    const size_t buffer_size = 1 << 20;
+
+    // the known hashes map to paths relative to the database directory
+    bool is_destination_of(const std::string &destination, const std::string &relative_path) {
+        return destination.size() > relative_path.size() &&
+               destination.compare(destination.size() - relative_path.size(), std::string::npos, relative_path) == 0 &&
+               destination[destination.size() - relative_path.size() - 1] == '/';
+    }
+}
+
+ImportEngine::ImportEngine()
+:
+    cancelled(false),
+    importing(false),
+    files_done(0),
+    file_count(0),
+    bytes_done(0),
+    bytes_total(0)
+{
+    dispatcher.connect(sigc::mem_fun(*this, &ImportEngine::on_dispatch));
+}
+
+ImportEngine::~ImportEngine() {
+    cancelled = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void ImportEngine::start(const std::vector<ImportEngine::Job> &jobs,
+                         const std::unordered_map<uint64_t, std::string> &known_hashes)
+{
+    if (importing) { return; }
+
+    cancelled = false;
+    importing = true;
+    files_done = 0;
+    file_count = jobs.size();
+    bytes_done = 0;
+    bytes_total = 0;
+    start_time = std::chrono::steady_clock::now();
+
+    thread = std::thread(&ImportEngine::run, this, jobs, known_hashes);
+}
+
+void ImportEngine::cancel() {
+    cancelled = true;
+}
+
+bool ImportEngine::is_importing() const {
+    return importing;
+}
+
+ImportEngine::Progress ImportEngine::get_progress() const {
+    Progress progress;
+    progress.files_done = files_done;
+    progress.file_count = file_count;
+    progress.bytes_done = bytes_done;
+    progress.bytes_total = bytes_total;
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_time).count();
+    progress.bytes_per_second = seconds > 0 ? progress.bytes_done / seconds : 0;
+
+    return progress;
+}
+
+sigc::signal<void (const std::vector<ImportEngine::Result> &)> ImportEngine::signal_finished() {
+    return private_finished;
+}
+
+void ImportEngine::run(std::vector<ImportEngine::Job> jobs,
+                       std::unordered_map<uint64_t, std::string> known_hashes)
+{
+    // the total size is only known after looking at every source
+    // files are read once for hashing, once more for copying and
+    // the copy is read again to verify it
+    for (const Job &job : jobs) {
+        struct stat source_stat;
+        if (stat(job.source.c_str(), &source_stat) == 0) {
+            bytes_total += source_stat.st_size * (job.action == Job::Action::KEEP ? 1 : 3);
+        }
+    }
+
+    std::vector<Result> import_results;
+    for (const Job &job : jobs) {
+        import_results.push_back(Result{job, false, "", false, 0, ""});
+    }
+
+    {
+        size_t thread_count = std::max(1u, std::thread::hardware_concurrency());
+        WorkerPool pool(std::min(thread_count, max_import_threads));
+
+        std::vector<std::future<void>> futures;
+        for (Result &result : import_results) {
+            futures.push_back(pool.submit([this, &result](){ hash_file(result); }));
+        }
+        for (std::future<void> &future : futures) {
+            future.get();
+        }
+
+        // duplicates are decided in order, so the first
+        // of several identical files is the one imported
+        std::unordered_map<uint64_t, std::string> batch_hashes;
+        for (Result &result : import_results) {
+            if (!result.hashed) { continue; }
+
+            auto known = known_hashes.find(result.hash);
+            auto earlier = batch_hashes.find(result.hash);
+            if (earlier != batch_hashes.end()) {
+                result.error = "The file is the same as " + earlier->second;
+                result.duplicate_of = earlier->second;
+            }
+            // adding an item again is not a duplicate of itself
+            else if (known != known_hashes.end() && !is_destination_of(result.job.destination, known->second)) {
+                result.error = "The file is already in the database as " + known->second;
+                result.duplicate_of = known->second;
+            }
+            else {
+                batch_hashes.emplace(result.hash, result.job.source);
+            }
+        }
+
+        futures.clear();
+        for (Result &result : import_results) {
+            futures.push_back(pool.submit([this, &result](){ import_file(result); }));
+        }
+        for (std::future<void> &future : futures) {
+            future.get();
+        }
+    }
+
+    results.swap(import_results);
+    dispatcher.emit();
+}
+
+void ImportEngine::hash_file(ImportEngine::Result &result) {
+    if (cancelled) { return; }
+
+    result.hashed = ContentHash::hash_file(result.job.source, result.hash, &bytes_done);
+}
+
+void ImportEngine::import_file(ImportEngine::Result &result) {
+    const Job &job = result.job;
+
+    if (cancelled) {
+        result.error = "Cancelled";
+        files_done += 1;
+        return;
+    }
+
+    // duplicates were found while hashing
+    if (result.duplicate_of.size() > 0) {
+        files_done += 1;
+        return;
+    }
+
+    struct stat source_stat;
+    if (!result.hashed || stat(job.source.c_str(), &source_stat) == -1) {
+        result.error = "The source file could not be read";
+        files_done += 1;
+        return;
+    }
+
+    if (job.action == Job::Action::KEEP) {
+        result.success = true;
+        files_done += 1;
+        return;
+    }
+
+    // within a file system a move is a rename that never replaces a file
+    if (job.action == Job::Action::MOVE) {
+        if (renameat2(AT_FDCWD, job.source.c_str(), AT_FDCWD, job.destination.c_str(), RENAME_NOREPLACE) == 0) {
+            // a renamed file is neither copied nor verified
+            bytes_done += source_stat.st_size * 2;
+            files_done += 1;
+            result.success = true;
+            return;
+        }
+
+        // other file systems or no support for the flag, copy instead
+        if (errno != EXDEV && errno != EINVAL && errno != ENOSYS) {
+            result.error = errno == EEXIST ? "The destination file already exists" : std::strerror(errno);
+            files_done += 1;
+            return;
+        }
+    }
+
+    int source_fd = open(job.source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd == -1) {
+        result.error = std::strerror(errno);
+        files_done += 1;
+        return;
+    }
+
+    // creating the destination exclusively also checks that it does not exist
+    int destination_fd = open(job.destination.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                              source_stat.st_mode & 0777);
+    if (destination_fd == -1) {
+        result.error = errno == EEXIST ? "The destination file already exists" : std::strerror(errno);
+        close(source_fd);
+        files_done += 1;
+        return;
+    }
+
+    posix_fadvise(source_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // a reflink shares the data with the source, where the file system supports it
+    bool copied;
+    if (ioctl(destination_fd, FICLONE, source_fd) == 0) {
+        bytes_done += source_stat.st_size;
+        copied = true;
+    }
+    else {
+        copied = copy_data(source_fd, destination_fd, source_stat.st_size, result.error);
+    }
+
+    // verify the copy against the hash of its source, which
+    // also finds sources that changed after they were hashed
+    uint64_t copy_hash = 0;
+    if (copied && (!ContentHash::hash_file(job.destination, copy_hash, &bytes_done) || copy_hash != result.hash)) {
+        result.error = "The copy does not match the source";
+        copied = false;
+    }
+
+    // the source is only removed once the copy is on the disk
+    if (copied && job.action == Job::Action::MOVE) {
+        if (fsync(destination_fd) == -1) {
+            result.error = std::strerror(errno);
+            copied = false;
+        }
+    }
+
+    close(source_fd);
+    close(destination_fd);
+
+    if (copied) {
+        if (job.action == Job::Action::MOVE) {
+            unlink(job.source.c_str());
+        }
+        result.success = true;
+    }
+    else {
+        // do not leave partial copies behind
+        unlink(job.destination.c_str());
+    }
+
+    files_done += 1;
+}
+
+bool ImportEngine::copy_data(int source_fd, int destination_fd, uint64_t size, std::string &error) {
+    uint64_t copied = 0;
+    bool in_kernel = true;
+    std::vector<char> buffer;
+
+    while (copied < size) {
+        if (cancelled) {
+            error = "Cancelled";
+            return false;
+        }
+
+        size_t chunk = std::min<uint64_t>(size - copied, copy_chunk_size);
+
+        ssize_t bytes;
+        if (in_kernel) {
+            bytes = copy_file_range(source_fd, nullptr, destination_fd, nullptr, chunk, 0);
+
+            // not supported between these files, both file
+            // positions are where copying stopped so just go on
+            if (bytes == -1 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                in_kernel = false;
+                continue;
+            }
+        }
+        else {
+            buffer.resize(buffer_size);
+            bytes = read(source_fd, buffer.data(), std::min(chunk, buffer_size));
+            for (ssize_t written = 0; bytes > 0 && written < bytes;) {
+                ssize_t result = write(destination_fd, buffer.data() + written, bytes - written);
+                if (result == -1) {
+                    bytes = -1;
+                    break;
+                }
+                written += result;
+            }
+        }
+
+        if (bytes == -1) {
+            error = std::strerror(errno);
+            return false;
+        }
+
+        // the source became shorter while copying
+        if (bytes == 0) { break; }
+
+        copied += bytes;
+        bytes_done += bytes;
+    }
+
+    return true;
+}
+
+void ImportEngine::on_dispatch() {
+    if (!importing) { return; }
+
+    thread.join();
+    importing = false;
+    private_finished.emit(results);
+}
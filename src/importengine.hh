@@ -0,0 +1,105 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+// gtkmm
+#include <glibmm/dispatcher.h>
+#include <sigc++/signal.h>
+
+// Copies or moves files into the database directories on a pool of
+// background threads. Copies are reflinked where the file system supports
+// it and use copy_file_range otherwise, so the data does not pass through
+// user space. Moves within a file system are renames. Every copy is hashed
+// and checked against the hash of its source before it counts as done.
+// All files are hashed first, files that are already in the database
+// or that appear twice in the same import are not imported.
+class ImportEngine {
+    public: class Job {
+        public:
+            // files that are already in place are only hashed
+            enum class Action { COPY, MOVE, KEEP };
+
+            std::string source;
+            std::string destination;
+            Action action;
+    };
+
+    public: class Result {
+        public:
+            Job job;
+            bool success;
+            std::string error;
+
+            // content hash of the source, see ContentHash
+            bool hashed;
+            uint64_t hash;
+
+            // relative path of the item with the same content
+            // or absolute path of the source imported instead
+            std::string duplicate_of;
+    };
+
+    public: class Progress {
+        public:
+            size_t files_done;
+            size_t file_count;
+            uint64_t bytes_done;
+            uint64_t bytes_total;
+            double bytes_per_second;
+    };
+
+    public:
+        ImportEngine();
+        ~ImportEngine();
+
+        // importing while an import is still running is not supported
+        // the known hashes are those of the items in the database
+        void start(const std::vector<Job> &jobs,
+                   const std::unordered_map<uint64_t, std::string> &known_hashes);
+
+        // jobs that did not finish yet fail, signal_finished is still emitted
+        void cancel();
+        bool is_importing() const;
+
+        // safe to call from the GUI thread while importing
+        Progress get_progress() const;
+
+        // signal forwarding
+        sigc::signal<void (const std::vector<Result> &)> signal_finished();
+
+    private:
+        // members
+        std::thread thread;
+        std::atomic<bool> cancelled;
+        bool importing;
+
+        // progress counters, written by the worker threads
+        std::atomic<size_t> files_done;
+        std::atomic<size_t> file_count;
+        std::atomic<uint64_t> bytes_done;
+        std::atomic<uint64_t> bytes_total;
+        std::chrono::steady_clock::time_point start_time;
+
+        // the results are passed from the importing thread to the GUI thread
+        Glib::Dispatcher dispatcher;
+        std::vector<Result> results;
+
+        // functions
+        void run(std::vector<Job> jobs, std::unordered_map<uint64_t, std::string> known_hashes);
+        void hash_file(Result &result);
+        void import_file(Result &result);
+        bool copy_data(int source_fd, int destination_fd, uint64_t size, std::string &error);
+
+        // signal handlers
+        void on_dispatch();
+
+        // signals
+        sigc::signal<void (const std::vector<Result> &)> private_finished;
+};
@@ -1,12 +1,13 @@
-// standard library
-#include <filesystem>
-
 // gtkmm
 #include <glibmm.h>
 
 // project
 #include "glibmm/spawn.h"
 #include "itemwindow.hh"
+#include "imagehash.hh"
+#include "metadatareader.hh"
+#include "fsscanner.hh"
+#include "videothumbnailer.hh"
 
 ItemWindow::ItemWindow(Gtk::Window &parent)
 :
@@ -15,7 +16,9 @@ ItemWindow::ItemWindow(Gtk::Window &parent)
     in_edit_mode(false),
     current_idx(0),
     suggestion_count(5),
-    preview_size(256)
+    preview_size(256),
+    preview_hashed(false),
+    preview_hash(0)
 {
     // item path setup
     btn_item_path.set_has_frame(false);
@@ -38,6 +41,9 @@ ItemWindow::ItemWindow(Gtk::Window &parent)
     // combo box setup
     combo_dirs.set_halign(Gtk::Align::START);
 
+    // files are copied unless moving is chosen, the choice is kept between items
+    chk_move.set_label(" Move files instead of copying");
+
     // tag editor setup
     tag_editor.set_label_markup("<span weight=\"bold\" size=\"large\">Tags</span>");
     tag_editor.set_hexpand(false);
@@ -74,6 +80,7 @@ ItemWindow::ItemWindow(Gtk::Window &parent)
 
     // checkbox setup
     chk_fav.set_label(" Favorite");
+    chk_batch.set_visible(false);
 
     // add mode buttons
     btn_skip.set_label("Skip");
@@ -125,7 +132,9 @@ ItemWindow::ItemWindow(Gtk::Window &parent)
     box.append(item_preview);
     box.append(lbl_copy_to_dir);
     box.append(combo_dirs);
+    box.append(chk_move);
     box.append(chk_fav);
+    box.append(chk_batch);
     box.append(editor_box);
     box.append(buttons_mode_add);
 
@@ -136,8 +145,8 @@ ItemWindow::ItemWindow(Gtk::Window &parent)
     set_modal(true);
 }
 
-void ItemWindow::set_completer_model(Glib::RefPtr<Gtk::ListStore> completer_list) {
-    tag_editor.set_completer_model(completer_list);
+void ItemWindow::set_completion_index(std::shared_ptr<const CompletionIndex> completion_index) {
+    tag_editor.set_completion_index(completion_index);
 }
 
 void ItemWindow::set_directories(const std::set<Glib::ustring> &directories) {
@@ -155,6 +164,9 @@ void ItemWindow::set_prefix(const std::string &prefix) {
 }
 
 void ItemWindow::set_suggestions(const std::vector<Glib::ustring> &tags) {
+    // the suggested tags also complete first
+    tag_editor.set_completion_context(tags);
+
     if (tags.size() == 0) {
         suggestions_box.set_visible(false);
         return;
@@ -183,6 +195,7 @@ void ItemWindow::set_suggestions(const std::vector<Glib::ustring> &tags) {
 
 void ItemWindow::add_items(const std::vector<std::string> &file_paths) {
     if (file_paths.size() == 0) { return; }
+    commit_staged_items();
     if (in_edit_mode) {
         box.remove(buttons_mode_edit);
         box.append(buttons_mode_add);
@@ -195,6 +208,7 @@ void ItemWindow::add_items(const std::vector<std::string> &file_paths) {
 }
 
 void ItemWindow::edit_item(const TagDb::Item &item) {
+    commit_staged_items();
     if (!in_edit_mode) {
         box.remove(buttons_mode_add);
         box.append(buttons_mode_edit);
@@ -205,8 +219,9 @@ void ItemWindow::edit_item(const TagDb::Item &item) {
     show();
 }
 
-sigc::signal<void (TagDb::Item)> ItemWindow::signal_add_item() {
-    return private_add_item;
+sigc::signal<void (const std::vector<TagDb::Item> &,
+                   const std::vector<ImportEngine::Job> &)> ItemWindow::signal_add_items() {
+    return private_add_items;
 }
 
 sigc::signal<void (TagDb::Item)> ItemWindow::signal_edit_item() {
@@ -217,6 +232,10 @@ sigc::signal<void (const std::set<Glib::ustring> &)> ItemWindow::signal_request_
     return private_request_suggestions;
 }
 
+sigc::signal<void (uint64_t)> ItemWindow::signal_request_visual_suggestions() {
+    return private_request_visual_suggestions;
+}
+
 sigc::signal<void (const Glib::ustring &, bool)> ItemWindow::signal_delete_item() {
     return private_delete_item;
 }
@@ -230,28 +249,43 @@ void ItemWindow::setup_for_add_item(size_t idx) {
 
     // do not copy if file is already in a valid subdirectory
     if (items_to_add.at(idx).rfind(prefix, 0) == 0) {
-        item_starts_with_prefix = true;
-
         lbl_copy_to_dir.set_visible(false);
         combo_dirs.set_visible(false);
+        chk_move.set_visible(false);
     }
     else {
-        item_starts_with_prefix = false;
-
         lbl_copy_to_dir.set_visible(true);
         combo_dirs.set_visible(true);
         combo_dirs.set_active(0);
+        chk_move.set_visible(true);
     }
 
     chk_fav.set_active(false);
     tag_editor.clear();
+
+    // keywords that other programs tagged the file with do not have to be typed again
+    std::vector<Glib::ustring> keywords;
+    if (MetadataReader::read_keywords(items_to_add.at(idx), keywords)) {
+        for (const Glib::ustring &keyword : keywords) {
+            tag_editor.add_tag(keyword);
+        }
+    }
+
     tag_suggestions.clear();
     suggestions_box.set_visible(false);
+    request_suggestions();
+
+    // offer to tag the rest of the items the same way
+    size_t remaining = items_to_add.size() - idx;
+    chk_batch.set_active(false);
+    chk_batch.set_label(" Add all " + std::to_string(remaining) + " remaining items with these tags");
+    chk_batch.set_visible(remaining > 1);
 }
 
 void ItemWindow::setup_for_edit_item(const TagDb::Item &item)
 {
     set_title("Edit Item");
+    chk_batch.set_visible(false);
     current_edited_item_file_path = item.get_file_path();
     btn_item_path.set_label(item.get_file_path());
     set_preview(prefix + item.get_file_path());
@@ -259,22 +293,29 @@ void ItemWindow::setup_for_edit_item(const TagDb::Item &item)
 
     lbl_copy_to_dir.set_visible(false);
     combo_dirs.set_visible(false);
+    chk_move.set_visible(false);
 
     tag_editor.clear();
     for (const Glib::ustring &tag : item.get_tags()) {
         tag_editor.add_tag(tag);
     }
-    private_request_suggestions.emit(tag_editor.get_content());
+    request_suggestions();
 }
 
 bool ItemWindow::set_preview(const Glib::ustring &file_path) {
     Glib::RefPtr<Gdk::Pixbuf> pbuf;
     try {
-        pbuf = Gdk::Pixbuf::create_from_file(file_path);
+        if (FsScanner::is_video_name(file_path.raw())) {
+            pbuf = VideoThumbnailer::create_thumbnail(file_path);
+        }
+        else {
+            pbuf = Gdk::Pixbuf::create_from_file(file_path);
+        }
     }
     catch (...) {
         item_preview_error.set_visible(true);
         item_preview.set_visible(false);
+        preview_hashed = false;
         return false;
     }
 
@@ -291,50 +332,34 @@ bool ItemWindow::set_preview(const Glib::ustring &file_path) {
 
     item_preview.set(pbuf);
 
+    // the gallery hashes its previews the same way
+    preview_hash = ImageHash::dhash(pbuf);
+    preview_hashed = true;
+
     item_preview_error.set_visible(false);
     item_preview.set_visible(true);
     return true;
 }
 
-bool ItemWindow::copy(const std::string &file_path) {
-    // item name is the part of the path after the last /
-    std::string item_name = file_path.substr(file_path.find_last_of("/") + 1);
-
-    // configure directory
-    std::string dir = combo_dirs.get_active_text();
-    if (dir == default_directory) { dir = ""; }
-    else { dir = dir + "/"; }
-
-    // establish destination
-    std::string destination_path = prefix + dir + item_name;
-
-    // check if the source file exists
-    if (!std::filesystem::exists(file_path)) {
-        show_warning("Error Copying File", "The source file could not be found.");
-        return false;
-    }
-
-    // check if the destination file already exists
-    if (std::filesystem::exists(destination_path)) {
-        show_warning("Error Copying File", "The destination file already exists.");
-        return false;
-    }
-
-    // perform the copy
-    try {
-        std::filesystem::copy_file(file_path, destination_path);
+void ItemWindow::request_suggestions() {
+    // an image without tags can only be matched by how it looks
+    if (tag_editor.get_content().size() == 0 && preview_hashed) {
+        private_request_visual_suggestions.emit(preview_hash);
     }
-    catch (...) {
-        show_warning("Error Copying File", "There was an error while copying the file.");
-        return false;
+    else {
+        private_request_suggestions.emit(tag_editor.get_content());
     }
+}
 
-    return true;
+std::string ItemWindow::get_destination_dir() const {
+    std::string dir = combo_dirs.get_active_text();
+    if (dir == default_directory) { return ""; }
+    return dir + "/";
 }
 
 TagDb::Item ItemWindow::create_db_item(size_t idx) {
     std::string item_path;
-    if (item_starts_with_prefix) {
+    if (items_to_add.at(idx).rfind(prefix, 0) == 0) {
         // if the full path starts with the prefix, then the
         // relative path is everything after the prefix
         item_path = items_to_add.at(idx).substr(prefix.size());
@@ -343,16 +368,51 @@ TagDb::Item ItemWindow::create_db_item(size_t idx) {
         // item name is the part of the path after the last /
         std::string item_name = items_to_add.at(idx).substr(items_to_add.at(idx).find_last_of("/") + 1);
 
-        // configure directory
-        std::string dir = combo_dirs.get_active_text();
-        if (dir == default_directory) { dir = ""; }
-        else { dir = dir + "/"; }
+        item_path = get_destination_dir() + item_name;
+    }
+
+    TagDb::Item::Type type = FsScanner::is_video_name(item_path) ? TagDb::Item::Type::video
+                                                                 : TagDb::Item::Type::image;
+
+    return TagDb::Item(item_path, type, tag_editor.get_content(), chk_fav.get_active());
+}
+
+void ItemWindow::stage_item(size_t idx) {
+    TagDb::Item item = create_db_item(idx);
+
+    // files outside of the database are imported, files already
+    // in a valid subdirectory are only hashed to find duplicates
+    std::string destination = prefix + item.get_file_path().raw();
+    if (items_to_add.at(idx).rfind(prefix, 0) != 0) {
+        ImportEngine::Job::Action action = chk_move.get_active() ? ImportEngine::Job::Action::MOVE
+                                                                 : ImportEngine::Job::Action::COPY;
+        staged_imports.push_back(ImportEngine::Job{items_to_add.at(idx), destination, action});
+    }
+    else {
+        staged_imports.push_back(ImportEngine::Job{destination, destination, ImportEngine::Job::Action::KEEP});
+    }
 
-        item_path = dir + item_name;
+    staged_items.push_back(item);
+}
+
+void ItemWindow::stage_remaining_items() {
+    for (; current_idx < items_to_add.size(); current_idx++) {
+        stage_item(current_idx);
     }
 
-    return TagDb::Item(item_path, TagDb::Item::Type::image,
-                       tag_editor.get_content(), chk_fav.get_active());
+    commit_staged_items();
+    hide();
+}
+
+void ItemWindow::commit_staged_items() {
+    if (staged_items.size() == 0) { return; }
+
+    // clear the staged items before emitting, in case a handler adds more
+    std::vector<TagDb::Item> items;
+    std::vector<ImportEngine::Job> imports;
+    items.swap(staged_items);
+    imports.swap(staged_imports);
+    private_add_items.emit(items, imports);
 }
 
 void ItemWindow::show_warning(Glib::ustring primary, Glib::ustring secondary) {
@@ -381,12 +441,12 @@ void ItemWindow::on_item_path_clicked() {
 }
 
 void ItemWindow::on_tag_editor_contents_changed(const std::set<Glib::ustring> &tags) {
-    private_request_suggestions.emit(tag_editor.get_content());
+    request_suggestions();
 }
 
 void ItemWindow::on_add_suggestion(const Glib::ustring &tag) {
     tag_editor.add_tag(tag);
-    private_request_suggestions.emit(tag_editor.get_content());
+    request_suggestions();
 }
 
 void ItemWindow::on_add() {
@@ -395,27 +455,26 @@ void ItemWindow::on_add() {
         return;
     }
 
+    else if (chk_batch.get_active()) {
+        stage_remaining_items();
+    }
+
     else {
-        bool result = true;
-        if (!item_starts_with_prefix) {
-            result = copy(items_to_add.at(current_idx));
+        stage_item(current_idx);
+        current_idx += 1;
+        if (current_idx == items_to_add.size()) {
+            commit_staged_items();
+            hide();
         }
-        if (result) {
-            private_add_item.emit(create_db_item(current_idx));
-
-            current_idx += 1;
-            if (current_idx == items_to_add.size()) {
-                hide();
-            }
-            else {
-                setup_for_add_item(current_idx);
-            }
+        else {
+            setup_for_add_item(current_idx);
         }
     }
 }
 
 void ItemWindow::on_skip() {
     if (current_idx == items_to_add.size() - 1) {
+        commit_staged_items();
         hide();
     }
     else {
@@ -448,6 +507,8 @@ void ItemWindow::on_delete_respone(int respone_id) {
 }
 
 bool ItemWindow::on_close_request() {
+    // items added before closing the window are kept
+    commit_staged_items();
     hide();
     return true;
 }
@@ -4,6 +4,7 @@
 #include <memory>
 #include <vector>
 #include <set>
+#include <cstdint>
 
 // gtkmm
 #include <gtkmm/window.h>
@@ -20,11 +21,12 @@
 // project
 #include "tagutils.hh"
 #include "tagdb.hh"
+#include "importengine.hh"
 
 class ItemWindow : public Gtk::Window {
     public:
         ItemWindow(Gtk::Window &parent);
-        void set_completer_model(Glib::RefPtr<Gtk::ListStore> completer_list);
+        void set_completion_index(std::shared_ptr<const CompletionIndex> completion_index);
         void set_directories(const std::set<Glib::ustring> &directories);
         void set_prefix(const std::string &prefix);
         void set_suggestions(const std::vector<Glib::ustring> &tags);
@@ -32,12 +34,23 @@ class ItemWindow : public Gtk::Window {
         void add_items(const std::vector<std::string> &file_paths);
         void edit_item(const TagDb::Item &item);
 
+        // emits signal_add_items for the items that were added so far,
+        // before the database changes or the program quits
+        void commit_staged_items();
+
         // signal forwarding
-        sigc::signal<void (TagDb::Item)> signal_add_item();
+        // added items are staged and emitted together once adding is done,
+        // along with the files that need to be imported into the database
+        sigc::signal<void (const std::vector<TagDb::Item> &,
+                           const std::vector<ImportEngine::Job> &)> signal_add_items();
         sigc::signal<void (TagDb::Item)> signal_edit_item();
         sigc::signal<void (const Glib::ustring &, bool)> signal_delete_item();
         sigc::signal<void (const std::set<Glib::ustring> &)> signal_request_suggestions();
 
+        // requested instead while the item has no tags, with the
+        // perceptual hash of its image, see ImageHash
+        sigc::signal<void (uint64_t)> signal_request_visual_suggestions();
+
     private: class DeleteDialog : public Gtk::MessageDialog {
                  public:
                      DeleteDialog(ItemWindow &parent);
@@ -58,7 +71,9 @@ class ItemWindow : public Gtk::Window {
 
         Gtk::Label lbl_copy_to_dir;
         Gtk::ComboBoxText combo_dirs;
+        Gtk::CheckButton chk_move;
         Gtk::CheckButton chk_fav;
+        Gtk::CheckButton chk_batch;
 
         // tag editor with suggestions
         Gtk::Box editor_box;
@@ -80,7 +95,6 @@ class ItemWindow : public Gtk::Window {
 
         // members
         std::string prefix;
-        bool item_starts_with_prefix;
         std::string default_directory;
 
         bool in_edit_mode;
@@ -90,16 +104,27 @@ class ItemWindow : public Gtk::Window {
         std::vector<std::string> items_to_add;
         size_t current_idx;
 
+        // items that were added but not yet committed to the database
+        std::vector<TagDb::Item> staged_items;
+        std::vector<ImportEngine::Job> staged_imports;
+
         // max number of suggestions to show
         size_t suggestion_count;
         int preview_size;
 
+        // perceptual hash of the previewed image
+        bool preview_hashed;
+        uint64_t preview_hash;
+
         // functions
         void setup_for_add_item(size_t idx);
         void setup_for_edit_item(const TagDb::Item &item);
         bool set_preview(const Glib::ustring &file_path);
-        bool copy(const std::string &file_path);
+        void request_suggestions();
+        std::string get_destination_dir() const;
         TagDb::Item create_db_item(size_t idx);
+        void stage_item(size_t idx);
+        void stage_remaining_items();
         void show_warning(Glib::ustring primary, Glib::ustring secondary);
 
         // signal handlers
@@ -114,8 +139,10 @@ class ItemWindow : public Gtk::Window {
         bool on_close_request() override;
 
         // signals
-        sigc::signal<void (TagDb::Item)> private_add_item;
+        sigc::signal<void (const std::vector<TagDb::Item> &,
+                           const std::vector<ImportEngine::Job> &)> private_add_items;
         sigc::signal<void (TagDb::Item)> private_edit_item;
         sigc::signal<void (const Glib::ustring &, bool)> private_delete_item;
         sigc::signal<void (const std::set<Glib::ustring> &)> private_request_suggestions;
+        sigc::signal<void (uint64_t)> private_request_visual_suggestions;
 };
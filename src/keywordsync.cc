@@ -0,0 +1,146 @@
+// standard library
+#include <future>
+
+// project
+#include "keywordsync.hh"
+#include "metadatareader.hh"
+#include "xmpsidecar.hh"
+#include "workerpool.hh"
+
+// KeywordSync::Result implementation
+KeywordSync::Result::Result()
+:
+    action(KeywordSync::Result::Action::IMPORT),
+    written(0)
+{}
+
+// KeywordSync implementation
+KeywordSync::KeywordSync()
+:
+    cancelled(false),
+    finished(false),
+    running(false)
+{
+    dispatcher.connect(sigc::mem_fun(*this, &KeywordSync::on_dispatch));
+}
+
+KeywordSync::~KeywordSync() {
+    cancel();
+}
+
+void KeywordSync::import_keywords(const std::string &prefix, std::vector<std::string> rel_paths) {
+    cancel();
+
+    running = true;
+    thread = std::thread(&KeywordSync::run_import, this, prefix, std::move(rel_paths));
+}
+
+void KeywordSync::write_sidecars(const std::string &prefix,
+                                 std::vector<std::pair<std::string, std::set<Glib::ustring>>> item_tags)
+{
+    cancel();
+
+    running = true;
+    thread = std::thread(&KeywordSync::run_write, this, prefix, std::move(item_tags));
+}
+
+void KeywordSync::cancel() {
+    cancelled = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    cancelled = false;
+    finished = false;
+    running = false;
+}
+
+bool KeywordSync::is_running() const {
+    return running;
+}
+
+sigc::signal<void (const KeywordSync::Result &)> KeywordSync::signal_finished() {
+    return private_finished;
+}
+
+void KeywordSync::run_import(std::string prefix, std::vector<std::string> rel_paths) {
+    result = Result();
+
+    // only the headers of the files are read, see MetadataReader
+    std::vector<std::vector<Glib::ustring>> keywords(rel_paths.size());
+    std::vector<char> read(rel_paths.size(), false);
+    {
+        WorkerPool pool;
+        std::vector<std::future<void>> futures;
+        for (size_t idx = 0; idx < rel_paths.size(); idx++) {
+            futures.push_back(pool.submit([this, &prefix, &rel_paths, &keywords, &read, idx](){
+                if (cancelled) { return; }
+                read.at(idx) = MetadataReader::read_keywords(prefix + rel_paths.at(idx), keywords.at(idx));
+            }));
+        }
+        for (std::future<void> &future : futures) {
+            future.get();
+        }
+    }
+
+    if (cancelled) { return; }
+
+    for (size_t idx = 0; idx < rel_paths.size(); idx++) {
+        if (!read.at(idx)) {
+            result.failed.push_back(rel_paths.at(idx));
+        }
+        else if (keywords.at(idx).size() > 0) {
+            std::set<Glib::ustring> tags(keywords.at(idx).begin(), keywords.at(idx).end());
+            result.imported.push_back(std::make_pair(rel_paths.at(idx), std::move(tags)));
+        }
+    }
+
+    finished = true;
+    dispatcher.emit();
+}
+
+void KeywordSync::run_write(std::string prefix,
+                            std::vector<std::pair<std::string, std::set<Glib::ustring>>> item_tags)
+{
+    result = Result();
+    result.action = Result::Action::WRITE;
+
+    std::vector<char> written(item_tags.size(), false);
+    {
+        WorkerPool pool;
+        std::vector<std::future<void>> futures;
+        for (size_t idx = 0; idx < item_tags.size(); idx++) {
+            futures.push_back(pool.submit([this, &prefix, &item_tags, &written, idx](){
+                if (cancelled) { return; }
+                written.at(idx) = XmpSidecar::write_keywords(prefix + item_tags.at(idx).first,
+                                                             item_tags.at(idx).second);
+            }));
+        }
+        for (std::future<void> &future : futures) {
+            future.get();
+        }
+    }
+
+    if (cancelled) { return; }
+
+    for (size_t idx = 0; idx < item_tags.size(); idx++) {
+        if (written.at(idx)) {
+            result.written += 1;
+        }
+        else {
+            result.failed.push_back(item_tags.at(idx).first);
+        }
+    }
+
+    finished = true;
+    dispatcher.emit();
+}
+
+void KeywordSync::on_dispatch() {
+    // a cancelled run may still have notified
+    if (!running || !finished) { return; }
+
+    thread.join();
+    finished = false;
+    running = false;
+    private_finished.emit(result);
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <vector>
+#include <set>
+#include <utility>
+#include <thread>
+#include <atomic>
+
+// gtkmm
+#include <glibmm/ustring.h>
+#include <glibmm/dispatcher.h>
+#include <sigc++/signal.h>
+
+// Imports the keywords of many files as tags, and writes the tags of items
+// to XMP sidecars, on background threads, see MetadataReader and XmpSidecar.
+// The result of a whole run is delivered at once on the GUI thread, so the
+// database changes in a single batch.
+class KeywordSync {
+    public: class Result {
+        public:
+            enum class Action { IMPORT, WRITE };
+
+            Result();
+
+            Action action;
+
+            // relative paths and keywords of the files that have any
+            std::vector<std::pair<std::string, std::set<Glib::ustring>>> imported;
+
+            // number of sidecars that were written
+            size_t written;
+
+            // relative paths of files that could not be read
+            // or whose sidecars could not be written
+            std::vector<std::string> failed;
+    };
+
+    public:
+        KeywordSync();
+        ~KeywordSync();
+
+        // the relative paths are read below the prefix, a run
+        // that is still in progress is cancelled first
+        void import_keywords(const std::string &prefix, std::vector<std::string> rel_paths);
+        void write_sidecars(const std::string &prefix,
+                            std::vector<std::pair<std::string, std::set<Glib::ustring>>> item_tags);
+        void cancel();
+        bool is_running() const;
+
+        // signal forwarding
+        sigc::signal<void (const Result &)> signal_finished();
+
+    private:
+        // members
+        std::thread thread;
+        std::atomic<bool> cancelled;
+        std::atomic<bool> finished;
+        bool running;
+
+        // the result is passed from the worker thread to the GUI thread
+        Glib::Dispatcher dispatcher;
+        Result result;
+
+        // functions
+        void run_import(std::string prefix, std::vector<std::string> rel_paths);
+        void run_write(std::string prefix,
+                       std::vector<std::pair<std::string, std::set<Glib::ustring>>> item_tags);
+
+        // signal handlers
+        void on_dispatch();
+
+        // signals
+        sigc::signal<void (const Result &)> private_finished;
+};
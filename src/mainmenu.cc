@@ -7,6 +7,7 @@ MainMenu::MainMenu()
     button_create_database("Create Database"),
     checkbutton_show_tag_picker(" Show Tag Picker"),
     button_add_items("Add Items"),
+    button_scan_directories("Scan Directories"),
     button_db_settings("DB Settings"),
     button_preferences("Preferences"),
     button_about("About")
@@ -15,6 +16,7 @@ MainMenu::MainMenu()
     button_load_database.set_has_frame(false);
     button_create_database.set_has_frame(false);
     button_add_items.set_has_frame(false);
+    button_scan_directories.set_has_frame(false);
     button_db_settings.set_has_frame(false);
     button_preferences.set_has_frame(false);
     button_about.set_has_frame(false);
@@ -25,6 +27,7 @@ MainMenu::MainMenu()
     // database config options such as add item
     // are hidden until a database is actually loaded
     button_add_items.set_visible(false);
+    button_scan_directories.set_visible(false);
     button_db_settings.set_visible(false);
     sep_2.set_visible(false);
 
@@ -34,6 +37,7 @@ MainMenu::MainMenu()
     box.append(button_create_database);
     box.append(sep_1);
     box.append(button_add_items);
+    box.append(button_scan_directories);
     box.append(button_db_settings);
     box.append(sep_2);
     box.append(checkbutton_show_tag_picker);
@@ -46,11 +50,13 @@ MainMenu::MainMenu()
 void MainMenu::set_show_database_controls(bool show_controls) {
     if (show_controls) {
         button_add_items.set_visible(true);
+        button_scan_directories.set_visible(true);
         button_db_settings.set_visible(true);
         sep_2.set_visible(true);
     }
     else {
         button_add_items.set_visible(false);
+        button_scan_directories.set_visible(false);
         button_db_settings.set_visible(false);
         sep_2.set_visible(false);
     }
@@ -72,6 +78,10 @@ Glib::SignalProxy<void()> MainMenu::signal_add_items() {
     return button_add_items.signal_clicked();
 }
 
+Glib::SignalProxy<void()> MainMenu::signal_scan_directories() {
+    return button_scan_directories.signal_clicked();
+}
+
 Glib::SignalProxy<void()> MainMenu::signal_db_settings() {
     return button_db_settings.signal_clicked();
 }
@@ -23,6 +23,7 @@ class MainMenu : public Gtk::Popover {
         Glib::SignalProxy<void()> signal_load_database();
         Glib::SignalProxy<void()> signal_create_database();
         Glib::SignalProxy<void()> signal_add_items();
+        Glib::SignalProxy<void()> signal_scan_directories();
         Glib::SignalProxy<void()> signal_db_settings();
         Glib::SignalProxy<void()> signal_show_tag_picker_toggled();
         Glib::SignalProxy<void()> signal_preferences();
@@ -38,6 +39,7 @@ class MainMenu : public Gtk::Popover {
         Gtk::CheckButton checkbutton_show_tag_picker;
         Gtk::Separator sep_1;
         Gtk::Button button_add_items;
+        Gtk::Button button_scan_directories;
         Gtk::Button button_db_settings;
         Gtk::Separator sep_2;
         Gtk::Button button_preferences;
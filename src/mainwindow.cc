@@ -1,16 +1,29 @@
 // standard library
 #include <filesystem>
+#include <unordered_set>
+#include <unordered_map>
+#include <cstdio>
+
+// gtkmm
+#include <glibmm/main.h>
 
 // project
 #include "mainwindow.hh"
 
 MainWindow::MainWindow()
 :
+    query_scheduler(db),
     item_window(*this),
     db_settings_window(*this),
     preferences_window(*this),
     key_controller(Gtk::EventControllerKey::create()),
-    switching_allowed(true)
+    switching_allowed(true),
+    first_section_loaded(false),
+    gallery_generating(false),
+    gallery_refresh_pending(false),
+    query_result_pending(false),
+    scan_adds_untracked(false),
+    close_pending(false)
 {
     // configure image viewer controls
     viewer_controls.signal_zoom_out().connect(sigc::mem_fun(viewer, &ImageViewer::zoom_out));
@@ -29,23 +42,78 @@ MainWindow::MainWindow()
     main_menu.signal_load_database().connect(sigc::mem_fun(*this, &MainWindow::on_load_database));
     main_menu.signal_create_database().connect(sigc::mem_fun(*this, &MainWindow::on_create_database));
     main_menu.signal_add_items().connect(sigc::mem_fun(*this, &MainWindow::on_add_items));
+    main_menu.signal_scan_directories().connect(
+            sigc::mem_fun(*this, &MainWindow::on_scan_directories));
     main_menu.signal_db_settings().connect(sigc::mem_fun(*this, &MainWindow::on_db_settings));
     main_menu.signal_show_tag_picker_toggled().connect(
             sigc::mem_fun(*this, &MainWindow::on_tag_picker_toggled));
     main_menu.signal_about().connect(sigc::mem_fun(*this, &MainWindow::on_about));
     main_menu.signal_preferences().connect(sigc::mem_fun(*this, &MainWindow::on_preferences));
 
+    // configure progress of loading the database or
+    // scanning its directories, only visible while working
+    load_progress.set_show_text(true);
+    load_progress.set_valign(Gtk::Align::CENTER);
+    load_progress.set_visible(false);
+
+    // configure import progress, only visible while importing files
+    import_progress.set_show_text(true);
+    import_progress.set_valign(Gtk::Align::CENTER);
+    btn_cancel_import.set_icon_name("process-stop-symbolic");
+    btn_cancel_import.set_has_frame(false);
+    btn_cancel_import.set_tooltip_text("Cancel import");
+    btn_cancel_import.signal_clicked().connect(
+            sigc::mem_fun(*this, &MainWindow::on_cancel_import));
+    import_box.set_orientation(Gtk::Orientation::HORIZONTAL);
+    import_box.append(import_progress);
+    import_box.append(btn_cancel_import);
+    import_box.set_visible(false);
+
     // configure header
     header.set_show_title_buttons(true);
     header.pack_start(viewer_controls);
     header.pack_end(button_main_menu);
+    header.pack_end(load_progress);
+    header.pack_end(import_box);
     set_titlebar(header);
 
+    // configure database loader
+    loader.signal_section_loaded().connect(
+            sigc::mem_fun(*this, &MainWindow::on_db_section_loaded));
+    loader.signal_progress().connect(
+            sigc::mem_fun(*this, &MainWindow::on_db_load_progress));
+    loader.signal_finished().connect(
+            sigc::mem_fun(*this, &MainWindow::on_db_load_finished));
+    loader.signal_failed().connect(
+            sigc::mem_fun(*this, &MainWindow::on_db_load_failed));
+
+    // configure directory scanner
+    scanner.signal_finished().connect(
+            sigc::mem_fun(*this, &MainWindow::on_scan_finished));
+
+    // configure import engine
+    importer.signal_finished().connect(
+            sigc::mem_fun(*this, &MainWindow::on_import_finished));
+
+    // configure directory watcher
+    watcher.signal_changed().connect(
+            sigc::mem_fun(*this, &MainWindow::on_watched_files_changed));
+
+    // configure metadata extractor
+    extractor.signal_extracted().connect(
+            sigc::mem_fun(*this, &MainWindow::on_metadata_extracted));
+    extractor.signal_finished().connect(
+            sigc::mem_fun(*this, &MainWindow::on_metadata_finished));
+
+    // configure keyword import
+    keyword_sync.signal_finished().connect(
+            sigc::mem_fun(*this, &MainWindow::on_keyword_sync_finished));
+
     // configure completion
-    list_store = Gtk::ListStore::create(list_model);
+    completion_index = std::make_shared<CompletionIndex>();
 
     // configure tag picker
-    tag_picker.set_completer_model(list_store);
+    tag_picker.set_completion_index(completion_index);
     tag_picker.set_halign(Gtk::Align::START);
     tag_picker.set_valign(Gtk::Align::START);
     tag_picker.set_margin(15);
@@ -55,6 +123,16 @@ MainWindow::MainWindow()
             sigc::mem_fun(*this, &MainWindow::on_tag_query_changed));
     tag_picker.signal_reload_default_exclude_required().connect(
             sigc::mem_fun(*this, &MainWindow::on_reload_default_exclude_required));
+    tag_picker.signal_album_chosen().connect(
+            sigc::mem_fun(*this, &MainWindow::on_album_chosen));
+    tag_picker.signal_album_saved().connect(
+            sigc::mem_fun(*this, &MainWindow::on_album_saved));
+    tag_picker.signal_album_removed().connect(
+            sigc::mem_fun(*this, &MainWindow::on_album_removed));
+
+    // configure query scheduler
+    query_scheduler.signal_finished().connect(
+            sigc::mem_fun(*this, &MainWindow::on_query_finished));
 
     // configure preview gallery
     gallery.set_preview_size(config.get_preview_size());
@@ -68,6 +146,10 @@ MainWindow::MainWindow()
             sigc::mem_fun(*this, &MainWindow::on_gallery_edit));
     gallery.signal_generation_status_changed().connect(
             sigc::mem_fun(*this, &MainWindow::on_gallery_generation_status_changed));
+    gallery.signal_find_similar().connect(
+            sigc::mem_fun(*this, &MainWindow::on_gallery_find_similar));
+    gallery.signal_previews_hashed().connect(
+            sigc::mem_fun(*this, &MainWindow::on_gallery_previews_hashed));
 
     // configure main box
     box.set_orientation(Gtk::Orientation::HORIZONTAL);
@@ -82,22 +164,34 @@ MainWindow::MainWindow()
             sigc::mem_fun(*this, &MainWindow::on_key_pressed), false);
 
     // configure item window
-    item_window.set_completer_model(list_store);
-    item_window.signal_add_item().connect(
-            sigc::mem_fun(*this, &MainWindow::on_add_item));
+    item_window.set_completion_index(completion_index);
+    item_window.signal_add_items().connect(
+            sigc::mem_fun(*this, &MainWindow::on_add_item_batch));
     item_window.signal_edit_item().connect(
             sigc::mem_fun(*this, &MainWindow::on_edit_item));
     item_window.signal_delete_item().connect(
             sigc::mem_fun(*this, &MainWindow::on_delete_item));
     item_window.signal_request_suggestions().connect(
             sigc::mem_fun(*this, &MainWindow::on_request_suggestions));
+    item_window.signal_request_visual_suggestions().connect(
+            sigc::mem_fun(*this, &MainWindow::on_request_visual_suggestions));
 
     // configure dbsettings window
-    db_settings_window.set_completer_model(list_store);
+    db_settings_window.set_completion_index(completion_index);
     db_settings_window.signal_directoires_changed().connect(
             sigc::mem_fun(*this, &MainWindow::on_directories_changed));
     db_settings_window.signal_exclude_tags_changed().connect(
             sigc::mem_fun(*this, &MainWindow::on_exclude_tags_changed));
+    db_settings_window.signal_merge_tags().connect(
+            sigc::mem_fun(*this, &MainWindow::on_merge_tags));
+    db_settings_window.signal_retag_gallery_items().connect(
+            sigc::mem_fun(*this, &MainWindow::on_retag_gallery_items));
+    db_settings_window.signal_rules_changed().connect(
+            sigc::mem_fun(*this, &MainWindow::on_rules_changed));
+    db_settings_window.signal_import_keywords().connect(
+            sigc::mem_fun(*this, &MainWindow::on_import_keywords));
+    db_settings_window.signal_write_sidecars().connect(
+            sigc::mem_fun(*this, &MainWindow::on_write_sidecars));
 
     // configure preferences window
     preferences_window.set_default_db_path(config.get_default_db_path());
@@ -114,58 +208,69 @@ MainWindow::MainWindow()
     set_default_size(950, 800);
 
     // load default config if it exists
+    // this happens in the background, the window is shown right away
     if (config.get_default_db_path().size() > 0) {
         load_database(config.get_default_db_path());
     }
 }
 
 void MainWindow::load_database(const std::string &db_file_path) {
-    try {
-        db.load_from_file(db_file_path);
-    }
-    catch (TagDb::FileParseException &ex) {
-        show_warning("Error Loading Database",
-                     "There was an error parsing the file at line " + std::to_string(ex.line_number));
+    // items that were added in the item window but not committed yet
+    // have paths relative to the current database, they are added to it
+    item_window.commit_staged_items();
+    item_window.hide();
+
+    // files that are being imported are added to the current
+    // database first, the new one is loaded once they are
+    if (importer.is_importing() || import_queue.size() > 0) {
+        pending_db_path = db_file_path;
         return;
     }
-    catch (TagDb::FileErrorException &ex) {
-        show_warning("Error Loading Database",
-                     "There was an error opening the file:\n" + ex.file_path);
-
-        return;
-    }
-
-    set_completer_data(db.get_all_tags());
-
-    // load default excluded tags to tag_picer
+    pending_db_path.clear();
+
+    // changes that were only kept in memory belong to the current database
+    write_unwritten_changes();
+
+    // database controls are hidden until the file is loaded
+    // completely, so that a partial database is never written
+    main_menu.set_show_database_controls(false);
+    db_settings_window.hide();
+
+    // a scan of the previous database is no longer useful
+    scanner.cancel();
+    scan_pulse.disconnect();
+    watcher.stop();
+    extractor.cancel();
+    keyword_sync.cancel();
+
+    // results of the previous database are no longer shown
+    query_scheduler.cancel();
+    query_result_pending = false;
+
+    db.begin_load(db_file_path);
+    update_completer_data();
+    update_album_sizes();
     tag_picker.clear_excluded_tags();
-    on_reload_default_exclude_required();
-
-    db_settings_window.setup(db_file_path,
-                             db.get_directories(),
-                             db.get_default_excluded_tags(),
-                             db.get_prefix());
+    first_section_loaded = false;
 
-    item_window.set_directories(db.get_directories());
-    item_window.set_prefix(db.get_prefix());
-
-    main_menu.set_show_database_controls(true);
-
-    if (gallery.is_visible()) {
-        refresh_gallery();
-    }
+    load_progress.set_text("Loading database");
+    load_progress.set_fraction(0);
+    load_progress.set_visible(true);
+    loader.load(db_file_path);
 }
 
 void MainWindow::add_items(const std::vector<std::string> &file_paths) {
     item_window.add_items(file_paths);
 }
 
-void MainWindow::set_completer_data(const std::set<Glib::ustring> &completer_tags) {
-    list_store->clear();
-    for (const Glib::ustring &tag : completer_tags) {
-        auto row = *(list_store->append());
-        row[list_model.tag] = tag;
-    }
+void MainWindow::update_completer_data() {
+    // only the tags that changed since the last update are touched
+    completion_index->update_tags(db.take_tag_changes());
+}
+
+void MainWindow::update_album_sizes() {
+    // the database keeps the sizes up to date, nothing is counted here
+    tag_picker.set_albums(db.get_album_sizes());
 }
 
 void MainWindow::show_warning(Glib::ustring primary, Glib::ustring secondary) {
@@ -183,15 +288,101 @@ void MainWindow::show_warning(Glib::ustring primary, Glib::ustring secondary) {
 
 void MainWindow::refresh_gallery() {
     TagQuery query = tag_picker.get_current_query();
-    files = db.query(query.tags_include, query.tags_exclude);
-    gallery.set_content(files);
+    query_scheduler.schedule(query.tags_include, query.tags_exclude);
     tag_picker.clear_current_item_tags();
 }
 
+void MainWindow::request_gallery_refresh() {
+    // the refresh runs from an idle handler so that it does not
+    // block other handlers, such as the database loader's
+    // generating previews iterates the main loop, so while it is
+    // in progress the refresh waits until the generation is done
+    if (gallery_refresh_pending) { return; }
+    gallery_refresh_pending = true;
+
+    if (!gallery_generating) {
+        Glib::signal_idle().connect_once(sigc::mem_fun(*this, &MainWindow::on_gallery_refresh_idle));
+    }
+}
+
+void MainWindow::scan_directories(bool add_untracked) {
+    if (loader.is_loading()) { return; }
+
+    // a scan the user asked for adds untracked items even
+    // if it is already running because events were lost
+    if (scanner.is_scanning()) {
+        scan_adds_untracked = scan_adds_untracked || add_untracked;
+        return;
+    }
+    scan_adds_untracked = add_untracked;
+
+    load_progress.set_text("Scanning directories");
+    load_progress.set_visible(true);
+    scan_pulse = Glib::signal_timeout().connect(sigc::mem_fun(*this, &MainWindow::on_scan_pulse), 100);
+
+    scanner.scan(db.get_prefix(), db.get_directories(), db.get_item_paths(), db.get_item_hashes());
+}
+
+void MainWindow::extract_missing_metadata() {
+    // a running extraction is started again, the
+    // records it already delivered are not read twice
+    if (loader.is_loading()) { return; }
+    extractor.extract(db.get_prefix(), db.get_items_without_metadata());
+}
+
+void MainWindow::show_missing_items(const std::vector<std::string> &missing) {
+    if (missing.size() == 0) { return; }
+
+    std::string missing_list;
+    for (size_t idx = 0; idx < missing.size() && idx < 10; idx++) {
+        missing_list += "\n" + missing.at(idx);
+    }
+    if (missing.size() > 10) {
+        missing_list += "\n...";
+    }
+
+    show_warning("Missing Items",
+                 std::to_string(missing.size()) +
+                 " items could not be found on disk:" + missing_list);
+}
+
+void MainWindow::watch_directories() {
+    watcher.watch(db.get_prefix(), db.get_directories(), db.get_item_paths());
+}
+
+void MainWindow::write_unwritten_changes() {
+    hash_write_timer.disconnect();
+
+    // a partially loaded database is never written
+    if (loader.is_loading() || !db.has_unwritten_changes()) { return; }
+
+    try {
+        db.write_to_file();
+    }
+    catch (TagDb::FileErrorException &ex) {
+        show_warning("Error Writing Database",
+                     "There was an error opening the file:\n" + ex.file_path);
+    }
+}
+
+void MainWindow::start_next_import() {
+    if (importer.is_importing() || import_queue.size() == 0) { return; }
+
+    import_progress.set_fraction(0);
+    import_progress.set_text("Importing");
+    import_box.set_visible(true);
+    import_progress_timer = Glib::signal_timeout().connect(
+            sigc::mem_fun(*this, &MainWindow::on_import_progress), 200);
+
+    importing_items = std::move(import_queue.front().first);
+    importer.start(import_queue.front().second, db.get_hash_index());
+    import_queue.pop_front();
+}
+
 bool MainWindow::on_key_pressed(guint keyval, guint keycode, Gdk::ModifierType state) {
     // Ctrl + Q exit
     if (keyval == 'q' && static_cast<int>(state) == 0b00000100) {
-        hide();
+        close();
     }
 
     // viewer image switching
@@ -218,14 +409,416 @@ bool MainWindow::on_key_pressed(guint keyval, guint keycode, Gdk::ModifierType s
     return false;
 }
 
+bool MainWindow::on_close_request() {
+    // the items that were added in the item window are imported
+    // and written to the database before the program quits
+    item_window.commit_staged_items();
+    item_window.hide();
+
+    if (importer.is_importing() || import_queue.size() > 0) {
+        close_pending = true;
+        return true;
+    }
+
+    write_unwritten_changes();
+    return false;
+}
+
+void MainWindow::on_db_section_loaded(DbFile::ParseResult &section) {
+    db.load_items(section.items, section.directories, section.default_excluded_tags,
+                  section.rules, section.albums, section.metadata);
+    update_completer_data();
+    update_album_sizes();
+
+    // show the first items as soon as they are available
+    // the default excluded tags are at the top of the file
+    if (!first_section_loaded) {
+        first_section_loaded = true;
+
+        for (const Glib::ustring &tag : db.get_default_excluded_tags()) {
+            tag_picker.add_excluded_tag(tag);
+        }
+
+        if (gallery.is_visible()) {
+            request_gallery_refresh();
+        }
+    }
+}
+
+void MainWindow::on_db_load_progress(double fraction) {
+    load_progress.set_fraction(fraction);
+}
+
+void MainWindow::on_db_load_finished() {
+    load_progress.set_visible(false);
+
+    db_settings_window.setup(db.get_db_file_path(),
+                             db.get_directories(),
+                             db.get_default_excluded_tags(),
+                             db.get_rules().get_rules(),
+                             db.get_prefix());
+
+    item_window.set_directories(db.get_directories());
+    item_window.set_prefix(db.get_prefix());
+
+    main_menu.set_show_database_controls(true);
+    watch_directories();
+    extract_missing_metadata();
+
+    if (gallery.is_visible()) {
+        request_gallery_refresh();
+    }
+}
+
+void MainWindow::on_db_load_failed(std::exception_ptr error) {
+    load_progress.set_visible(false);
+
+    // do not keep a partially loaded database around
+    db.clear();
+    update_completer_data();
+    update_album_sizes();
+    tag_picker.clear_excluded_tags();
+    if (gallery.is_visible()) {
+        request_gallery_refresh();
+    }
+
+    try {
+        std::rethrow_exception(error);
+    }
+    catch (TagDb::FileParseException &ex) {
+        show_warning("Error Loading Database",
+                     "There was an error parsing the file at line " + std::to_string(ex.line_number));
+    }
+    catch (TagDb::FileErrorException &ex) {
+        show_warning("Error Loading Database",
+                     "There was an error opening the file:\n" + ex.file_path);
+    }
+    catch (...) {
+        show_warning("Error Loading Database", "There was an error reading the file.");
+    }
+}
+
+void MainWindow::on_scan_finished(const FsScanner::Result &result) {
+    scan_pulse.disconnect();
+    load_progress.set_visible(false);
+
+    // hashes of items that were added before files were hashed
+    if (result.hashed.size() > 0) {
+        std::vector<std::pair<Glib::ustring, uint64_t>> hashes;
+        for (const auto &entry : result.hashed) {
+            hashes.push_back(std::make_pair(entry.first, entry.second));
+        }
+        db.set_hashes(hashes);
+    }
+
+    // moved items keep their tags, only their paths change
+    if (result.moved.size() > 0) {
+        std::vector<std::pair<Glib::ustring, Glib::ustring>> moves;
+        for (const auto &move : result.moved) {
+            moves.push_back(std::make_pair(move.first, move.second));
+            gallery.remove_from_cache(db.get_prefix() + move.first);
+        }
+
+        // an item may have been removed while scanning, the others are still moved
+        std::vector<std::string> skipped;
+        db.move_items(moves, skipped);
+        std::unordered_set<std::string> skipped_paths(skipped.begin(), skipped.end());
+
+        TagDb::PathChanges changes;
+        std::vector<Glib::ustring> moved_items;
+        for (const auto &move : result.moved) {
+            if (skipped_paths.count(move.first) != 0) { continue; }
+            changes.moved.push_back(move);
+            moved_items.push_back(move.second);
+        }
+        move_shown_files(changes);
+        watcher.add_items(moved_items);
+
+        if (skipped.size() > 0) {
+            std::string skipped_list;
+            for (size_t idx = 0; idx < skipped.size() && idx < 10; idx++) {
+                skipped_list += "\n" + skipped.at(idx);
+            }
+            if (skipped.size() > 10) {
+                skipped_list += "\n...";
+            }
+
+            show_warning("Could Not Update Moved Items",
+                         std::to_string(skipped.size()) +
+                         " moved items are no longer in the database:" + skipped_list);
+        }
+
+        if (gallery.is_visible()) {
+            request_gallery_refresh();
+        }
+    }
+
+    // missing items are only reported, their tags are kept
+    show_missing_items(result.missing);
+
+    // new images are queued for tagging, unless the scan only
+    // replaced the events that the directory watcher lost
+    if (result.untracked.size() > 0 && scan_adds_untracked) {
+        add_items(result.untracked);
+    }
+}
+
+void MainWindow::move_shown_files(const TagDb::PathChanges &changes) {
+    // the gallery and the viewer keep their positions, so the shown
+    // files follow the items right away instead of after a refresh,
+    // removed files stay in the database as missing items
+    const std::string &prefix = db.get_prefix();
+    std::unordered_map<std::string, std::string> moved;
+    for (const auto &move : changes.moved) {
+        moved[prefix + move.first] = prefix + move.second;
+    }
+
+    for (Glib::ustring &file : files) {
+        auto iter = moved.find(file.raw());
+        if (iter != moved.end()) {
+            file = iter->second;
+        }
+
+        // files are moved before directories, like in the database
+        for (const auto &move : changes.moved_dirs) {
+            std::string old_dir = prefix + move.first + "/";
+            if (file.raw().compare(0, old_dir.size(), old_dir) == 0) {
+                file = prefix + move.second + "/" + file.raw().substr(old_dir.size());
+            }
+        }
+    }
+}
+
+bool MainWindow::on_scan_pulse() {
+    load_progress.pulse();
+    return true;
+}
+
+void MainWindow::on_import_finished(const std::vector<ImportEngine::Result> &results) {
+    import_progress_timer.disconnect();
+    import_box.set_visible(false);
+
+    std::vector<TagDb::Item> items;
+    items.swap(importing_items);
+
+    // items are only added if their file was imported, with its hash
+    // the results are in the order of the jobs, one for each item
+    std::vector<TagDb::Item> imported_items;
+    std::string failed_list;
+    std::string duplicate_list;
+    size_t failed_count = 0;
+    size_t duplicate_count = 0;
+    for (size_t idx = 0; idx < results.size() && idx < items.size(); idx++) {
+        const ImportEngine::Result &result = results.at(idx);
+        if (result.success) {
+            TagDb::Item item = items.at(idx);
+            item.set_hash(result.hash);
+            imported_items.push_back(item);
+        }
+        else if (result.duplicate_of.size() > 0) {
+            duplicate_count += 1;
+            if (duplicate_count <= 10) {
+                duplicate_list += "\n" + result.job.source + ": " + result.error;
+            }
+        }
+        else {
+            failed_count += 1;
+            if (failed_count <= 10) {
+                failed_list += "\n" + result.job.source + ": " + result.error;
+            }
+        }
+    }
+
+    if (imported_items.size() > 0) {
+        db.apply_batch(imported_items);
+
+        std::vector<Glib::ustring> imported_paths;
+        for (const TagDb::Item &item : imported_items) {
+            imported_paths.push_back(item.get_file_path());
+        }
+        watcher.add_items(imported_paths);
+        update_completer_data();
+        update_album_sizes();
+        refresh_gallery();
+        extract_missing_metadata();
+    }
+
+    if (failed_count > 0) {
+        if (failed_count > 10) {
+            failed_list += "\n...";
+        }
+        show_warning("Error Importing Files",
+                     std::to_string(failed_count) + " files could not be imported:" + failed_list);
+    }
+
+    if (duplicate_count > 0) {
+        if (duplicate_count > 10) {
+            duplicate_list += "\n...";
+        }
+        show_warning("Duplicate Files",
+                     std::to_string(duplicate_count) + " files were not added because they are duplicates:" +
+                     duplicate_list);
+    }
+
+    start_next_import();
+
+    if (importer.is_importing()) { return; }
+
+    // the window was closed while importing
+    if (close_pending) {
+        close();
+        return;
+    }
+
+    // a database was chosen while importing
+    if (pending_db_path.size() > 0) {
+        std::string db_file_path;
+        db_file_path.swap(pending_db_path);
+        load_database(db_file_path);
+    }
+}
+
+bool MainWindow::on_import_progress() {
+    ImportEngine::Progress progress = importer.get_progress();
+
+    if (progress.bytes_total > 0) {
+        import_progress.set_fraction((double)progress.bytes_done / (double)progress.bytes_total);
+    }
+
+    char throughput[32];
+    std::snprintf(throughput, sizeof(throughput), "%.1f MB/s", progress.bytes_per_second / 1e6);
+    // another database is loaded or the window closes after these imports
+    Glib::ustring action = pending_db_path.empty() && !close_pending ? "Importing " : "Finishing imports ";
+    import_progress.set_text(action + std::to_string(progress.files_done) + "/" +
+                             std::to_string(progress.file_count) + ", " + throughput);
+
+    return true;
+}
+
+void MainWindow::on_cancel_import() {
+    // files that were imported before cancelling are still added
+    import_progress.set_text("Cancelling");
+    importer.cancel();
+
+    // the batches that did not start yet are dropped
+    import_queue.clear();
+}
+
+void MainWindow::on_watched_files_changed(const DirWatcher::Changes &changes) {
+    // previews of changed files are generated again
+    const std::string &prefix = db.get_prefix();
+    for (const auto &move : changes.paths.moved) {
+        gallery.remove_from_cache(prefix + move.first);
+        gallery.remove_from_cache(prefix + move.second);
+    }
+    for (const std::string &file_path : changes.paths.removed) {
+        gallery.remove_from_cache(prefix + file_path);
+    }
+    for (const std::string &file_path : changes.modified) {
+        gallery.remove_from_cache(prefix + file_path);
+    }
+
+    // the whole batch is a single update of the database, items
+    // of removed files are only reported, their tags are kept
+    std::vector<std::string> missing;
+    bool db_changed = db.apply_path_changes(changes.paths, missing);
+    move_shown_files(changes.paths);
+    if (db_changed) {
+        update_completer_data();
+        update_album_sizes();
+    }
+    show_missing_items(missing);
+
+    // only refresh if an item in the gallery is affected
+    bool gallery_changed = db_changed;
+    if (!gallery_changed && changes.modified.size() > 0) {
+        std::unordered_set<std::string> shown(files.size());
+        for (const Glib::ustring &file : files) {
+            shown.insert(file.raw());
+        }
+        for (const std::string &file_path : changes.modified) {
+            if (shown.count(prefix + file_path) != 0) {
+                gallery_changed = true;
+                break;
+            }
+        }
+    }
+
+    if (gallery_changed && gallery.is_visible()) {
+        request_gallery_refresh();
+    }
+
+    // events were lost, compare the directories with the database
+    // without asking to tag the files that were not added yet
+    if (changes.overflowed) {
+        scan_directories(false);
+    }
+}
+
+void MainWindow::on_metadata_extracted(const MetadataExtractor::Batch &batch) {
+    db.set_metadata(batch);
+    update_album_sizes();
+
+    // the result only changes if the query has a metadata predicate
+    TagQuery query = tag_picker.get_current_query();
+    MetadataTable::Predicate predicate;
+    for (const std::set<Glib::ustring> *tags : { &query.tags_include, &query.tags_exclude }) {
+        for (const Glib::ustring &tag : *tags) {
+            if (MetadataTable::Predicate::parse(tag.raw(), predicate)) {
+                if (gallery.is_visible()) {
+                    request_gallery_refresh();
+                }
+                return;
+            }
+        }
+    }
+}
+
+void MainWindow::on_metadata_finished() {
+    // the records of all batches are written at once
+    write_unwritten_changes();
+}
+
+void MainWindow::on_keyword_sync_finished(const KeywordSync::Result &result) {
+    if (result.action == KeywordSync::Result::Action::IMPORT && result.imported.size() > 0) {
+        // all keywords are added in a single write
+        size_t changed = db.add_item_tags(result.imported);
+        if (changed > 0) {
+            update_completer_data();
+            update_album_sizes();
+            refresh_gallery();
+        }
+    }
+
+    if (result.failed.size() > 0) {
+        std::string failed_list;
+        for (size_t idx = 0; idx < result.failed.size() && idx < 10; idx++) {
+            failed_list += "\n" + result.failed.at(idx);
+        }
+        if (result.failed.size() > 10) {
+            failed_list += "\n...";
+        }
+
+        if (result.action == KeywordSync::Result::Action::IMPORT) {
+            show_warning("Error Importing Keywords",
+                         std::to_string(result.failed.size()) + " files could not be read:" + failed_list);
+        }
+        else {
+            show_warning("Error Writing Sidecars",
+                         std::to_string(result.failed.size()) + " sidecars could not be written:" + failed_list);
+        }
+    }
+}
+
 void MainWindow::on_filter_toggled(TagDb::QueryType query_type) {
     db.set_query_type(query_type);
     refresh_gallery();
 }
 
 void MainWindow::on_tag_query_changed(TagQuery tag_selection) {
-    files = db.query(tag_selection.tags_include, tag_selection.tags_exclude);
-    gallery.set_content(files);
+    // quick changes are coalesced, only the last one is shown
+    query_scheduler.schedule(tag_selection.tags_include, tag_selection.tags_exclude);
+
     if (!viewer.get_visible()) {
         tag_picker.clear_current_item_tags();
         switching_allowed = true;
@@ -235,6 +828,32 @@ void MainWindow::on_tag_query_changed(TagQuery tag_selection) {
     }
 }
 
+void MainWindow::on_query_finished(std::vector<Glib::ustring> &result,
+                                   std::shared_ptr<const TagDb::QueryCounts> counts,
+                                   std::vector<Glib::ustring> &suggestions)
+{
+    query_result.swap(result);
+    query_result_counts = counts;
+    query_result_suggestions.swap(suggestions);
+    query_result_pending = true;
+    show_query_result();
+}
+
+void MainWindow::show_query_result() {
+    // generating previews iterates the main loop, the result
+    // is shown once the generation is done
+    if (!query_result_pending || gallery_generating) { return; }
+    query_result_pending = false;
+
+    files.swap(query_result);
+    query_result.clear();
+    gallery.set_content(files);
+    tag_picker.set_result_counts(query_result_counts);
+
+    // tags that appear together with the query complete first
+    tag_picker.set_completion_context(query_result_suggestions);
+}
+
 void MainWindow::on_reload_default_exclude_required() {
     for (const Glib::ustring &tag : db.get_default_excluded_tags()) {
         tag_picker.add_excluded_tag(tag);
@@ -245,6 +864,55 @@ void MainWindow::on_reload_default_exclude_required() {
     }
 }
 
+void MainWindow::on_album_chosen(const Glib::ustring &name) {
+    for (const TagDb::Album &album : db.get_albums()) {
+        if (album.name != name) { continue; }
+
+        // the items of the album are already known, no query runs
+        query_scheduler.cancel();
+        db.set_query_type(album.query_type);
+        tag_picker.set_query(TagQuery(album.tags_include, album.tags_exclude), album.query_type);
+
+        query_result = db.get_album_items(name);
+        query_result_counts.reset();
+
+        // opening an album is a single search, unlike the results of typing
+        query_result_suggestions = db.suggestions(album.tags_include);
+        query_result_pending = true;
+        show_query_result();
+
+        if (!viewer.get_visible()) {
+            tag_picker.clear_current_item_tags();
+            switching_allowed = true;
+        }
+        else {
+            switching_allowed = false;
+        }
+        return;
+    }
+}
+
+void MainWindow::on_album_saved(const Glib::ustring &name) {
+    TagQuery query = tag_picker.get_current_query();
+    if (query.tags_include.size() == 0) {
+        show_warning("Error Saving Album", "Include at least one tag in the query");
+        return;
+    }
+
+    TagDb::Album album;
+    album.name = name;
+    album.tags_include = query.tags_include;
+    album.tags_exclude = query.tags_exclude;
+    album.query_type = db.get_query_type();
+    db.set_album(album);
+    update_album_sizes();
+}
+
+void MainWindow::on_album_removed(const Glib::ustring &name) {
+    db.remove_album(name);
+    update_album_sizes();
+}
+
 void MainWindow::on_gallery_item_chosen(size_t id) {
     // storing id for arrow key navigation later
     files_idx = id;
@@ -260,7 +928,13 @@ void MainWindow::on_gallery_item_chosen(size_t id) {
 }
 
 void MainWindow::on_gallery_item_selected(size_t id) {
-    tag_picker.set_current_item_tags(db.get_tags_for_item(files.at(id)));
+    // the item may be gone before the gallery is refreshed
+    try {
+        tag_picker.set_current_item_tags(db.get_tags_for_item(files.at(id)));
+    }
+    catch (const TagDb::ItemNotFoundException &) {
+        tag_picker.clear_current_item_tags();
+    }
 }
 
 void MainWindow::on_gallery_failed_to_open(size_t id) {
@@ -268,10 +942,70 @@ void MainWindow::on_gallery_failed_to_open(size_t id) {
 }
 
 void MainWindow::on_gallery_edit(const Glib::ustring &file_path) {
-    item_window.edit_item(db.get_item(file_path));
+    // editing would write a partially loaded database
+    if (loader.is_loading()) { return; }
+
+    // the gallery may still show a path that changed since
+    try {
+        item_window.edit_item(db.get_item(file_path));
+    }
+    catch (const TagDb::ItemNotFoundException &) {
+        tag_picker.clear_current_item_tags();
+    }
+}
+
+void MainWindow::on_gallery_find_similar(const Glib::ustring &file_path) {
+    std::vector<Glib::ustring> similar = db.find_similar(file_path);
+    if (similar.size() == 0) {
+        show_warning("Find Similar", "The image has not been analysed yet");
+        return;
+    }
+
+    // the tag query is applied again on its next change
+    query_scheduler.cancel();
+    query_result_pending = false;
+    files = similar;
+    gallery.set_content(files);
+    tag_picker.clear_current_item_tags();
+}
+
+void MainWindow::on_gallery_previews_hashed(const std::vector<std::pair<Glib::ustring, uint64_t>> &hashes) {
+    // writing would store a partially loaded database, the
+    // previews are shown again once loading has finished
+    if (loader.is_loading()) { return; }
+
+    std::vector<std::pair<Glib::ustring, uint64_t>> relative_hashes;
+    for (const auto &entry : hashes) {
+        if (entry.first.raw().compare(0, db.get_prefix().size(), db.get_prefix()) == 0) {
+            relative_hashes.push_back(std::make_pair(Glib::ustring(entry.first.raw().substr(db.get_prefix().size())),
+                                                     entry.second));
+        }
+    }
+
+    db.set_perceptual_hashes(relative_hashes);
+
+    // scrolling through the gallery hashes many small batches,
+    // they are written together instead of once per batch
+    if (db.has_unwritten_changes() && !hash_write_timer.connected()) {
+        hash_write_timer = Glib::signal_timeout().connect_seconds(
+                sigc::mem_fun(*this, &MainWindow::on_hash_write_timeout), 30);
+    }
+}
+
+bool MainWindow::on_hash_write_timeout() {
+    write_unwritten_changes();
+    return false;
 }
 
 void MainWindow::on_gallery_generation_status_changed(bool generation_in_progress) {
+    gallery_generating = generation_in_progress;
+    if (!generation_in_progress && gallery_refresh_pending) {
+        Glib::signal_idle().connect_once(sigc::mem_fun(*this, &MainWindow::on_gallery_refresh_idle));
+    }
+    if (!generation_in_progress && query_result_pending) {
+        Glib::signal_idle().connect_once(sigc::mem_fun(*this, &MainWindow::show_query_result));
+    }
+
     tag_picker.set_sensitive(!generation_in_progress);
     button_main_menu.set_sensitive(!generation_in_progress);
     viewer_controls.set_sensitive(!generation_in_progress);
@@ -282,6 +1016,15 @@ void MainWindow::on_gallery_generation_status_changed(bool generation_in_progres
     }
 }
 
+void MainWindow::on_gallery_refresh_idle() {
+    // a generation started after the refresh was scheduled
+    // it is scheduled again once that generation is done
+    if (gallery_generating) { return; }
+
+    gallery_refresh_pending = false;
+    refresh_gallery();
+}
+
 void MainWindow::on_hide_viewer() {
     switching_allowed = true;
     TagQuery query = tag_picker.get_current_query();
@@ -289,6 +1032,7 @@ void MainWindow::on_hide_viewer() {
         tag_picker.clear_current_item_tags();
     }
 
+    viewer.stop();
     viewer.set_visible(false);
     viewer_controls.set_visible(false);
     gallery.set_visible(true);
@@ -347,12 +1091,13 @@ void MainWindow::on_add_items() {
     file_chooser->add_button("Select", Gtk::ResponseType::OK);
 
     auto filter = Gtk::FileFilter::create();
-    filter->set_name("Image files");
+    filter->set_name("Image and video files");
     filter->add_mime_type("image/png");
     filter->add_mime_type("image/jpg");
     filter->add_mime_type("image/jpeg");
     filter->add_mime_type("image/tiff");
     filter->add_mime_type("image/gif");
+    filter->add_mime_type("video/*");
     file_chooser->add_filter(filter);
 
     auto filter_all = Gtk::FileFilter::create();
@@ -366,6 +1111,11 @@ void MainWindow::on_add_items() {
     file_chooser->show();
 }
 
+void MainWindow::on_scan_directories() {
+    main_menu.hide();
+    scan_directories(true);
+}
+
 void MainWindow::on_db_settings() {
     main_menu.hide();
     db_settings_window.show();
@@ -406,18 +1156,125 @@ void MainWindow::on_exclude_tags_changed(const std::set<Glib::ustring> &exclude_
 void MainWindow::on_directories_changed(const std::set<Glib::ustring> &directories) {
     db.set_directories(directories);
     item_window.set_directories(directories);
+    watch_directories();
 }
 
-void MainWindow::on_add_item(TagDb::Item item) {
-    db.add_item(item);
-    set_completer_data(db.get_all_tags());
+void MainWindow::on_merge_tags(const std::set<Glib::ustring> &tags, const Glib::ustring &target) {
+    db.merge_tags(tags, target);
+    update_completer_data();
+    update_album_sizes();
+
+    // the default excluded tags may have been renamed as well
+    db_settings_window.setup(db.get_db_file_path(),
+                             db.get_directories(),
+                             db.get_default_excluded_tags(),
+                             db.get_rules().get_rules(),
+                             db.get_prefix());
 
     refresh_gallery();
 }
 
+void MainWindow::on_retag_gallery_items(const std::set<Glib::ustring> &tags, bool add) {
+    // the gallery shows the result of the current query
+    std::vector<std::string> skipped;
+    size_t changed = add ? db.add_tags_to_items(files, tags) : db.remove_tags_from_items(files, tags, skipped);
+
+    if (changed > 0) {
+        update_completer_data();
+        update_album_sizes();
+        refresh_gallery();
+    }
+
+    if (skipped.size() > 0) {
+        std::string skipped_list;
+        for (size_t idx = 0; idx < skipped.size() && idx < 10; idx++) {
+            skipped_list += "\n" + skipped.at(idx);
+        }
+        if (skipped.size() > 10) {
+            skipped_list += "\n...";
+        }
+
+        show_warning("Items Not Changed",
+                     std::to_string(skipped.size()) +
+                     " items were not changed because they would have no tags left:" + skipped_list);
+    }
+}
+
+void MainWindow::on_rules_changed(const std::set<TagRules::Rule> &rules) {
+    // implied tags change the counts and the results of queries
+    db.set_rules(rules);
+    update_completer_data();
+    update_album_sizes();
+    refresh_gallery();
+}
+
+void MainWindow::on_import_keywords(bool gallery_items) {
+    if (keyword_sync.is_running()) {
+        show_warning("Error Importing Keywords", "Keywords are already being imported or written");
+        return;
+    }
+
+    const std::string &prefix = db.get_prefix();
+    std::vector<std::string> rel_paths;
+    if (gallery_items) {
+        // the gallery shows the result of the current query
+        for (const Glib::ustring &file : files) {
+            if (file.raw().compare(0, prefix.size(), prefix) == 0) {
+                rel_paths.push_back(file.raw().substr(prefix.size()));
+            }
+        }
+    }
+    else {
+        for (const Glib::ustring &item_path : db.get_item_paths()) {
+            for (const Glib::ustring &dir : db.get_directories()) {
+                if (item_path.raw().compare(0, dir.bytes() + 1, dir.raw() + "/") == 0) {
+                    rel_paths.push_back(item_path.raw());
+                    break;
+                }
+            }
+        }
+    }
+
+    if (rel_paths.size() == 0) {
+        show_warning("Error Importing Keywords",
+                     gallery_items ? "The gallery shows no items" : "There are no items in the registered directories");
+        return;
+    }
+
+    keyword_sync.import_keywords(prefix, std::move(rel_paths));
+}
+
+void MainWindow::on_write_sidecars() {
+    if (keyword_sync.is_running()) {
+        show_warning("Error Writing Sidecars", "Keywords are already being imported or written");
+        return;
+    }
+
+    // the gallery shows the result of the current query
+    std::vector<std::pair<std::string, std::set<Glib::ustring>>> item_tags = db.get_tags_for_items(files);
+    if (item_tags.size() == 0) {
+        show_warning("Error Writing Sidecars", "The gallery shows no items");
+        return;
+    }
+
+    keyword_sync.write_sidecars(db.get_prefix(), std::move(item_tags));
+}
+
+void MainWindow::on_add_item_batch(const std::vector<TagDb::Item> &items,
+                                   const std::vector<ImportEngine::Job> &imports)
+{
+    // every file is hashed before its item is added, including
+    // files that are already in the database directory
+    if (items.size() == 0) { return; }
+
+    import_queue.push_back(std::make_pair(items, imports));
+    start_next_import();
+}
+
 void MainWindow::on_edit_item(TagDb::Item item) {
     db.edit_item(item);
-    set_completer_data(db.get_all_tags());
+    update_completer_data();
+    update_album_sizes();
 
     refresh_gallery();
 }
@@ -426,9 +1283,14 @@ void MainWindow::on_request_suggestions(const std::set<Glib::ustring> &tags) {
     item_window.set_suggestions(db.suggestions(tags));
 }
 
+void MainWindow::on_request_visual_suggestions(uint64_t perceptual_hash) {
+    item_window.set_suggestions(db.visual_suggestions(perceptual_hash));
+}
+
 void MainWindow::on_delete_item(const Glib::ustring &file_path, bool delete_file) {
     db.delete_item(file_path, delete_file);
-    set_completer_data(db.get_all_tags());
+    update_completer_data();
+    update_album_sizes();
 
     gallery.remove_from_cache(file_path);
     refresh_gallery();
@@ -2,6 +2,8 @@
 
 // standard library
 #include <memory>
+#include <deque>
+#include <utility>
 
 // gtkmm
 #include <gtkmm/applicationwindow.h>
@@ -16,6 +18,7 @@
 #include <gtkmm/messagedialog.h>
 #include <gtkmm/filechooserdialog.h>
 #include <gtkmm/aboutdialog.h>
+#include <gtkmm/progressbar.h>
 
 // project
 #include "imageviewer.hh"
@@ -24,6 +27,13 @@
 #include "tagpicker.hh"
 #include "mainmenu.hh"
 #include "tagdb.hh"
+#include "dbloader.hh"
+#include "queryscheduler.hh"
+#include "fsscanner.hh"
+#include "dirwatcher.hh"
+#include "importengine.hh"
+#include "metadataextractor.hh"
+#include "keywordsync.hh"
 #include "config.hh"
 #include "itemwindow.hh"
 #include "dbsettingswindow.hh"
@@ -39,8 +49,7 @@ class MainWindow : public Gtk::ApplicationWindow {
         enum class Action { LOAD, CREATE, ADD };
 
         // members for providing entry completion
-        Glib::RefPtr<Gtk::ListStore> list_store;
-        TagPickerBase::ListModel list_model;
+        std::shared_ptr<CompletionIndex> completion_index;
 
         // custom widgets
         ImageViewer viewer;
@@ -50,12 +59,23 @@ class MainWindow : public Gtk::ApplicationWindow {
 
         // other custom classes
         TagDb db;
+        QueryScheduler query_scheduler;
+        DbLoader loader;
+        FsScanner scanner;
+        DirWatcher watcher;
+        ImportEngine importer;
+        MetadataExtractor extractor;
+        KeywordSync keyword_sync;
         Config config;
 
         // header widgets
         Gtk::HeaderBar header;
         Gtk::MenuButton button_main_menu;
         ViewerControls viewer_controls;
+        Gtk::ProgressBar load_progress;
+        Gtk::Box import_box;
+        Gtk::ProgressBar import_progress;
+        Gtk::Button btn_cancel_import;
 
         // other windows
         ItemWindow item_window;
@@ -79,27 +99,105 @@ class MainWindow : public Gtk::ApplicationWindow {
         size_t files_idx;
         bool switching_allowed;
 
+        // members for refreshing the gallery while a database is loading
+        bool first_section_loaded;
+        bool gallery_generating;
+        bool gallery_refresh_pending;
+
+        // the newest query result, shown once no previews are being generated
+        std::vector<Glib::ustring> query_result;
+        std::shared_ptr<const TagDb::QueryCounts> query_result_counts;
+        std::vector<Glib::ustring> query_result_suggestions;
+        bool query_result_pending;
+
+        // animates the progress bar while scanning directories
+        sigc::connection scan_pulse;
+
+        // whether the running scan queues untracked files for tagging
+        bool scan_adds_untracked;
+
+        // items waiting for their files to be imported
+        std::deque<std::pair<std::vector<TagDb::Item>, std::vector<ImportEngine::Job>>> import_queue;
+        std::vector<TagDb::Item> importing_items;
+
+        // a database that is loaded once the imports are done
+        std::string pending_db_path;
+
+        // the window closes once the imports are done
+        bool close_pending;
+        sigc::connection import_progress_timer;
+
+        // perceptual hashes are written some time after the previews
+        // are generated, unless another change writes them earlier
+        sigc::connection hash_write_timer;
+
         // fucntions
         void load_database(const std::string &db_file_path);
         void add_items(const std::vector<std::string> &file_paths);
-        void set_completer_data(const std::set<Glib::ustring> &completer_tags);
+        void update_completer_data();
+        void update_album_sizes();
         void show_warning(Glib::ustring primary, Glib::ustring secondary);
         void refresh_gallery();
+        void request_gallery_refresh();
+        void scan_directories(bool add_untracked);
+        void show_missing_items(const std::vector<std::string> &missing);
+        void move_shown_files(const TagDb::PathChanges &changes);
+        void watch_directories();
+        void start_next_import();
+        void extract_missing_metadata();
+        void write_unwritten_changes();
 
         // signal handlers
         bool on_key_pressed(guint keyval, guint keycode, Gdk::ModifierType state);
+        bool on_close_request() override;
+
+        // database loader
+        void on_db_section_loaded(DbFile::ParseResult &section);
+        void on_db_load_progress(double fraction);
+        void on_db_load_finished();
+        void on_db_load_failed(std::exception_ptr error);
+
+        // directory scanner
+        void on_scan_finished(const FsScanner::Result &result);
+        bool on_scan_pulse();
+
+        // import engine
+        void on_import_finished(const std::vector<ImportEngine::Result> &results);
+        bool on_import_progress();
+        void on_cancel_import();
+
+        // directory watcher
+        void on_watched_files_changed(const DirWatcher::Changes &changes);
+
+        // metadata extractor
+        void on_metadata_extracted(const MetadataExtractor::Batch &batch);
+        void on_metadata_finished();
+
+        // keyword import and sidecars
+        void on_keyword_sync_finished(const KeywordSync::Result &result);
 
         // tag picker
         void on_filter_toggled(TagDb::QueryType query_type);
         void on_tag_query_changed(TagQuery tag_selection);
+        void on_query_finished(std::vector<Glib::ustring> &result,
+                               std::shared_ptr<const TagDb::QueryCounts> counts,
+                               std::vector<Glib::ustring> &suggestions);
+        void show_query_result();
         void on_reload_default_exclude_required();
+        void on_album_chosen(const Glib::ustring &name);
+        void on_album_saved(const Glib::ustring &name);
+        void on_album_removed(const Glib::ustring &name);
 
         // gallery
         void on_gallery_item_chosen(size_t id);
         void on_gallery_item_selected(size_t id);
         void on_gallery_failed_to_open(size_t id);
         void on_gallery_edit(const Glib::ustring &file_path);
+        void on_gallery_find_similar(const Glib::ustring &file_path);
+        void on_gallery_previews_hashed(const std::vector<std::pair<Glib::ustring, uint64_t>> &hashes);
+        bool on_hash_write_timeout();
         void on_gallery_generation_status_changed(bool generation_in_progress);
+        void on_gallery_refresh_idle();
 
         // image viewer
         void on_hide_viewer();
@@ -108,6 +206,7 @@ class MainWindow : public Gtk::ApplicationWindow {
         void on_load_database();
         void on_create_database();
         void on_add_items();
+        void on_scan_directories();
         void on_db_settings();
         void on_tag_picker_toggled();
         void on_preferences();
@@ -116,12 +215,19 @@ class MainWindow : public Gtk::ApplicationWindow {
         // db settings window
         void on_exclude_tags_changed(const std::set<Glib::ustring> &exclude_tags);
         void on_directories_changed(const std::set<Glib::ustring> &directories);
+        void on_merge_tags(const std::set<Glib::ustring> &tags, const Glib::ustring &target);
+        void on_retag_gallery_items(const std::set<Glib::ustring> &tags, bool add);
+        void on_rules_changed(const std::set<TagRules::Rule> &rules);
+        void on_import_keywords(bool gallery_items);
+        void on_write_sidecars();
 
         // item window
-        void on_add_item(TagDb::Item item);
+        void on_add_item_batch(const std::vector<TagDb::Item> &items,
+                               const std::vector<ImportEngine::Job> &imports);
         void on_edit_item(TagDb::Item item);
         void on_delete_item(const Glib::ustring &file_path, bool delete_file);
         void on_request_suggestions(const std::set<Glib::ustring> &tags);
+        void on_request_visual_suggestions(uint64_t perceptual_hash);
 
         // preferences window
         void on_select_default_db(const std::string &default_db_path);
@@ -0,0 +1,132 @@
+// standard library
+#include <algorithm>
+#include <iterator>
+#include <chrono>
+#include <future>
+
+// project
+#include "metadataextractor.hh"
+#include "metadatareader.hh"
+#include "workerpool.hh"
+
+namespace {
+    // files per job, large enough that the queue stays short
+    const size_t chunk_size = 256;
+
+    // the GUI thread is notified at most this often
+    const std::chrono::milliseconds dispatch_interval(1000);
+}
+
+// MetadataExtractor implementation
+MetadataExtractor::MetadataExtractor()
+:
+    cancelled(false),
+    finished(false),
+    extracting(false)
+{
+    dispatcher.connect(sigc::mem_fun(*this, &MetadataExtractor::on_dispatch));
+}
+
+MetadataExtractor::~MetadataExtractor() {
+    cancel();
+}
+
+void MetadataExtractor::extract(const std::string &prefix, std::vector<std::string> rel_paths) {
+    cancel();
+    if (rel_paths.empty()) { return; }
+
+    extracting = true;
+    thread = std::thread(&MetadataExtractor::run, this, prefix, std::move(rel_paths));
+}
+
+void MetadataExtractor::cancel() {
+    cancelled = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+    cancelled = false;
+    finished = false;
+    extracting = false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    pending.clear();
+}
+
+bool MetadataExtractor::is_extracting() const {
+    return extracting;
+}
+
+sigc::signal<void (const MetadataExtractor::Batch &)> MetadataExtractor::signal_extracted() {
+    return private_extracted;
+}
+
+sigc::signal<void ()> MetadataExtractor::signal_finished() {
+    return private_finished;
+}
+
+void MetadataExtractor::run(std::string prefix, std::vector<std::string> rel_paths) {
+    // reading headers is mostly waiting for the disk, so
+    // many files are read at once even on few cores
+    WorkerPool pool(std::max<size_t>(std::thread::hardware_concurrency(), 8));
+    std::chrono::steady_clock::time_point last_dispatch = std::chrono::steady_clock::now();
+    std::mutex dispatch_mutex;
+
+    std::vector<std::future<void>> futures;
+    for (size_t begin = 0; begin < rel_paths.size(); begin += chunk_size) {
+        size_t end = std::min(begin + chunk_size, rel_paths.size());
+        futures.push_back(pool.submit([this, &prefix, &rel_paths, &last_dispatch, &dispatch_mutex, begin, end](){
+            Batch batch;
+            for (size_t idx = begin; idx < end && !cancelled; idx++) {
+                MetadataTable::Record record;
+                if (MetadataReader::read_file(prefix + rel_paths.at(idx), record)) {
+                    batch.push_back(std::make_pair(rel_paths.at(idx), std::move(record)));
+                }
+            }
+            if (cancelled) { return; }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                pending.insert(pending.end(), std::make_move_iterator(batch.begin()), std::make_move_iterator(batch.end()));
+            }
+
+            std::lock_guard<std::mutex> lock(dispatch_mutex);
+            std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+            if (now - last_dispatch >= dispatch_interval) {
+                last_dispatch = now;
+                dispatcher.emit();
+            }
+        }));
+    }
+    for (std::future<void> &future : futures) {
+        future.get();
+    }
+
+    if (cancelled) { return; }
+
+    finished = true;
+    dispatcher.emit();
+}
+
+void MetadataExtractor::on_dispatch() {
+    // a cancelled extraction may still have notified
+    if (!extracting) { return; }
+
+    // all records are pending before the extraction is finished
+    bool done = finished;
+    Batch batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        batch.swap(pending);
+    }
+
+    if (!batch.empty()) {
+        private_extracted.emit(batch);
+    }
+
+    if (done) {
+        thread.join();
+        finished = false;
+        extracting = false;
+        private_finished.emit();
+    }
+}
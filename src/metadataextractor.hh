@@ -0,0 +1,60 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <vector>
+#include <utility>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// gtkmm
+#include <glibmm/dispatcher.h>
+#include <sigc++/signal.h>
+
+// project
+#include "metadatatable.hh"
+
+// Reads the metadata of many files on background threads, see MetadataReader.
+// The records are delivered on the GUI thread in batches, at most about
+// once a second, so that a large collection does not flood the main loop.
+class MetadataExtractor {
+    public:
+        // relative paths and records of the files that were read
+        typedef std::vector<std::pair<std::string, MetadataTable::Record>> Batch;
+
+        MetadataExtractor();
+        ~MetadataExtractor();
+
+        // the relative paths are read below the prefix, an
+        // extraction that is still running is cancelled first
+        void extract(const std::string &prefix, std::vector<std::string> rel_paths);
+        void cancel();
+        bool is_extracting() const;
+
+        // signal forwarding
+        sigc::signal<void (const Batch &)> signal_extracted();
+        sigc::signal<void ()> signal_finished();
+
+    private:
+        // members
+        std::thread thread;
+        std::atomic<bool> cancelled;
+        std::atomic<bool> finished;
+        bool extracting;
+
+        // records are passed from the worker threads to the GUI thread
+        Glib::Dispatcher dispatcher;
+        std::mutex mutex;
+        Batch pending;
+
+        // functions
+        void run(std::string prefix, std::vector<std::string> rel_paths);
+
+        // signal handlers
+        void on_dispatch();
+
+        // signals
+        sigc::signal<void (const Batch &)> private_extracted;
+        sigc::signal<void ()> private_finished;
+};
@@ -0,0 +1,738 @@
+// standard library
+#include <cstring>
+#include <vector>
+#include <string_view>
+#include <set>
+
+// POSIX
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// glib
+#include <glib.h>
+
+// project
+#include "metadatareader.hh"
+#include "xmpsidecar.hh"
+
+namespace {
+    // the headers of most files fit into the first read
+    const size_t first_read_size = 1 << 16;
+
+    // corrupt files may have loops or huge counts in their headers
+    const size_t max_entries = 1024;
+    const size_t max_chunks = 4096;
+
+    const std::string_view exif_signature("Exif\0\0", 6);
+    const std::string_view xmp_signature("http://ns.adobe.com/xap/1.0/\0", 29);
+    const std::string_view xmp_keyword("XML:com.adobe.xmp\0", 18);
+    const std::string_view photoshop_signature("Photoshop 3.0\0", 14);
+
+    uint32_t read_be16(const unsigned char *data) {
+        return ((uint32_t)data[0] << 8) | data[1];
+    }
+
+    uint32_t read_be32(const unsigned char *data) {
+        return ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+    }
+
+    uint32_t read_le16(const unsigned char *data) {
+        return (uint32_t)data[0] | ((uint32_t)data[1] << 8);
+    }
+
+    uint32_t read_le24(const unsigned char *data) {
+        return (uint32_t)data[0] | ((uint32_t)data[1] << 8) | ((uint32_t)data[2] << 16);
+    }
+
+    uint32_t read_le32(const unsigned char *data) {
+        return read_le24(data) | ((uint32_t)data[3] << 24);
+    }
+
+    // random access to a file, the first block is kept in memory
+    class FileView {
+        public:
+            FileView(int fd)
+            :
+                fd(fd),
+                file_size(0)
+            {
+                struct stat file_stat;
+                if (fstat(fd, &file_stat) == 0) {
+                    file_size = file_stat.st_size;
+                }
+
+                head.resize(std::min<uint64_t>(file_size, first_read_size));
+                if (!read_at(0, head.data(), head.size())) {
+                    head.clear();
+                    file_size = 0;
+                }
+            }
+
+            // the bytes stay valid until the next call, nullptr if the file is too short
+            const unsigned char *get(uint64_t offset, size_t length) {
+                if (offset > file_size || length > file_size - offset) { return nullptr; }
+                if (offset + length <= head.size()) { return head.data() + offset; }
+
+                scratch.resize(length);
+                return read_at(offset, scratch.data(), length) ? scratch.data() : nullptr;
+            }
+
+            std::string get_string(uint64_t offset, size_t length) {
+                const unsigned char *data = get(offset, length);
+                return data == nullptr ? std::string() : std::string((const char *)data, length);
+            }
+
+            uint64_t size() const {
+                return file_size;
+            }
+
+        private:
+            int fd;
+            uint64_t file_size;
+            std::vector<unsigned char> head;
+            std::vector<unsigned char> scratch;
+
+            bool read_at(uint64_t offset, unsigned char *data, size_t length) {
+                while (length > 0) {
+                    ssize_t count = pread(fd, data, length, offset);
+                    if (count <= 0) { return false; }
+                    data += count;
+                    offset += count;
+                    length -= count;
+                }
+                return true;
+            }
+    };
+
+    // metadata blocks that are parsed after the structure of the file
+    class Headers {
+        public:
+            std::string xmp;
+            std::string iptc;
+    };
+
+    // the time in EXIF and XMP, time zones and fractions of seconds are left out
+    bool parse_capture_time(std::string_view str, int64_t &time) {
+        size_t length = 0;
+        while (length < str.size() && length < 19) {
+            char c = str[length];
+            if (length >= 10 && (c == '+' || c == '-' || c == 'Z' || c == '.')) { break; }
+            length += 1;
+        }
+
+        int64_t end;
+        return MetadataTable::parse_time(str.substr(0, length), time, end);
+    }
+
+    std::string strip(const std::string &str) {
+        size_t end = str.find('\0');
+        std::string result = str.substr(0, end);
+
+        size_t begin = result.find_first_not_of(" \t\n");
+        if (begin == std::string::npos) { return std::string(); }
+        return result.substr(begin, result.find_last_not_of(" \t\n") - begin + 1);
+    }
+
+    // the model often repeats the make, like Canon and Canon EOS 5D
+    Glib::ustring get_camera(const std::string &make, const std::string &model) {
+        std::string camera = strip(model);
+        std::string stripped_make = strip(make);
+        if (!stripped_make.empty() &&
+            g_ascii_strncasecmp(camera.c_str(), stripped_make.c_str(), stripped_make.size()) != 0)
+        {
+            camera = camera.empty() ? stripped_make : stripped_make + " " + camera;
+        }
+
+        if (!g_utf8_validate(camera.data(), camera.size(), nullptr)) { return Glib::ustring(); }
+        return camera;
+    }
+
+    // the TIFF structure of an EXIF block, which is also the structure of a TIFF file
+    class ExifReader {
+        public:
+            ExifReader(FileView &view, uint64_t base, uint64_t size)
+            :
+                view(view),
+                base(base),
+                size(size),
+                little_endian(true)
+            {}
+
+            void read(MetadataTable::Record &record, Headers &headers, bool is_tiff_file) {
+                const unsigned char *header = view.get(base, 8);
+                if (header == nullptr || size < 8) { return; }
+
+                if (header[0] == 'I' && header[1] == 'I') { little_endian = true; }
+                else if (header[0] == 'M' && header[1] == 'M') { little_endian = false; }
+                else { return; }
+                if (read16(header + 2) != 42) { return; }
+
+                std::string make;
+                std::string model;
+                std::string time_original;
+                std::string time_digitized;
+                std::string time_modified;
+                uint32_t width = 0;
+                uint32_t height = 0;
+                uint32_t exif_offset = 0;
+                uint32_t gps_offset = 0;
+
+                for (const Entry &entry : read_ifd(read32(header + 4))) {
+                    switch (entry.tag) {
+                        case 0x0100: if (is_tiff_file) { read_uint(entry, width); } break;
+                        case 0x0101: if (is_tiff_file) { read_uint(entry, height); } break;
+                        case 0x010F: make = read_string(entry); break;
+                        case 0x0110: model = read_string(entry); break;
+                        case 0x0132: time_modified = read_string(entry); break;
+                        case 0x8769: read_uint(entry, exif_offset); break;
+                        case 0x8825: read_uint(entry, gps_offset); break;
+                        case 0x02BC: if (is_tiff_file) { headers.xmp = read_bytes(entry); } break;
+                        case 0x83BB: if (is_tiff_file) { headers.iptc = read_bytes(entry); } break;
+                    }
+                }
+
+                if (exif_offset != 0) {
+                    for (const Entry &entry : read_ifd(exif_offset)) {
+                        switch (entry.tag) {
+                            case 0x9003: time_original = read_string(entry); break;
+                            case 0x9004: time_digitized = read_string(entry); break;
+                            case 0xA002: if (width == 0) { read_uint(entry, width); } break;
+                            case 0xA003: if (height == 0) { read_uint(entry, height); } break;
+                        }
+                    }
+                }
+
+                if (gps_offset != 0) {
+                    std::string latitude_ref;
+                    std::string longitude_ref;
+                    double latitude[3];
+                    double longitude[3];
+                    bool has_latitude = false;
+                    bool has_longitude = false;
+                    for (const Entry &entry : read_ifd(gps_offset)) {
+                        switch (entry.tag) {
+                            case 1: latitude_ref = read_string(entry); break;
+                            case 2: has_latitude = read_rationals(entry, latitude, 3); break;
+                            case 3: longitude_ref = read_string(entry); break;
+                            case 4: has_longitude = read_rationals(entry, longitude, 3); break;
+                        }
+                    }
+
+                    if (has_latitude && has_longitude && !latitude_ref.empty() && !longitude_ref.empty()) {
+                        record.latitude = latitude[0] + latitude[1] / 60 + latitude[2] / 3600;
+                        record.longitude = longitude[0] + longitude[1] / 60 + longitude[2] / 3600;
+                        if (latitude_ref[0] == 'S') { record.latitude = -record.latitude; }
+                        if (longitude_ref[0] == 'W') { record.longitude = -record.longitude; }
+                    }
+                }
+
+                // the time the picture was taken, or the best guess
+                for (const std::string *time : { &time_original, &time_digitized, &time_modified }) {
+                    if (!record.has_capture_time() && parse_capture_time(*time, record.capture_time)) { break; }
+                }
+
+                if (record.width == 0 || record.height == 0) {
+                    record.width = width;
+                    record.height = height;
+                }
+
+                if (record.camera.empty()) {
+                    record.camera = get_camera(make, model);
+                }
+            }
+
+        private:
+            class Entry {
+                public:
+                    uint32_t tag;
+                    uint32_t type;
+                    uint32_t count;
+
+                    // offset of the value within the block
+                    uint64_t value;
+            };
+
+            FileView &view;
+            uint64_t base;
+            uint64_t size;
+            bool little_endian;
+
+            uint32_t read16(const unsigned char *data) const {
+                return little_endian ? read_le16(data) : read_be16(data);
+            }
+
+            uint32_t read32(const unsigned char *data) const {
+                return little_endian ? read_le32(data) : read_be32(data);
+            }
+
+            const unsigned char *get(uint64_t offset, size_t length) {
+                if (offset > size || length > size - offset) { return nullptr; }
+                return view.get(base + offset, length);
+            }
+
+            static size_t type_size(uint32_t type) {
+                switch (type) {
+                    case 1: case 2: case 6: case 7: return 1;
+                    case 3: case 8: return 2;
+                    case 4: case 9: case 11: return 4;
+                    case 5: case 10: case 12: return 8;
+                    default: return 0;
+                }
+            }
+
+            std::vector<Entry> read_ifd(uint64_t offset) {
+                std::vector<Entry> result;
+
+                const unsigned char *count_data = get(offset, 2);
+                if (count_data == nullptr) { return result; }
+                size_t count = read16(count_data);
+                if (count > max_entries) { return result; }
+
+                const unsigned char *data = get(offset + 2, count * 12);
+                if (data == nullptr) { return result; }
+
+                for (size_t idx = 0; idx < count; idx++) {
+                    const unsigned char *entry_data = data + idx * 12;
+                    Entry entry;
+                    entry.tag = read16(entry_data);
+                    entry.type = read16(entry_data + 2);
+                    entry.count = read32(entry_data + 4);
+
+                    // values of up to four bytes are stored in the entry itself
+                    uint64_t value_size = (uint64_t)type_size(entry.type) * entry.count;
+                    if (value_size == 0) { continue; }
+                    entry.value = value_size <= 4 ? offset + 2 + idx * 12 + 8 : read32(entry_data + 8);
+                    result.push_back(entry);
+                }
+
+                return result;
+            }
+
+            std::string read_string(const Entry &entry) {
+                if (entry.type != 2 || entry.count > max_entries) { return std::string(); }
+
+                const unsigned char *data = get(entry.value, entry.count);
+                return data == nullptr ? std::string() : strip(std::string((const char *)data, entry.count));
+            }
+
+            std::string read_bytes(const Entry &entry) {
+                size_t length = (size_t)type_size(entry.type) * entry.count;
+                const unsigned char *data = get(entry.value, length);
+                return data == nullptr ? std::string() : std::string((const char *)data, length);
+            }
+
+            bool read_uint(const Entry &entry, uint32_t &value) {
+                const unsigned char *data = get(entry.value, 4);
+                if (entry.type == 3 && data != nullptr) {
+                    value = read16(data);
+                    return true;
+                }
+                if (entry.type == 4 && data != nullptr) {
+                    value = read32(data);
+                    return true;
+                }
+                return false;
+            }
+
+            bool read_rationals(const Entry &entry, double *values, size_t count) {
+                if (entry.type != 5 || entry.count < count) { return false; }
+
+                const unsigned char *data = get(entry.value, count * 8);
+                if (data == nullptr) { return false; }
+
+                for (size_t idx = 0; idx < count; idx++) {
+                    uint32_t denominator = read32(data + idx * 8 + 4);
+                    if (denominator == 0) { return false; }
+                    values[idx] = (double)read32(data + idx * 8) / denominator;
+                }
+                return true;
+            }
+    };
+
+    // the value of a property in an XMP packet, written
+    // as an attribute or as an element, or an empty string
+    std::string find_xmp_value(const std::string &xmp, const std::string &name) {
+        for (size_t pos = xmp.find(name); pos != std::string::npos; pos = xmp.find(name, pos + 1)) {
+            size_t end = pos + name.size();
+            if (end >= xmp.size()) { break; }
+
+            if (pos > 0 && xmp[pos - 1] == '<' && xmp[end] == '>') {
+                size_t close = xmp.find('<', end);
+                if (close == std::string::npos) { break; }
+                return strip(xmp.substr(end + 1, close - end - 1));
+            }
+
+            bool attribute = pos > 0 && std::strchr(" \t\r\n", xmp[pos - 1]) != nullptr;
+            if (attribute && end + 1 < xmp.size() && xmp[end] == '=' && (xmp[end + 1] == '"' || xmp[end + 1] == '\'')) {
+                size_t close = xmp.find(xmp[end + 1], end + 2);
+                if (close == std::string::npos) { break; }
+                return strip(xmp.substr(end + 2, close - end - 2));
+            }
+        }
+
+        return std::string();
+    }
+
+    // coordinates in XMP are written like 52,31.20012N or 52,31,12N
+    bool parse_xmp_coordinate(const std::string &str, double &value) {
+        if (str.size() < 2) { return false; }
+
+        char direction = str.back();
+        if (std::strchr("NSEW", direction) == nullptr) { return false; }
+
+        double parts[3] = { 0, 0, 0 };
+        size_t count = 0;
+        std::string numbers = str.substr(0, str.size() - 1);
+        const char *pos = numbers.c_str();
+        while (*pos != '\0' && count < 3) {
+            char *end = nullptr;
+            parts[count] = g_ascii_strtod(pos, &end);
+            if (end == pos) { return false; }
+            count += 1;
+            pos = *end == ',' ? end + 1 : end;
+        }
+        if (*pos != '\0' || count < 2) { return false; }
+
+        value = parts[0] + parts[1] / 60 + parts[2] / 3600;
+        if (direction == 'S' || direction == 'W') { value = -value; }
+        return true;
+    }
+
+    void read_xmp(const std::string &xmp, MetadataTable::Record &record) {
+        if (xmp.empty()) { return; }
+
+        if (!record.has_capture_time()) {
+            for (const char *name : { "exif:DateTimeOriginal", "xmp:CreateDate", "photoshop:DateCreated" }) {
+                if (parse_capture_time(find_xmp_value(xmp, name), record.capture_time)) { break; }
+            }
+        }
+
+        if (record.width == 0 || record.height == 0) {
+            std::string width = find_xmp_value(xmp, "exif:PixelXDimension");
+            std::string height = find_xmp_value(xmp, "exif:PixelYDimension");
+            if (width.empty() || height.empty()) {
+                width = find_xmp_value(xmp, "tiff:ImageWidth");
+                height = find_xmp_value(xmp, "tiff:ImageLength");
+            }
+            record.width = std::strtoul(width.c_str(), nullptr, 10);
+            record.height = std::strtoul(height.c_str(), nullptr, 10);
+        }
+
+        if (!record.has_location()) {
+            double latitude;
+            double longitude;
+            if (parse_xmp_coordinate(find_xmp_value(xmp, "exif:GPSLatitude"), latitude) &&
+                parse_xmp_coordinate(find_xmp_value(xmp, "exif:GPSLongitude"), longitude))
+            {
+                record.latitude = latitude;
+                record.longitude = longitude;
+            }
+        }
+
+        if (record.camera.empty()) {
+            record.camera = get_camera(find_xmp_value(xmp, "tiff:Make"), find_xmp_value(xmp, "tiff:Model"));
+        }
+    }
+
+    // the IPTC block among the image resources of Photoshop
+    std::string get_photoshop_iptc(const std::string &resources) {
+        const unsigned char *data = (const unsigned char *)resources.data();
+        size_t pos = 0;
+        while (pos + 12 <= resources.size() && resources.compare(pos, 4, "8BIM") == 0) {
+            uint32_t id = read_be16(data + pos + 4);
+
+            // the name is a padded Pascal string
+            size_t size_pos = pos + 6 + ((data[pos + 6] + 2) & ~1);
+            if (size_pos + 4 > resources.size()) { break; }
+            uint32_t length = read_be32(data + size_pos);
+            size_t data_pos = size_pos + 4;
+            if (length > resources.size() - data_pos) { break; }
+
+            if (id == 0x0404) {
+                return resources.substr(data_pos, length);
+            }
+            pos = data_pos + length + (length & 1);
+        }
+
+        return std::string();
+    }
+
+    // the keywords of the application record, which are in UTF-8
+    // if the envelope says so and are taken as Latin-1 otherwise
+    std::vector<Glib::ustring> get_iptc_keywords(const std::string &iptc) {
+        const unsigned char *data = (const unsigned char *)iptc.data();
+        bool utf8 = false;
+        std::vector<std::string> keywords;
+
+        size_t pos = 0;
+        while (pos + 5 <= iptc.size() && data[pos] == 0x1C) {
+            uint8_t record = data[pos + 1];
+            uint8_t dataset = data[pos + 2];
+            uint32_t length = read_be16(data + pos + 3);
+
+            // extended datasets are never keywords
+            if (length & 0x8000) { break; }
+            pos += 5;
+            if (length > iptc.size() - pos) { break; }
+
+            if (record == 1 && dataset == 90) {
+                utf8 = iptc.compare(pos, length, "\x1b%G") == 0;
+            }
+            else if (record == 2 && dataset == 25) {
+                keywords.push_back(iptc.substr(pos, length));
+            }
+            pos += length;
+        }
+
+        std::vector<Glib::ustring> result;
+        for (const std::string &keyword : keywords) {
+            if (g_utf8_validate(keyword.data(), keyword.size(), nullptr)) {
+                result.push_back(keyword);
+                continue;
+            }
+            if (utf8) { continue; }
+
+            std::string converted;
+            for (unsigned char c : keyword) {
+                if (c < 0x80) {
+                    converted += c;
+                }
+                else {
+                    converted += (char)(0xC0 | (c >> 6));
+                    converted += (char)(0x80 | (c & 0x3F));
+                }
+            }
+            result.push_back(converted);
+        }
+
+        return result;
+    }
+
+    void read_jpeg(FileView &view, MetadataTable::Record &record, Headers &headers) {
+        bool exif_read = false;
+
+        // the segments with metadata come before the frame header
+        uint64_t offset = 2;
+        for (size_t idx = 0; idx < max_chunks; idx++) {
+            const unsigned char *marker = view.get(offset, 4);
+            if (marker == nullptr || marker[0] != 0xFF) { break; }
+
+            // fill bytes and markers without a segment
+            if (marker[1] == 0xFF) {
+                offset += 1;
+                continue;
+            }
+            if (marker[1] == 0x01 || (marker[1] >= 0xD0 && marker[1] <= 0xD7)) {
+                offset += 2;
+                continue;
+            }
+            if (marker[1] == 0xD9 || marker[1] == 0xDA) { break; }
+
+            uint8_t type = marker[1];
+            uint32_t length = read_be16(marker + 2);
+            if (length < 2) { break; }
+            uint64_t data = offset + 4;
+            uint32_t data_length = length - 2;
+
+            // every start of frame except the ones of DHT, JPG and DAC
+            bool frame = type >= 0xC0 && type <= 0xCF && type != 0xC4 && type != 0xC8 && type != 0xCC;
+            if (frame) {
+                const unsigned char *header = view.get(data, 5);
+                if (header != nullptr) {
+                    record.height = read_be16(header + 1);
+                    record.width = read_be16(header + 3);
+                }
+                break;
+            }
+
+            if (type == 0xE1 && !exif_read && data_length > exif_signature.size() &&
+                view.get_string(data, exif_signature.size()) == exif_signature)
+            {
+                ExifReader exif(view, data + exif_signature.size(), data_length - exif_signature.size());
+                exif.read(record, headers, false);
+                exif_read = true;
+            }
+            else if (type == 0xE1 && headers.xmp.empty() && data_length > xmp_signature.size() &&
+                     view.get_string(data, xmp_signature.size()) == xmp_signature)
+            {
+                headers.xmp = view.get_string(data + xmp_signature.size(), data_length - xmp_signature.size());
+            }
+            else if (type == 0xED && headers.iptc.empty() && data_length > photoshop_signature.size() &&
+                     view.get_string(data, photoshop_signature.size()) == photoshop_signature)
+            {
+                headers.iptc = get_photoshop_iptc(view.get_string(data + photoshop_signature.size(),
+                                                                  data_length - photoshop_signature.size()));
+            }
+
+            offset = data + data_length;
+        }
+    }
+
+    void read_png(FileView &view, MetadataTable::Record &record, Headers &headers) {
+        // the chunks with metadata come before the image data
+        uint64_t offset = 8;
+        for (size_t idx = 0; idx < max_chunks; idx++) {
+            const unsigned char *header = view.get(offset, 8);
+            if (header == nullptr) { break; }
+
+            uint32_t length = read_be32(header);
+            std::string type((const char *)header + 4, 4);
+            uint64_t data = offset + 8;
+            if (type == "IDAT" || type == "IEND") { break; }
+
+            if (type == "IHDR") {
+                const unsigned char *dimensions = view.get(data, 8);
+                if (dimensions != nullptr) {
+                    record.width = read_be32(dimensions);
+                    record.height = read_be32(dimensions + 4);
+                }
+            }
+            else if (type == "eXIf") {
+                ExifReader exif(view, data, length);
+                exif.read(record, headers, false);
+            }
+            else if (type == "iTXt" && headers.xmp.empty() && length > xmp_keyword.size() + 2 &&
+                     view.get_string(data, xmp_keyword.size()) == xmp_keyword)
+            {
+                // only uncompressed text, after the language and the translated keyword
+                std::string text = view.get_string(data + xmp_keyword.size(), length - xmp_keyword.size());
+                if (text.size() > 2 && text[0] == 0) {
+                    size_t language_end = text.find('\0', 2);
+                    size_t keyword_end = language_end == std::string::npos ? language_end : text.find('\0', language_end + 1);
+                    if (keyword_end != std::string::npos) {
+                        headers.xmp = text.substr(keyword_end + 1);
+                    }
+                }
+            }
+
+            offset = data + (uint64_t)length + 4;
+        }
+    }
+
+    void read_webp(FileView &view, MetadataTable::Record &record, Headers &headers) {
+        uint64_t offset = 12;
+        for (size_t idx = 0; idx < max_chunks; idx++) {
+            const unsigned char *header = view.get(offset, 8);
+            if (header == nullptr) { break; }
+
+            std::string type((const char *)header, 4);
+            uint32_t length = read_le32(header + 4);
+            uint64_t data = offset + 8;
+
+            if (type == "VP8X") {
+                const unsigned char *canvas = view.get(data + 4, 6);
+                if (canvas != nullptr) {
+                    record.width = read_le24(canvas) + 1;
+                    record.height = read_le24(canvas + 3) + 1;
+                }
+            }
+            else if (type == "VP8 " && record.width == 0) {
+                const unsigned char *frame = view.get(data, 10);
+                if (frame != nullptr && frame[3] == 0x9D && frame[4] == 0x01 && frame[5] == 0x2A) {
+                    record.width = read_le16(frame + 6) & 0x3FFF;
+                    record.height = read_le16(frame + 8) & 0x3FFF;
+                }
+            }
+            else if (type == "VP8L" && record.width == 0) {
+                const unsigned char *frame = view.get(data, 5);
+                if (frame != nullptr && frame[0] == 0x2F) {
+                    uint32_t bits = read_le32(frame + 1);
+                    record.width = (bits & 0x3FFF) + 1;
+                    record.height = ((bits >> 14) & 0x3FFF) + 1;
+                }
+            }
+            else if (type == "EXIF") {
+                // some writers keep the signature of JPEG files
+                uint64_t skip = view.get_string(data, exif_signature.size()) == exif_signature ? exif_signature.size() : 0;
+                if (length > skip) {
+                    ExifReader exif(view, data + skip, length - skip);
+                    exif.read(record, headers, false);
+                }
+            }
+            else if (type == "XMP ") {
+                headers.xmp = view.get_string(data, length);
+            }
+
+            // chunks are padded to an even length
+            offset = data + length + (length & 1);
+        }
+    }
+
+    // reads the headers of a file of any supported format
+    bool read_headers(const std::string &file_path, MetadataTable::Record &record, Headers &headers) {
+        int fd = open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1) { return false; }
+
+        // only the headers are read, the kernel should not read ahead
+        posix_fadvise(fd, 0, 0, POSIX_FADV_RANDOM);
+
+        FileView view(fd);
+        const unsigned char *magic = view.get(0, 12);
+        if (magic != nullptr) {
+            if (magic[0] == 0xFF && magic[1] == 0xD8) {
+                read_jpeg(view, record, headers);
+            }
+            else if (std::memcmp(magic, "\x89PNG\r\n\x1a\n", 8) == 0) {
+                read_png(view, record, headers);
+            }
+            else if (std::memcmp(magic, "RIFF", 4) == 0 && std::memcmp(magic + 8, "WEBP", 4) == 0) {
+                read_webp(view, record, headers);
+            }
+            else if (std::memcmp(magic, "GIF8", 4) == 0) {
+                record.width = read_le16(magic + 6);
+                record.height = read_le16(magic + 8);
+            }
+            else if (std::memcmp(magic, "II*\0", 4) == 0 || std::memcmp(magic, "MM\0*", 4) == 0) {
+                ExifReader tiff(view, 0, view.size());
+                tiff.read(record, headers, true);
+            }
+        }
+
+        close(fd);
+        return true;
+    }
+}
+
+bool MetadataReader::read_file(const std::string &file_path, MetadataTable::Record &record) {
+    record = MetadataTable::Record();
+
+    Headers headers;
+    if (!read_headers(file_path, record, headers)) { return false; }
+
+    read_xmp(headers.xmp, record);
+    return true;
+}
+
+bool MetadataReader::read_keywords(const std::string &file_path, std::vector<Glib::ustring> &keywords) {
+    MetadataTable::Record record;
+    Headers headers;
+    if (!read_headers(file_path, record, headers)) { return false; }
+
+    // the sidecar is usually newer than the file, its keywords come first
+    std::vector<Glib::ustring> found;
+    std::vector<Glib::ustring> sidecar_keywords;
+    if (XmpSidecar::read_keywords(file_path, sidecar_keywords)) {
+        found.insert(found.end(), sidecar_keywords.begin(), sidecar_keywords.end());
+    }
+    for (const Glib::ustring &keyword : XmpSidecar::parse_keywords(headers.xmp)) {
+        found.push_back(keyword);
+    }
+    for (const Glib::ustring &keyword : get_iptc_keywords(headers.iptc)) {
+        found.push_back(keyword);
+    }
+
+    // keywords become tags, which are separated by commas in the file
+    keywords.clear();
+    std::set<std::string> seen;
+    for (const Glib::ustring &keyword : found) {
+        std::string tag = strip(keyword.raw());
+        if (tag.empty() || tag.find(',') != std::string::npos) { continue; }
+
+        if (seen.insert(tag).second) {
+            keywords.push_back(tag);
+        }
+    }
+
+    return true;
+}
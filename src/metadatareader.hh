@@ -0,0 +1,27 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <vector>
+
+// project
+#include "metadatatable.hh"
+
+// Reads the capture time, camera, dimensions and GPS position of an image
+// from the headers of its file without decoding any pixels. Only the bytes
+// of the headers are read, which for most files is the first block. JPEG,
+// PNG, WebP, GIF and TIFF files are understood. EXIF is read first, XMP
+// fills in the fields that EXIF does not have. The keywords other programs
+// tagged the image with are read from XMP and IPTC the same way.
+class MetadataReader {
+    public:
+        // returns false if the file cannot be opened, a file in an unknown
+        // format or without metadata gives a record with unknown fields
+        // the function is thread safe
+        static bool read_file(const std::string &file_path, MetadataTable::Record &record);
+
+        // the keywords of the file and of its XmpSidecar, without
+        // duplicates and without those that cannot be tags
+        // returns false if the file cannot be opened
+        static bool read_keywords(const std::string &file_path, std::vector<Glib::ustring> &keywords);
+};
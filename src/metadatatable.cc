@@ -0,0 +1,386 @@
+// standard library
+#include <cmath>
+#include <cstdio>
+
+// glib
+#include <glib.h>
+
+// project
+#include "metadatatable.hh"
+#include "tagdictionary.hh"
+
+namespace {
+    const double infinity = std::numeric_limits<double>::infinity();
+
+    // days since 1970-01-01 of a date in the proleptic Gregorian calendar
+    int64_t days_from_civil(int64_t year, int64_t month, int64_t day) {
+        year -= month <= 2 ? 1 : 0;
+        int64_t era = (year >= 0 ? year : year - 399) / 400;
+        int64_t year_of_era = year - era * 400;
+        int64_t day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+        int64_t day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+        return era * 146097 + day_of_era - 719468;
+    }
+
+    void civil_from_days(int64_t days, int64_t &year, int64_t &month, int64_t &day) {
+        days += 719468;
+        int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        int64_t day_of_era = days - era * 146097;
+        int64_t year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+        int64_t day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+        int64_t month_index = (5 * day_of_year + 2) / 153;
+        day = day_of_year - (153 * month_index + 2) / 5 + 1;
+        month = month_index < 10 ? month_index + 3 : month_index - 9;
+        year = year_of_era + era * 400 + (month <= 2 ? 1 : 0);
+    }
+
+    int days_in_month(int64_t year, int64_t month) {
+        static const int days[] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+        bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+        return month == 2 && leap ? 29 : days[month - 1];
+    }
+
+    bool parse_digits(std::string_view str, size_t pos, size_t count, int64_t &value) {
+        if (pos + count > str.size()) { return false; }
+
+        value = 0;
+        for (size_t idx = pos; idx < pos + count; idx++) {
+            if (str[idx] < '0' || str[idx] > '9') { return false; }
+            value = value * 10 + (str[idx] - '0');
+        }
+        return true;
+    }
+
+    // numbers are written and read the same way in every locale
+    bool parse_number(std::string_view str, double &value) {
+        if (str.empty()) { return false; }
+
+        std::string text(str);
+        char *end = nullptr;
+        value = g_ascii_strtod(text.c_str(), &end);
+        return end == text.c_str() + text.size() && std::isfinite(value);
+    }
+
+    std::string format_number(double value) {
+        char buffer[G_ASCII_DTOSTR_BUF_SIZE];
+        return g_ascii_formatd(buffer, sizeof(buffer), "%.7f", value);
+    }
+
+    std::string_view next_field(std::string_view &str) {
+        size_t space = str.find(' ');
+        std::string_view field = str.substr(0, space);
+        str = space == std::string_view::npos ? std::string_view() : str.substr(space + 1);
+        return field;
+    }
+}
+
+// MetadataTable::Record implementation
+MetadataTable::Record::Record()
+:
+    capture_time(MetadataTable::unknown_time),
+    width(0),
+    height(0),
+    latitude(std::numeric_limits<double>::quiet_NaN()),
+    longitude(std::numeric_limits<double>::quiet_NaN())
+{}
+
+bool MetadataTable::Record::has_capture_time() const {
+    return capture_time != MetadataTable::unknown_time;
+}
+
+bool MetadataTable::Record::has_location() const {
+    return !std::isnan(latitude) && !std::isnan(longitude);
+}
+
+std::string MetadataTable::Record::to_string() const {
+    std::string result = has_capture_time() ? MetadataTable::format_time(capture_time) : "-";
+    result += ' ';
+    result += width != 0 ? std::to_string(width) : "-";
+    result += ' ';
+    result += height != 0 ? std::to_string(height) : "-";
+    result += ' ';
+    result += has_location() ? format_number(latitude) : "-";
+    result += ' ';
+    result += has_location() ? format_number(longitude) : "-";
+
+    if (!camera.empty()) {
+        result += ' ';
+        result += camera.raw();
+    }
+
+    return result;
+}
+
+bool MetadataTable::Record::from_string(std::string_view str, MetadataTable::Record &record) {
+    record = Record();
+
+    std::string_view time = next_field(str);
+    if (time != "-") {
+        int64_t end;
+        if (!MetadataTable::parse_time(time, record.capture_time, end)) { return false; }
+    }
+
+    std::string_view sizes[2] = { next_field(str), next_field(str) };
+    uint32_t *dimensions[2] = { &record.width, &record.height };
+    for (size_t idx = 0; idx < 2; idx++) {
+        if (sizes[idx] == "-") { continue; }
+
+        double value;
+        if (!parse_number(sizes[idx], value) || value < 1 || value > UINT32_MAX) { return false; }
+        *dimensions[idx] = value;
+    }
+
+    std::string_view latitude = next_field(str);
+    std::string_view longitude = next_field(str);
+    if (latitude != "-" || longitude != "-") {
+        if (!parse_number(latitude, record.latitude) || !parse_number(longitude, record.longitude)) {
+            return false;
+        }
+    }
+
+    // the camera is the rest of the line
+    record.camera = Glib::ustring(str.data(), str.data() + str.size());
+    return true;
+}
+
+// MetadataTable::Predicate implementation
+bool MetadataTable::Predicate::parse(std::string_view text, MetadataTable::Predicate &predicate) {
+    static const std::pair<std::string_view, Field> fields[] = {
+        { "taken", Field::TAKEN }, { "width", Field::WIDTH }, { "height", Field::HEIGHT },
+        { "lat", Field::LATITUDE }, { "lon", Field::LONGITUDE }, { "camera", Field::CAMERA }
+    };
+
+    size_t pos = std::string_view::npos;
+    for (const auto &field : fields) {
+        if (text.compare(0, field.first.size(), field.first) == 0) {
+            predicate.field = field.second;
+            pos = field.first.size();
+            break;
+        }
+    }
+    if (pos == std::string_view::npos || pos >= text.size()) { return false; }
+
+    // the longer operators first
+    std::string_view operation;
+    for (std::string_view candidate : { ">=", "<=", ">", "<", "=" }) {
+        if (text.compare(pos, candidate.size(), candidate) == 0) {
+            operation = candidate;
+            break;
+        }
+    }
+    if (operation.empty()) { return false; }
+
+    std::string_view value = text.substr(pos + operation.size());
+    if (value.empty()) { return false; }
+
+    predicate.min = -infinity;
+    predicate.max = infinity;
+    predicate.camera.clear();
+
+    if (predicate.field == Field::CAMERA) {
+        if (operation != "=") { return false; }
+        predicate.camera = Glib::ustring(value.data(), value.data() + value.size()).casefold().raw();
+        return true;
+    }
+
+    // the first and the last value that match, a number is a period of its own
+    double begin;
+    double end;
+    if (predicate.field == Field::TAKEN) {
+        int64_t begin_time;
+        int64_t end_time;
+        if (!parse_time(value, begin_time, end_time)) { return false; }
+        begin = begin_time;
+        end = end_time;
+    }
+    else {
+        if (!parse_number(value, begin)) { return false; }
+        end = std::nextafter(begin, infinity);
+    }
+
+    if (operation == ">=") { predicate.min = begin; }
+    else if (operation == ">") { predicate.min = end; }
+    else if (operation == "<") { predicate.max = begin; }
+    else if (operation == "<=") { predicate.max = end; }
+    else {
+        predicate.min = begin;
+        predicate.max = end;
+    }
+
+    return true;
+}
+
+bool MetadataTable::Predicate::operator==(const MetadataTable::Predicate &other) const {
+    return field == other.field && min == other.min && max == other.max && camera == other.camera;
+}
+
+// MetadataTable implementation
+size_t MetadataTable::add(const MetadataTable::Record &record) {
+    capture_times.push_back(unknown_time);
+    widths.push_back(0);
+    heights.push_back(0);
+    latitudes.push_back(0);
+    longitudes.push_back(0);
+    cameras.push_back(nullptr);
+    folded_cameras.push_back(nullptr);
+
+    set(size() - 1, record);
+    return size() - 1;
+}
+
+void MetadataTable::set(size_t row, const MetadataTable::Record &record) {
+    capture_times.at(row) = record.capture_time;
+    widths.at(row) = record.width;
+    heights.at(row) = record.height;
+    latitudes.at(row) = record.latitude;
+    longitudes.at(row) = record.longitude;
+
+    // the few distinct cameras are stored once, and interned
+    // strings stay valid in copies of the table on other threads
+    cameras.at(row) = nullptr;
+    folded_cameras.at(row) = nullptr;
+    if (!record.camera.empty()) {
+        cameras.at(row) = TagDictionary::intern(record.camera.raw());
+        folded_cameras.at(row) = TagDictionary::intern(record.camera.casefold().raw());
+    }
+}
+
+MetadataTable::Record MetadataTable::get(size_t row) const {
+    Record result;
+    result.capture_time = capture_times.at(row);
+    result.width = widths.at(row);
+    result.height = heights.at(row);
+    result.latitude = latitudes.at(row);
+    result.longitude = longitudes.at(row);
+    if (cameras.at(row) != nullptr) {
+        result.camera = *cameras.at(row);
+    }
+
+    return result;
+}
+
+size_t MetadataTable::append(const MetadataTable &other) {
+    size_t first_row = size();
+
+    capture_times.insert(capture_times.end(), other.capture_times.begin(), other.capture_times.end());
+    widths.insert(widths.end(), other.widths.begin(), other.widths.end());
+    heights.insert(heights.end(), other.heights.begin(), other.heights.end());
+    latitudes.insert(latitudes.end(), other.latitudes.begin(), other.latitudes.end());
+    longitudes.insert(longitudes.end(), other.longitudes.begin(), other.longitudes.end());
+    cameras.insert(cameras.end(), other.cameras.begin(), other.cameras.end());
+    folded_cameras.insert(folded_cameras.end(), other.folded_cameras.begin(), other.folded_cameras.end());
+
+    return first_row;
+}
+
+size_t MetadataTable::size() const {
+    return capture_times.size();
+}
+
+void MetadataTable::clear() {
+    capture_times.clear();
+    widths.clear();
+    heights.clear();
+    latitudes.clear();
+    longitudes.clear();
+    cameras.clear();
+    folded_cameras.clear();
+}
+
+bool MetadataTable::matches_all(size_t row, const std::vector<MetadataTable::Predicate> &predicates) const {
+    for (const Predicate &predicate : predicates) {
+        if (!matches(row, predicate)) { return false; }
+    }
+    return true;
+}
+
+bool MetadataTable::matches_any(size_t row, const std::vector<MetadataTable::Predicate> &predicates) const {
+    for (const Predicate &predicate : predicates) {
+        if (matches(row, predicate)) { return true; }
+    }
+    return false;
+}
+
+std::string MetadataTable::format_time(int64_t time) {
+    int64_t days = time / 86400;
+    int64_t seconds = time % 86400;
+    if (seconds < 0) {
+        days -= 1;
+        seconds += 86400;
+    }
+
+    int64_t year, month, day;
+    civil_from_days(days, year, month, day);
+
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d",
+                  (int)year, (int)month, (int)day,
+                  (int)(seconds / 3600), (int)(seconds / 60 % 60), (int)(seconds % 60));
+    return buffer;
+}
+
+bool MetadataTable::parse_time(std::string_view str, int64_t &begin, int64_t &end) {
+    // year, month, day, hour, minute and second
+    int64_t fields[6] = { 0, 1, 1, 0, 0, 0 };
+    if (!parse_digits(str, 0, 4, fields[0])) { return false; }
+
+    size_t count = 1;
+    size_t pos = 4;
+    while (pos < str.size() && count < 6) {
+        char separator = str[pos];
+        bool valid = count < 3 ? (separator == '-' || separator == ':') :
+                     count == 3 ? (separator == 'T' || separator == ' ') :
+                     separator == ':';
+        if (!valid || !parse_digits(str, pos + 1, 2, fields[count])) { return false; }
+
+        pos += 3;
+        count += 1;
+    }
+    if (pos != str.size()) { return false; }
+
+    if (fields[1] < 1 || fields[1] > 12 ||
+        fields[2] < 1 || fields[2] > days_in_month(fields[0], fields[1]) ||
+        fields[3] > 23 || fields[4] > 59 || fields[5] > 60)
+    {
+        return false;
+    }
+
+    int64_t days = days_from_civil(fields[0], fields[1], fields[2]);
+    begin = days * 86400 + fields[3] * 3600 + fields[4] * 60 + fields[5];
+
+    switch (count) {
+        case 1: end = days_from_civil(fields[0] + 1, 1, 1) * 86400; break;
+        case 2: end = (fields[1] == 12 ? days_from_civil(fields[0] + 1, 1, 1)
+                                       : days_from_civil(fields[0], fields[1] + 1, 1)) * 86400; break;
+        case 3: end = begin + 86400; break;
+        case 4: end = begin + 3600; break;
+        case 5: end = begin + 60; break;
+        default: end = begin + 1; break;
+    }
+
+    return true;
+}
+
+bool MetadataTable::matches(size_t row, const MetadataTable::Predicate &predicate) const {
+    if (row == npos) { return false; }
+
+    // comparisons with NaN are false, so unknown locations never match
+    switch (predicate.field) {
+        case Predicate::Field::TAKEN:
+            if (capture_times[row] == unknown_time) { return false; }
+            return capture_times[row] >= predicate.min && capture_times[row] < predicate.max;
+        case Predicate::Field::WIDTH:
+            return widths[row] != 0 && widths[row] >= predicate.min && widths[row] < predicate.max;
+        case Predicate::Field::HEIGHT:
+            return heights[row] != 0 && heights[row] >= predicate.min && heights[row] < predicate.max;
+        case Predicate::Field::LATITUDE:
+            return latitudes[row] >= predicate.min && latitudes[row] < predicate.max;
+        case Predicate::Field::LONGITUDE:
+            return longitudes[row] >= predicate.min && longitudes[row] < predicate.max;
+        case Predicate::Field::CAMERA:
+            return folded_cameras[row] != nullptr &&
+                   folded_cameras[row]->raw().find(predicate.camera) != std::string::npos;
+    }
+
+    return false;
+}
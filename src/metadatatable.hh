@@ -0,0 +1,112 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <string_view>
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+// gtkmm
+#include <glibmm/ustring.h>
+
+// The metadata of image files, such as the time a picture was taken, kept
+// in one array per field next to the items of a TagDb. Items refer to their
+// row, so a range predicate on a field reads a single array of numbers
+// instead of a record per item.
+class MetadataTable {
+    // the fields of a single file, unknown fields keep their defaults
+    public: class Record {
+        public:
+            Record();
+
+            // seconds since 1970 of the time the picture was taken, as the
+            // camera recorded it, without a time zone
+            int64_t capture_time;
+
+            // pixels, zero if unknown
+            uint32_t width;
+            uint32_t height;
+
+            // degrees, north and east are positive, NaN if unknown
+            double latitude;
+            double longitude;
+
+            // make and model of the camera, empty if unknown
+            Glib::ustring camera;
+
+            bool has_capture_time() const;
+            bool has_location() const;
+
+            // the form of the [meta] line in the database file, the time, width,
+            // height, latitude and longitude separated by spaces with a dash for
+            // unknown fields, followed by the camera which may contain spaces
+            std::string to_string() const;
+            static bool from_string(std::string_view str, Record &record);
+    };
+
+    // a condition on a field, written like a tag such as width>=1920,
+    // taken<2021-06 or camera=canon, times may leave out their end
+    // and a partial time stands for the whole period it names
+    public: class Predicate {
+        public:
+            enum class Field { TAKEN, WIDTH, HEIGHT, LATITUDE, LONGITUDE, CAMERA };
+
+            Field field;
+
+            // numbers from min up to but not including max match
+            double min;
+            double max;
+
+            // casefolded text the camera contains
+            std::string camera;
+
+            // returns false if the text is not a predicate
+            static bool parse(std::string_view text, Predicate &predicate);
+
+            bool operator==(const Predicate &other) const;
+    };
+
+    public:
+        static constexpr size_t npos = std::numeric_limits<size_t>::max();
+        static constexpr int64_t unknown_time = std::numeric_limits<int64_t>::min();
+
+        // returns the row of the record
+        size_t add(const Record &record);
+        void set(size_t row, const Record &record);
+        Record get(size_t row) const;
+
+        // adds the rows of another table, returns the row of its first one
+        size_t append(const MetadataTable &other);
+        size_t size() const;
+        void clear();
+
+        // whether the row matches all or any of the predicates
+        // a row of npos or an unknown field matches no predicate
+        bool matches_all(size_t row, const std::vector<Predicate> &predicates) const;
+        bool matches_any(size_t row, const std::vector<Predicate> &predicates) const;
+
+        // times are written like 2021-05-03T10:22:01
+        static std::string format_time(int64_t time);
+
+        // parses a time like 2021, 2021-05, 2021-05-03, 2021-05-03T10:22 or
+        // 2021-05-03T10:22:01 into the period it names, colons may separate the
+        // date and a space the time like in EXIF, returns false if it is not a time
+        static bool parse_time(std::string_view str, int64_t &begin, int64_t &end);
+
+    private:
+        // columns
+        std::vector<int64_t> capture_times;
+        std::vector<uint32_t> widths;
+        std::vector<uint32_t> heights;
+        std::vector<double> latitudes;
+        std::vector<double> longitudes;
+
+        // interned strings, see TagDictionary, or nullptr if unknown
+        std::vector<const Glib::ustring *> cameras;
+        std::vector<const Glib::ustring *> folded_cameras;
+
+        // functions
+        bool matches(size_t row, const Predicate &predicate) const;
+};
@@ -13,11 +13,21 @@
 // project
 #include "glibmm/main.h"
 #include "previewgallery.hh"
+#include "imagehash.hh"
+#include "fsscanner.hh"
+#include "videothumbnailer.hh"
+
+namespace {
+    // decoding videos mostly waits on the disk and GStreamer's own threads
+    const size_t thumbnail_threads = 2;
+}
 
 // PreviewGallery implementation
 PreviewGallery::PreviewGallery(PreviewSize size)
 :
-    size(size)
+    size(size),
+    content_generation(0),
+    thumbnail_pool(thumbnail_threads)
 {
     // configure label for when the gallery is empty
     no_items_label.set_markup("<span weight=\"bold\" size=\"xx-large\">No Items</span>");
@@ -63,12 +73,22 @@ PreviewGallery::PreviewGallery(PreviewSize size)
     set_propagate_natural_width(true);
     set_propagate_natural_height(true);
     set_expand(true);
+
+    thumbnail_dispatcher.connect(sigc::mem_fun(*this, &PreviewGallery::on_thumbnails_finished));
+}
+
+PreviewGallery::~PreviewGallery() {
+    // queued videos are skipped, the pool only waits for running ones
+    content_generation += 1;
 }
 
 void PreviewGallery::set_content(const std::vector<Glib::ustring> &file_paths) {
     // clear ListStore
     store->clear();
 
+    // videos that were queued for the previous content are not decoded
+    content_generation += 1;
+
     // if content is empty, show the no items label
     if (file_paths.size() == 0) {
         if (!icon_view_is_not_child) {
@@ -101,6 +121,12 @@ void PreviewGallery::set_content(const std::vector<Glib::ustring> &file_paths) {
 
     private_generation_status_changed.emit(false);
 
+    if (shown_hashes.size() > 0) {
+        std::vector<std::pair<Glib::ustring, uint64_t>> hashes;
+        hashes.swap(shown_hashes);
+        private_previews_hashed.emit(hashes);
+    }
+
     // now that contents are available
     // the iconview can be set as child
     if (icon_view_is_not_child) {
@@ -124,10 +150,14 @@ Glib::ustring PreviewGallery::get_file_path(const Gtk::TreePath &tpath) const {
 
 void PreviewGallery::clear_cache() {
     preview_cache.clear();
+    hash_cache.clear();
+    failed_previews.clear();
 }
 
 void PreviewGallery::remove_from_cache(const Glib::ustring &item) {
     preview_cache.erase(item);
+    hash_cache.erase(item);
+    failed_previews.erase(item);
 }
 
 void PreviewGallery::grab_focus() {
@@ -158,6 +188,14 @@ sigc::signal<void (bool)> PreviewGallery::signal_generation_status_changed() {
     return private_generation_status_changed;
 }
 
+sigc::signal<void (const Glib::ustring &)> PreviewGallery::signal_find_similar() {
+    return private_find_similar;
+}
+
+sigc::signal<void (const std::vector<std::pair<Glib::ustring, uint64_t>> &)> PreviewGallery::signal_previews_hashed() {
+    return private_previews_hashed;
+}
+
 bool PreviewGallery::add_item(size_t id, const Glib::ustring &file_path) {
     // get pixbuf from file path
     Glib::RefPtr<Gdk::Pixbuf> pbuf;
@@ -168,27 +206,29 @@ bool PreviewGallery::add_item(size_t id, const Glib::ustring &file_path) {
     if (iter != preview_cache.end()) {
         pbuf = iter->second;
     }
+    else if (failed_previews.count(file_path) > 0) {
+        return false;
+    }
+    else if (FsScanner::is_video_name(file_path.raw())) {
+        // videos are previewed by a single decoded frame, which
+        // can take seconds, the row gets its preview once it arrives
+        request_thumbnail(file_path);
+    }
     else {
         try {
-            pbuf = Gdk::Pixbuf::create_from_file(file_path);
-
-            // calculate scale proportion based on the longer dimension
-            int image_size = pbuf->get_width() > pbuf->get_height() ? pbuf->get_width() : pbuf->get_height();
-            double prop = (double)((int)size) / (double)image_size;
-
-            // scale image by proportion
-            pbuf = pbuf->scale_simple(
-                    std::round(pbuf->get_width() * prop),
-                    std::round(pbuf->get_height() * prop),
-                    Gdk::InterpType::BILINEAR);
-
-            preview_cache.insert(std::make_pair(file_path, pbuf));
+            pbuf = cache_preview(file_path, Gdk::Pixbuf::create_from_file(file_path));
         }
         catch (...) {
+            failed_previews.insert(file_path);
             return false;
         }
     }
 
+    auto hash = hash_cache.find(file_path);
+    if (hash != hash_cache.end()) {
+        shown_hashes.push_back(*hash);
+    }
+
     // add image to store
     auto row = *(store->append());
     row[icon_model.id] = id;
@@ -199,6 +239,103 @@ bool PreviewGallery::add_item(size_t id, const Glib::ustring &file_path) {
     return true;
 }
 
+Glib::RefPtr<Gdk::Pixbuf> PreviewGallery::cache_preview(const Glib::ustring &file_path,
+                                                        const Glib::RefPtr<Gdk::Pixbuf> &image)
+{
+    // calculate scale proportion based on the longer dimension
+    int image_size = image->get_width() > image->get_height() ? image->get_width() : image->get_height();
+    double prop = (double)((int)size) / (double)image_size;
+
+    // scale image by proportion
+    Glib::RefPtr<Gdk::Pixbuf> pbuf = image->scale_simple(
+            std::round(image->get_width() * prop),
+            std::round(image->get_height() * prop),
+            Gdk::InterpType::BILINEAR);
+
+    preview_cache.insert(std::make_pair(file_path, pbuf));
+
+    // the preview is already decoded and small, hashing it is cheap
+    hash_cache.insert(std::make_pair(file_path, ImageHash::dhash(pbuf)));
+
+    return pbuf;
+}
+
+void PreviewGallery::request_thumbnail(const Glib::ustring &file_path) {
+    // a video shown again before its frame arrived is not queued twice
+    if (!pending_thumbnails.insert(file_path).second) { return; }
+
+    size_t generation = content_generation;
+    thumbnail_pool.submit([this, file_path, generation](){ create_thumbnail(file_path, generation); });
+}
+
+void PreviewGallery::create_thumbnail(const Glib::ustring &file_path, size_t generation) {
+    Thumbnail thumbnail{file_path, Glib::RefPtr<Gdk::Pixbuf>(), false};
+
+    if (generation == content_generation) {
+        thumbnail.attempted = true;
+        try {
+            thumbnail.pixbuf = VideoThumbnailer::create_thumbnail(file_path);
+        }
+        catch (...) {}
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(thumbnail_mutex);
+        finished_thumbnails.push_back(thumbnail);
+    }
+    thumbnail_dispatcher.emit();
+}
+
+void PreviewGallery::on_thumbnails_finished() {
+    std::vector<Thumbnail> thumbnails;
+    {
+        std::lock_guard<std::mutex> lock(thumbnail_mutex);
+        thumbnails.swap(finished_thumbnails);
+    }
+
+    std::vector<std::pair<Glib::ustring, uint64_t>> hashes;
+    for (const Thumbnail &thumbnail : thumbnails) {
+        pending_thumbnails.erase(thumbnail.file_path);
+
+        // a skipped video may have been shown again while it waited
+        if (!thumbnail.attempted) {
+            for (const Gtk::TreeRow &row : store->children()) {
+                if (row.get_value(icon_model.file_path) == thumbnail.file_path) {
+                    request_thumbnail(thumbnail.file_path);
+                    break;
+                }
+            }
+            continue;
+        }
+
+        // scaling and hashing happen here, like for images
+        Glib::RefPtr<Gdk::Pixbuf> pbuf;
+        if (thumbnail.pixbuf) {
+            pbuf = cache_preview(thumbnail.file_path, thumbnail.pixbuf);
+            hashes.push_back(std::make_pair(thumbnail.file_path, hash_cache.at(thumbnail.file_path)));
+        }
+        else {
+            failed_previews.insert(thumbnail.file_path);
+        }
+
+        for (const Gtk::TreeRow &row : store->children()) {
+            if (row.get_value(icon_model.file_path) != thumbnail.file_path) { continue; }
+
+            if (pbuf) {
+                row.set_value(icon_model.pixbuf, pbuf);
+            }
+            else {
+                private_signal_failed_to_open.emit(row.get_value(icon_model.id));
+                break;
+            }
+        }
+    }
+
+    if (hashes.size() > 0) {
+        private_previews_hashed.emit(hashes);
+    }
+}
+
 void PreviewGallery::on_item_activate(const Gtk::TreePath &tpath) {
     Gtk::TreeRow row = (*(store->get_iter(tpath)));
     private_signal_item_chosen.emit(row[icon_model.id]);
@@ -246,6 +383,11 @@ void PreviewGallery::on_edit_clicked() {
     private_edit.emit(right_click_menu->get_file_path());
 }
 
+void PreviewGallery::on_find_similar_clicked() {
+    right_click_menu->hide();
+    private_find_similar.emit(right_click_menu->get_file_path());
+}
+
 // RightClickMenu implementation
 PreviewGallery::RightClickMenu::RightClickMenu(PreviewGallery &parent) {
     // wdiget setup
@@ -254,11 +396,17 @@ PreviewGallery::RightClickMenu::RightClickMenu(PreviewGallery &parent) {
     btn_edit_item.signal_clicked().connect(
             sigc::mem_fun(parent, &PreviewGallery::on_edit_clicked));
 
+    btn_find_similar.set_label("Find Similar");
+    btn_find_similar.set_has_frame(false);
+    btn_find_similar.signal_clicked().connect(
+            sigc::mem_fun(parent, &PreviewGallery::on_find_similar_clicked));
+
     // box setup
     box.set_orientation(Gtk::Orientation::VERTICAL);
     box.set_margin(10);
     box.set_spacing(15);
     box.append(btn_edit_item);
+    box.append(btn_find_similar);
 
     set_child(box);
     set_parent(parent);
@@ -3,6 +3,12 @@
 // standard library
 #include <memory>
 #include <map>
+#include <set>
+#include <vector>
+#include <utility>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
 
 // gtkmm
 #include <gtkmm/liststore.h>
@@ -17,9 +23,11 @@
 #include <gtkmm/box.h>
 #include <gtkmm/button.h>
 #include <gtkmm/progressbar.h>
+#include <glibmm/dispatcher.h>
 
 // project
 #include "tagdb.hh"
+#include "workerpool.hh"
 
 class PreviewGallery : public Gtk::ScrolledWindow {
     // the data associated with each icon
@@ -43,8 +51,9 @@ class PreviewGallery : public Gtk::ScrolledWindow {
     public: enum class PreviewSize { Small=64, Medium=128, Large=256 };
 
     public:
-        // ctor
+        // ctor and dtor
         PreviewGallery(PreviewSize size = PreviewSize::Medium);
+        ~PreviewGallery() override;
 
         // functions
         void set_content(const std::vector<Glib::ustring> &items);
@@ -62,6 +71,11 @@ class PreviewGallery : public Gtk::ScrolledWindow {
         sigc::signal<void (size_t)> signal_failed_to_open();
         sigc::signal<void (const Glib::ustring &)> signal_edit();
         sigc::signal<void (bool)> signal_generation_status_changed();
+        sigc::signal<void (const Glib::ustring &)> signal_find_similar();
+
+        // perceptual hashes of the items shown by set_content, see ImageHash
+        // emitted once per call with the file paths and their hashes
+        sigc::signal<void (const std::vector<std::pair<Glib::ustring, uint64_t>> &)> signal_previews_hashed();
 
     private: class RightClickMenu : public Gtk::Popover {
                  public:
@@ -79,11 +93,24 @@ class PreviewGallery : public Gtk::ScrolledWindow {
                      // widgets
                      Gtk::Box box;
                      Gtk::Button btn_edit_item;
+                     Gtk::Button btn_find_similar;
 
                      // members
                      Glib::ustring file_path;
              };
 
+    // a frame of a video decoded on a worker thread
+    private: class Thumbnail {
+        public:
+            Glib::ustring file_path;
+
+            // empty if the video could not be decoded
+            Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+
+            // false if the gallery moved on before the job started
+            bool attempted;
+    };
+
     private:
         // widgets
         Gtk::IconView icon_view;
@@ -99,9 +126,27 @@ class PreviewGallery : public Gtk::ScrolledWindow {
         PreviewSize size;
         IconModel icon_model;
         std::map<Glib::ustring, Glib::RefPtr<Gdk::Pixbuf>> preview_cache;
+        std::map<Glib::ustring, uint64_t> hash_cache;
+        std::vector<std::pair<Glib::ustring, uint64_t>> shown_hashes;
+
+        // files without a preview are not decoded again on every refresh,
+        // a broken video takes up to the timeout of VideoThumbnailer
+        std::set<Glib::ustring> failed_previews;
+
+        // videos are decoded on worker threads, their rows show no
+        // preview until the frame is handed back to the GUI thread
+        std::set<Glib::ustring> pending_thumbnails;
+        std::atomic<size_t> content_generation;
+        Glib::Dispatcher thumbnail_dispatcher;
+        std::mutex thumbnail_mutex;
+        std::vector<Thumbnail> finished_thumbnails;
 
         // functions
         bool add_item(size_t id, const Glib::ustring &file_path);
+        Glib::RefPtr<Gdk::Pixbuf> cache_preview(const Glib::ustring &file_path,
+                                                const Glib::RefPtr<Gdk::Pixbuf> &image);
+        void request_thumbnail(const Glib::ustring &file_path);
+        void create_thumbnail(const Glib::ustring &file_path, size_t generation);
 
         // signal handlers
         void on_item_activate(const Gtk::TreePath &tpath);
@@ -109,6 +154,8 @@ class PreviewGallery : public Gtk::ScrolledWindow {
         void on_right_click(int n_times, double x, double y);
         void on_fav_toggled();
         void on_edit_clicked();
+        void on_find_similar_clicked();
+        void on_thumbnails_finished();
 
         // signals
         sigc::signal<void (size_t)> private_signal_item_chosen;
@@ -116,4 +163,9 @@ class PreviewGallery : public Gtk::ScrolledWindow {
         sigc::signal<void (size_t)> private_signal_failed_to_open;
         sigc::signal<void (const Glib::ustring &)> private_edit;
         sigc::signal<void (bool)> private_generation_status_changed;
+        sigc::signal<void (const Glib::ustring &)> private_find_similar;
+        sigc::signal<void (const std::vector<std::pair<Glib::ustring, uint64_t>> &)> private_previews_hashed;
+
+        // last, so the jobs are done before the members they use are gone
+        WorkerPool thumbnail_pool;
 };
@@ -0,0 +1,130 @@
+// project
+#include "queryscheduler.hh"
+
+namespace {
+    // changes closer together than this are run as a single query
+    const unsigned int coalesce_delay_ms = 50;
+}
+
+QueryScheduler::QueryScheduler(const TagDb &db)
+:
+    db(db),
+    running(false),
+    request_pending(false),
+    cancelled(false),
+    generation(0),
+    running_generation(0)
+{
+    dispatcher.connect(sigc::mem_fun(*this, &QueryScheduler::on_dispatch));
+}
+
+QueryScheduler::~QueryScheduler() {
+    delay_timer.disconnect();
+    cancelled = true;
+    if (thread.joinable()) {
+        thread.join();
+    }
+}
+
+void QueryScheduler::schedule(const std::set<Glib::ustring> &tags_include,
+                              const std::set<Glib::ustring> &tags_exclude)
+{
+    generation += 1;
+    request_pending = true;
+    pending_include = tags_include;
+    pending_exclude = tags_exclude;
+
+    // the running query can no longer be shown
+    if (running) {
+        cancelled = true;
+    }
+
+    // every new request restarts the delay
+    delay_timer.disconnect();
+    delay_timer = Glib::signal_timeout().connect([this](){
+        start_pending();
+        return false;
+    }, coalesce_delay_ms);
+}
+
+void QueryScheduler::cancel() {
+    generation += 1;
+    request_pending = false;
+    delay_timer.disconnect();
+
+    // the thread is joined once it reports back, not here
+    if (running) {
+        cancelled = true;
+    }
+}
+
+bool QueryScheduler::is_pending() const {
+    return request_pending || (running && running_generation == generation);
+}
+
+sigc::signal<void (std::vector<Glib::ustring> &,
+                   std::shared_ptr<const TagDb::QueryCounts>,
+                   std::vector<Glib::ustring> &)> QueryScheduler::signal_finished() {
+    return private_finished;
+}
+
+void QueryScheduler::start_pending() {
+    // only one query runs at a time, a cancelled one returns quickly
+    // and the pending request starts when it reports back
+    if (running || !request_pending) { return; }
+
+    request_pending = false;
+    running = true;
+    running_generation = generation;
+    cancelled = false;
+
+    // the snapshot is shared until the database changes, so
+    // repeated queries on an unchanged database do not copy it
+    thread = std::thread(&QueryScheduler::run, this, db.get_query_snapshot(),
+                         pending_include, pending_exclude);
+}
+
+void QueryScheduler::run(std::shared_ptr<const TagDb::QuerySnapshot> snapshot,
+                         std::set<Glib::ustring> tags_include,
+                         std::set<Glib::ustring> tags_exclude)
+{
+    std::shared_ptr<TagDb::QueryCounts> counts = std::make_shared<TagDb::QueryCounts>();
+    std::vector<Glib::ustring> files = snapshot->query(tags_include, tags_exclude, &cancelled, counts.get());
+
+    // the completion of the tag picker follows the query, it
+    // is found here as well to keep both off the GUI thread
+    std::vector<Glib::ustring> suggestions = snapshot->suggestions(tags_include, &cancelled);
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.swap(files);
+        result_counts = counts;
+        result_suggestions.swap(suggestions);
+    }
+    dispatcher.emit();
+}
+
+void QueryScheduler::on_dispatch() {
+    thread.join();
+    running = false;
+
+    std::vector<Glib::ustring> files;
+    std::shared_ptr<const TagDb::QueryCounts> counts;
+    std::vector<Glib::ustring> suggestions;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        files.swap(result);
+        counts.swap(result_counts);
+        suggestions.swap(result_suggestions);
+    }
+
+    // a request that is still waiting for its delay starts when the delay is over
+    bool superseded = running_generation != generation;
+    if (superseded && request_pending && !delay_timer.connected()) {
+        start_pending();
+    }
+
+    if (!superseded) {
+        private_finished.emit(files, counts, suggestions);
+    }
+}
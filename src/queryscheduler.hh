@@ -0,0 +1,84 @@
+#pragma once
+
+// standard library
+#include <set>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// gtkmm
+#include <glibmm/dispatcher.h>
+#include <glibmm/main.h>
+#include <glibmm/ustring.h>
+#include <sigc++/signal.h>
+
+// project
+#include "tagdb.hh"
+
+// Runs the queries of the tag picker on a background thread. Requests
+// that arrive in quick succession are coalesced into one query, and a
+// query that is still running when a newer request arrives is cancelled.
+// Only the result of the newest request is delivered, on the GUI thread,
+// together with the counts of results for every tag the query could add
+// and the tags that appear together with the included ones, most common
+// first, for completing tags.
+class QueryScheduler {
+    public:
+        // the database is only read on the GUI thread, queries
+        // run on a snapshot of it taken when they start
+        QueryScheduler(const TagDb &db);
+        ~QueryScheduler();
+
+        // replaces any request that did not deliver its result yet
+        void schedule(const std::set<Glib::ustring> &tags_include,
+                      const std::set<Glib::ustring> &tags_exclude);
+
+        // drops the current request, nothing is delivered for it
+        void cancel();
+        bool is_pending() const;
+
+        // signal forwarding
+        sigc::signal<void (std::vector<Glib::ustring> &,
+                           std::shared_ptr<const TagDb::QueryCounts>,
+                           std::vector<Glib::ustring> &)> signal_finished();
+
+    private:
+        // members
+        const TagDb &db;
+        std::thread thread;
+        bool running;
+
+        // the newest request, waiting for the delay or the running query
+        bool request_pending;
+        std::set<Glib::ustring> pending_include;
+        std::set<Glib::ustring> pending_exclude;
+        sigc::connection delay_timer;
+
+        // the running query, it is superseded once the generation changes
+        std::atomic<bool> cancelled;
+        size_t generation;
+        size_t running_generation;
+
+        // the result passed from the query thread to the GUI thread
+        Glib::Dispatcher dispatcher;
+        std::mutex mutex;
+        std::vector<Glib::ustring> result;
+        std::shared_ptr<const TagDb::QueryCounts> result_counts;
+        std::vector<Glib::ustring> result_suggestions;
+
+        // functions
+        void start_pending();
+        void run(std::shared_ptr<const TagDb::QuerySnapshot> snapshot,
+                 std::set<Glib::ustring> tags_include,
+                 std::set<Glib::ustring> tags_exclude);
+
+        // signal handlers
+        void on_dispatch();
+
+        // signals
+        sigc::signal<void (std::vector<Glib::ustring> &,
+                           std::shared_ptr<const TagDb::QueryCounts>,
+                           std::vector<Glib::ustring> &)> private_finished;
+};
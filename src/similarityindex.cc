@@ -0,0 +1,138 @@
+// standard library
+#include <algorithm>
+
+// x86 intrinsics
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+
+// project
+#include "similarityindex.hh"
+
+namespace {
+    // distances are computed for a block at a time and filtered
+    // afterwards, which keeps the inner loop free of branches
+    const size_t block_size = 1024;
+
+    typedef void (*DistanceFunction)(const uint64_t *block, size_t count, uint64_t hash,
+                                     unsigned char *distances);
+
+    // without a popcount instruction every hash is a call into libgcc
+    void block_distances_generic(const uint64_t *block, size_t count, uint64_t hash,
+                                 unsigned char *distances)
+    {
+        for (size_t idx = 0; idx < count; idx++) {
+            distances[idx] = __builtin_popcountll(block[idx] ^ hash);
+        }
+    }
+
+#if defined(__x86_64__) || defined(__i386__)
+    // the same loop with the popcnt instruction, one hash at a time
+    __attribute__((target("popcnt")))
+    void block_distances_popcnt(const uint64_t *block, size_t count, uint64_t hash,
+                                unsigned char *distances)
+    {
+        for (size_t idx = 0; idx < count; idx++) {
+            distances[idx] = __builtin_popcountll(block[idx] ^ hash);
+        }
+    }
+
+    // four hashes at a time, AVX2 has no popcount so the bits of every
+    // nibble are looked up in a table and the bytes of a hash are summed
+    __attribute__((target("avx2,popcnt")))
+    void block_distances_avx2(const uint64_t *block, size_t count, uint64_t hash,
+                              unsigned char *distances)
+    {
+        const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                                0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+        const __m256i low_nibbles = _mm256_set1_epi8(0x0f);
+        const __m256i query = _mm256_set1_epi64x((long long)hash);
+
+        size_t idx = 0;
+        for (; idx + 4 <= count; idx += 4) {
+            __m256i bits = _mm256_xor_si256(_mm256_loadu_si256((const __m256i *)(block + idx)), query);
+            __m256i low = _mm256_and_si256(bits, low_nibbles);
+            __m256i high = _mm256_and_si256(_mm256_srli_epi16(bits, 4), low_nibbles);
+            __m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, low), _mm256_shuffle_epi8(lookup, high));
+
+            // the sum of absolute differences to zero adds up the bytes of every hash
+            __m256i sums = _mm256_sad_epu8(counts, _mm256_setzero_si256());
+            distances[idx] = _mm256_extract_epi8(sums, 0);
+            distances[idx + 1] = _mm256_extract_epi8(sums, 8);
+            distances[idx + 2] = _mm256_extract_epi8(sums, 16);
+            distances[idx + 3] = _mm256_extract_epi8(sums, 24);
+        }
+
+        for (; idx < count; idx++) {
+            distances[idx] = __builtin_popcountll(block[idx] ^ hash);
+        }
+    }
+#endif
+
+    // the build targets the baseline of the architecture,
+    // so the instructions are chosen when the program starts
+    DistanceFunction select_block_distances() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("popcnt")) {
+            return block_distances_avx2;
+        }
+        if (__builtin_cpu_supports("popcnt")) {
+            return block_distances_popcnt;
+        }
+#endif
+        return block_distances_generic;
+    }
+
+    const DistanceFunction block_distances = select_block_distances();
+}
+
+void SimilarityIndex::clear() {
+    hashes.clear();
+    ids.clear();
+}
+
+void SimilarityIndex::reserve(size_t count) {
+    hashes.reserve(count);
+    ids.reserve(count);
+}
+
+void SimilarityIndex::add(size_t id, uint64_t hash) {
+    hashes.push_back(hash);
+    ids.push_back(id);
+}
+
+size_t SimilarityIndex::size() const {
+    return hashes.size();
+}
+
+std::vector<SimilarityIndex::Match> SimilarityIndex::find(uint64_t hash, int max_distance,
+                                                          size_t max_results) const
+{
+    // matches sorted into buckets by their distance
+    std::vector<std::vector<size_t>> buckets(std::clamp(max_distance, 0, 64) + 1);
+
+    unsigned char distances[block_size];
+    for (size_t start = 0; start < hashes.size(); start += block_size) {
+        size_t count = std::min(block_size, hashes.size() - start);
+        const uint64_t *block = hashes.data() + start;
+
+        block_distances(block, count, hash, distances);
+
+        for (size_t idx = 0; idx < count; idx++) {
+            if (distances[idx] < buckets.size()) {
+                buckets[distances[idx]].push_back(start + idx);
+            }
+        }
+    }
+
+    std::vector<Match> result;
+    for (size_t distance = 0; distance < buckets.size() && result.size() < max_results; distance++) {
+        for (size_t idx : buckets[distance]) {
+            if (result.size() == max_results) { break; }
+            result.push_back(Match{ids[idx], (int)distance});
+        }
+    }
+
+    return result;
+}
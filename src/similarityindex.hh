@@ -0,0 +1,36 @@
+#pragma once
+
+// standard library
+#include <vector>
+#include <limits>
+#include <cstdint>
+#include <cstddef>
+
+// Finds perceptual hashes within a hamming distance of a query. The hashes
+// are kept in one contiguous array and compared in blocks of xor and
+// popcount. On x86 the popcounts use AVX2 or the popcnt instruction where
+// the processor has them, chosen at startup. For the size of a library this
+// is a few megabytes and faster to scan than tree structures are to walk,
+// since large distances make a BK-tree visit most of its nodes anyway.
+class SimilarityIndex {
+    public: class Match {
+        public:
+            size_t id;
+            int distance;
+    };
+
+    public:
+        void clear();
+        void reserve(size_t count);
+        void add(size_t id, uint64_t hash);
+        size_t size() const;
+
+        // matches within the distance, nearest first,
+        // matches with the same distance in the order they were added
+        std::vector<Match> find(uint64_t hash, int max_distance,
+                                size_t max_results = std::numeric_limits<size_t>::max()) const;
+
+    private:
+        std::vector<uint64_t> hashes;
+        std::vector<size_t> ids;
+};
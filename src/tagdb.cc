@@ -1,19 +1,32 @@
 // standard library
-#include <map>
+#include <unordered_map>
+#include <unordered_set>
 #include <tuple>
 #include <algorithm>
 #include <filesystem>
 #include <utility>
+#include <iterator>
+#include <thread>
+#include <future>
 
 // project
 #include "tagdb.hh"
+#include "dbfile.hh"
+#include "workerpool.hh"
+#include "tagdictionary.hh"
+#include "contenthash.hh"
 
 // TagDb::Item implementation
 TagDb::Item::Item(const Glib::ustring &file_path, const Type &type)
 :
     file_path(file_path),
     type(type),
-    favorite(false)
+    favorite(false),
+    hashed(false),
+    hash(0),
+    perceptual_hashed(false),
+    perceptual_hash(0),
+    metadata_row(MetadataTable::npos)
 {}
 
 TagDb::Item::Item(const Glib::ustring &file_path,
@@ -23,33 +36,51 @@ TagDb::Item::Item(const Glib::ustring &file_path,
 :
     file_path(file_path),
     type(type),
-    favorite(favorite)
+    favorite(favorite),
+    hashed(false),
+    hash(0),
+    perceptual_hashed(false),
+    perceptual_hash(0),
+    metadata_row(MetadataTable::npos)
 {
-    for (Glib::ustring tag : tags) {
-        this->tags.insert(tag);
-    }
+    set_tags(tags);
 }
 
 void TagDb::Item::add_tag(const Glib::ustring &tag) {
-    tags.insert(tag);
+    const Glib::ustring *interned = TagDictionary::intern(tag.raw());
+
+    auto iter = std::lower_bound(tags.begin(), tags.end(), interned, TagDictionary::less);
+    if (iter == tags.end() || *iter != interned) {
+        tags.insert(iter, interned);
+    }
 }
 
 void TagDb::Item::remove_tag(const Glib::ustring &tag) {
-    tags.erase(tag);
+    auto iter = std::lower_bound(tags.begin(), tags.end(), tag.raw(),
+            [](const Glib::ustring *a, const std::string &b){ return a->raw() < b; });
+    if (iter != tags.end() && (*iter)->raw() == tag.raw()) {
+        tags.erase(iter);
+    }
 }
 
 void TagDb::Item::set_tags(const std::set<Glib::ustring> &tags) {
-    this->tags = tags;
+    this->tags.clear();
+    for (const Glib::ustring &tag : tags) {
+        this->tags.push_back(TagDictionary::intern(tag.raw()));
+    }
+
+    // the set is ordered by collation, the interned tags by their bytes
+    std::sort(this->tags.begin(), this->tags.end(), TagDictionary::less);
 }
 
 bool TagDb::Item::is_tagged(const Glib::ustring &tag) const {
-    // count can only return 0 or 1
-    // implicit conversion to bool possible
-    return tags.count(tag);
+    auto iter = std::lower_bound(tags.begin(), tags.end(), tag.raw(),
+            [](const Glib::ustring *a, const std::string &b){ return a->raw() < b; });
+    return iter != tags.end() && (*iter)->raw() == tag.raw();
 }
 
 bool TagDb::Item::is_tagged(const std::set<Glib::ustring> &tags) const {
-        for (Glib::ustring tag : tags) {
+        for (const Glib::ustring &tag : tags) {
             if (is_tagged(tag)) {
                 return true;
             }
@@ -57,8 +88,29 @@ bool TagDb::Item::is_tagged(const std::set<Glib::ustring> &tags) const {
         return false;
 }
 
-const std::set<Glib::ustring> &TagDb::Item::get_tags() const {
-    return tags;
+bool TagDb::Item::matches(const Glib::ustring &tag) const {
+    if (is_tagged(tag)) { return true; }
+
+    auto iter = std::lower_bound(implied_tags.begin(), implied_tags.end(), tag.raw(),
+            [](const Glib::ustring *a, const std::string &b){ return a->raw() < b; });
+    return iter != implied_tags.end() && (*iter)->raw() == tag.raw();
+}
+
+bool TagDb::Item::matches(const std::set<Glib::ustring> &tags) const {
+    for (const Glib::ustring &tag : tags) {
+        if (matches(tag)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::set<Glib::ustring> TagDb::Item::get_tags() const {
+    std::set<Glib::ustring> result;
+    for (const Glib::ustring *tag : tags) {
+        result.insert(*tag);
+    }
+    return result;
 }
 
 void TagDb::Item::set_file_path(const Glib::ustring &file_path) {
@@ -85,6 +137,36 @@ void TagDb::Item::set_favorite(const bool &favorite) {
     this->favorite = favorite;
 }
 
+bool TagDb::Item::has_hash() const {
+    return hashed;
+}
+
+uint64_t TagDb::Item::get_hash() const {
+    return hash;
+}
+
+void TagDb::Item::set_hash(uint64_t hash) {
+    this->hash = hash;
+    hashed = true;
+}
+
+bool TagDb::Item::has_perceptual_hash() const {
+    return perceptual_hashed;
+}
+
+uint64_t TagDb::Item::get_perceptual_hash() const {
+    return perceptual_hash;
+}
+
+void TagDb::Item::set_perceptual_hash(uint64_t hash) {
+    perceptual_hash = hash;
+    perceptual_hashed = true;
+}
+
+bool TagDb::Item::has_metadata() const {
+    return metadata_row != MetadataTable::npos;
+}
+
 bool TagDb::Item::operator<(const TagDb::Item &other) const {
     if (this->favorite && (!other.favorite)) {
         return true;
@@ -108,8 +190,8 @@ std::ostream& operator<<(std::ostream &os, TagDb::Item item) {
         os << "[type]video" << std::endl;
 
     os << "[tags]";
-    for (Glib::ustring tag : item.tags) {
-        os << tag.raw() << ',';
+    for (const Glib::ustring *tag : item.tags) {
+        os << tag->raw() << ',';
     }
     os << std::endl;
 
@@ -118,13 +200,101 @@ std::ostream& operator<<(std::ostream &os, TagDb::Item item) {
     else
         os << "[fave]no" << std::endl;
 
-    os << std::endl;
+    if (item.hashed)
+        os << "[hash]" << ContentHash::to_string(item.hash) << std::endl;
+
+    if (item.perceptual_hashed)
+        os << "[phash]" << ContentHash::to_string(item.perceptual_hash) << std::endl;
 
     return os;
 }
 
+// TagDb::Album implementation
+TagDb::Album::Album()
+:
+    query_type(TagDb::QueryType::OR)
+{}
+
+// TagDb::QueryCounts implementation
+TagDb::QueryCounts::QueryCounts()
+:
+    query_type(TagDb::QueryType::OR),
+    result_count(0),
+    rules(std::make_shared<TagRules>()),
+    predicates_only(false)
+{}
+
+size_t TagDb::QueryCounts::get_result_count() const {
+    return result_count;
+}
+
+size_t TagDb::QueryCounts::count_with_included(const Glib::ustring &tag) const {
+    auto iter = tags.find(TagDictionary::find(rules->resolve(tag).raw()));
+    size_t in_result = iter == tags.end() ? 0 : iter->second.first;
+    size_t outside_result = iter == tags.end() ? 0 : iter->second.second;
+
+    // another included tag widens a query for any tag and narrows one for all
+    // tags, or one that only selects items by their metadata
+    if (query_type == TagDb::QueryType::OR && !predicates_only) {
+        return result_count + outside_result;
+    }
+    return in_result;
+}
+
+size_t TagDb::QueryCounts::count_with_excluded(const Glib::ustring &tag) const {
+    auto iter = tags.find(TagDictionary::find(rules->resolve(tag).raw()));
+    return result_count - (iter == tags.end() ? 0 : iter->second.first);
+}
+
+std::vector<TagDb::Facet> TagDb::QueryCounts::get_facets(size_t max_values) const {
+    std::vector<TagDb::Facet> result;
+    std::unordered_map<std::string_view, size_t> facet_indices;
+    for (const auto &entry : namespaces) {
+        facet_indices[entry.first] = result.size();
+        result.push_back(TagDb::Facet{std::string(entry.first), entry.second, {}});
+    }
+
+    // the counts of the values were taken in the same pass
+    for (const auto &entry : tags) {
+        if (entry.second.first == 0) { continue; }
+
+        std::string_view tag_namespace = TagDictionary::get_namespace(
+                std::string_view(entry.first->data(), entry.first->bytes()));
+        auto iter = facet_indices.find(tag_namespace);
+        if (iter != facet_indices.end()) {
+            result[iter->second].values.push_back(std::make_pair(*entry.first, entry.second.first));
+        }
+    }
+
+    for (TagDb::Facet &facet : result) {
+        size_t count = std::min(max_values, facet.values.size());
+        std::partial_sort(facet.values.begin(), facet.values.begin() + count, facet.values.end(),
+                          [](const std::pair<Glib::ustring, size_t> &a, const std::pair<Glib::ustring, size_t> &b)
+                          {
+                              if (a.second != b.second) { return a.second > b.second; }
+                              return a.first.raw() < b.first.raw();
+                          });
+        facet.values.resize(count);
+    }
+
+    std::sort(result.begin(), result.end(), [](const TagDb::Facet &a, const TagDb::Facet &b){
+        if (a.count != b.count) { return a.count > b.count; }
+        return a.name < b.name;
+    });
+
+    return result;
+}
+
 // TagDb implementation
-TagDb::TagDb() : query_type(TagDb::QueryType::OR)
+TagDb::TagDb()
+:
+    unwritten_changes(false),
+    item_storage(std::make_shared<std::vector<TagDb::Item>>()),
+    query_type(TagDb::QueryType::OR),
+    rules(std::make_shared<TagRules>()),
+    metadata_storage(std::make_shared<MetadataTable>()),
+    hash_index_valid(false),
+    similarity_index_valid(false)
 {}
 
 void TagDb::create_database(const std::string &db_file_path) {
@@ -137,133 +307,120 @@ void TagDb::create_database(const std::string &db_file_path) {
 }
 
 void TagDb::load_from_file(const std::string &db_file_path) {
-    // clear existing data
-    default_excluded_tags.clear();
-    directories.clear();
-
-    // variables for reading from file
-    std::string line;
-    std::ifstream input(db_file_path);
-
-    if (!input.good()) {
-        throw FileErrorException(db_file_path);
+    // map the file and check its header
+    // this throws if the file cannot be opened or has no header
+    DbFile file(db_file_path);
+
+    // split the file at item boundaries and parse the sections in parallel
+    // small files end up in a single section that is parsed right here
+    std::vector<DbFile::ParseResult> results;
+    std::vector<DbFile::Section> sections = file.split(std::thread::hardware_concurrency());
+    if (sections.size() == 1) {
+        results.push_back(DbFile::parse(sections.at(0)));
+    }
+    else {
+        WorkerPool pool(sections.size());
+        std::vector<std::future<DbFile::ParseResult>> futures;
+        for (const DbFile::Section &section : sections) {
+            futures.push_back(pool.submit([section](){ return DbFile::parse(section); }));
+        }
+        for (std::future<DbFile::ParseResult> &future : futures) {
+            results.push_back(future.get());
+        }
     }
 
-    // store file path
-    this->db_file_path = db_file_path;
-
-    // set the prefix to the directory that the file is located in
-    prefix = db_file_path.substr(0, db_file_path.find_last_of("/") + 1);
-
-    // clear any current items
-    items.clear();
+    // report the first error in the file, sections only know
+    // their own line numbers so add the lines of the previous ones
+    // the header is the first line of the file
+    size_t line_number = 1;
+    for (const DbFile::ParseResult &result : results) {
+        if (result.error_line != 0) {
+            throw TagDb::FileParseException(line_number + result.error_line);
+        }
+        line_number += result.line_count;
+    }
 
-    // buffer variables
-    Glib::ustring file_path = "";
-    TagDb::Item::Type type = TagDb::Item::Type::image;
-    std::set<Glib::ustring> tags;
-    bool favorite = false;
+    // the file was parsed successfully, replace current data
+    begin_load(db_file_path);
 
-    // check first line for header
-    std::getline(input, line);
-    if (line != "[TagView database file]") {
-        input.close();
-        throw TagDb::FileParseException(1);
+    // merge the sections in file order
+    for (DbFile::ParseResult &result : results) {
+        load_items(result.items, result.directories, result.default_excluded_tags,
+                   result.rules, result.albums, result.metadata);
     }
+}
 
-    // parse the rest of the file
-    size_t line_number = 1;
-    while (getline(input, line)) {
-        line_number += 1;
-
-        // use the # character for comments
-        if (line[0] == '#') continue;
-
-        // ignore empty lines
-        if (line.length() == 0) continue;
-
-        // otherwise, if the line does not
-        // start with a [ character, throw error
-        if (line[0] != '[') {
-            input.close();
-            throw TagDb::FileParseException(line_number);
-        }
-
-        // beginning a new item
-        // submit current buffer if vialbe
-        // clear buffer variables
-        if (line == "[item]") {
-            if (file_path.length() != 0 && tags.size() != 0) {
-                // add new item
-                items.push_back(TagDb::Item(file_path, type, tags, favorite));
-
-                // reset buffer variables
-                file_path.clear();
-                type = TagDb::Item::Type::image;
-                tags.clear();
-                favorite = false;
-            }
-        }
+void TagDb::clear() {
+    std::vector<TagDb::Item> &items = get_mutable_items();
 
-        // check all possible entry types
-        else if (str_starts_with(line, "[path]")) {
-            file_path = line.substr(6);
-        }
+    db_file_path.clear();
+    unwritten_changes = false;
+    prefix.clear();
+    items.clear();
+    directories.clear();
+    default_excluded_tags.clear();
+    rules = std::make_shared<TagRules>();
+    albums.clear();
+    metadata_storage = std::make_shared<MetadataTable>();
+    invalidate_indices();
+
+    // every tag is orphaned
+    for (const auto &entry : tag_counts) {
+        changed_tags.insert(entry.first);
+    }
+    tag_counts.clear();
+}
 
-        else if (str_starts_with(line, "[type]")) {
-            if (line.substr(6) == "image") {
-                type = TagDb::Item::Type::image;
-            }
-            else if (line.substr(6) == "video") {
-                type = TagDb::Item::Type::video;
-            }
-            else {
-                throw FileParseException(line_number);
-            }
-        }
+void TagDb::begin_load(const std::string &db_file_path) {
+    clear();
 
-        else if (str_starts_with(line, "[tags]")) {
-            tags = parse_tags(line.substr(6));
-        }
+    // store file path
+    this->db_file_path = db_file_path;
 
-        else if (str_starts_with(line, "[fave]")) {
-            if (line.substr(6) == "yes") {
-                favorite = true;
-            }
-            else if (line.substr(6) == "no") {
-                favorite = false;
-            }
-            else {
-                throw FileParseException(line_number);
-            }
-        }
+    // set the prefix to the directory that the file is located in
+    prefix = db_file_path.substr(0, db_file_path.find_last_of("/") + 1);
+}
 
-        else if (str_starts_with(line, "[dir]")) {
-            directories.insert(line.substr(5));
-        }
+void TagDb::load_items(std::vector<TagDb::Item> &new_items,
+                       const std::set<Glib::ustring> &new_directories,
+                       const std::set<Glib::ustring> &new_excluded_tags,
+                       const std::vector<TagRules::Rule> &new_rules,
+                       const std::vector<TagDb::Album> &new_albums,
+                       const MetadataTable &new_metadata)
+{
+    std::vector<TagDb::Item> &items = get_mutable_items();
 
-        else if (str_starts_with(line, "[exclude]")) {
-            for (const Glib::ustring &tag : parse_tags(line.substr(9))) {
-                default_excluded_tags.insert(tag);
-            }
-        }
+    // the rules are at the top of the file, before the items they apply to
+    if (new_rules.size() > 0) {
+        std::set<TagRules::Rule> merged_rules = rules->get_rules();
+        merged_rules.insert(new_rules.begin(), new_rules.end());
+        apply_rules(merged_rules);
+    }
+    add_albums(new_albums);
 
-        else {
-            throw FileParseException(line_number);
+    // the rows of the section follow the rows of the previous ones
+    size_t first_row = get_mutable_metadata().append(new_metadata);
+    for (TagDb::Item &item : new_items) {
+        if (item.metadata_row != MetadataTable::npos) {
+            item.metadata_row += first_row;
         }
+        update_implied_tags(item);
+        index_item(item, true);
     }
 
-    // at the end of file, if buffer variables are valid
-    // add last entry to database
-    if (file_path.length() != 0 && tags.size() != 0) {
-        // add new item
-        items.push_back(TagDb::Item(file_path, type, tags, favorite));
-    }
+    items.insert(items.end(),
+                 std::make_move_iterator(new_items.begin()),
+                 std::make_move_iterator(new_items.end()));
+    new_items.clear();
+    invalidate_indices();
 
-    input.close();
+    directories.insert(new_directories.begin(), new_directories.end());
+    default_excluded_tags.insert(new_excluded_tags.begin(), new_excluded_tags.end());
 }
 
 void TagDb::write_to_file() const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
     std::ofstream output(db_file_path);
 
     if (!output.good()) {
@@ -271,6 +428,7 @@ void TagDb::write_to_file() const {
     }
 
     output << "[TagView database file]" << std::endl << std::endl;
+    unwritten_changes = false;
 
     for (const Glib::ustring &dir : directories) {
         output << "[dir]" << dir << std::endl;
@@ -280,290 +438,1355 @@ void TagDb::write_to_file() const {
     for (const Glib::ustring &tag : default_excluded_tags) {
         output << tag.raw() << ',';
     }
+    output << std::endl;
+
+    for (const TagRules::Rule &rule : rules->get_rules()) {
+        output << (rule.type == TagRules::Rule::Type::IMPLIES ? "[implies]" : "[alias]")
+               << rule.tag.raw() << ',' << rule.target.raw() << ',' << std::endl;
+    }
 
-    output << std::endl << std::endl;
+    for (const TagDb::AlbumIndex &index : albums) {
+        const TagDb::Album &album = index.album;
+        output << "[album]" << album.name.raw() << std::endl;
+        output << "[album-type]" << (album.query_type == TagDb::QueryType::AND ? "and" : "or") << std::endl;
+        output << "[album-include]";
+        for (const Glib::ustring &tag : album.tags_include) {
+            output << tag.raw() << ',';
+        }
+        output << std::endl;
+        output << "[album-exclude]";
+        for (const Glib::ustring &tag : album.tags_exclude) {
+            output << tag.raw() << ',';
+        }
+        output << std::endl;
+    }
+
+    output << std::endl;
 
     for (const TagDb::Item &item : items) {
         output << item;
+        if (item.metadata_row != MetadataTable::npos) {
+            output << "[meta]" << metadata_storage->get(item.metadata_row).to_string() << std::endl;
+        }
+        output << std::endl;
     }
 
     output.close();
 }
 
+bool TagDb::has_unwritten_changes() const {
+    return unwritten_changes;
+}
+
 void TagDb::add_item(TagDb::Item &item) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
 
     // remove entry if it already in the database
+    // the metadata of the file is kept if the new item has none
+    size_t metadata_row = item.metadata_row;
     for (size_t idx = 0; idx < items.size(); idx++) {
         if (items[idx].get_file_path() == item.get_file_path()) {
+            if (metadata_row == MetadataTable::npos) {
+                metadata_row = items[idx].metadata_row;
+            }
+            index_item(items[idx], false);
             items.erase(items.begin() + idx);
             break;
         }
     }
 
     items.push_back(item);
+    items.back().metadata_row = metadata_row;
+    update_implied_tags(items.back());
+    index_item(items.back(), true);
+    invalidate_indices();
     write_to_file();
 }
 
-void TagDb::edit_item(const Item &item) {
+void TagDb::apply_batch(const std::vector<TagDb::Item> &new_items) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
+
+    if (new_items.size() == 0) { return; }
+
+    std::unordered_map<std::string, size_t> item_indices;
     for (size_t idx = 0; idx < items.size(); idx++) {
-        if (items[idx].get_file_path() == item.get_file_path()) {
-            items[idx].set_favorite(item.get_favorite());
-            items[idx].set_tags(item.get_tags());
-            items[idx].set_type(item.get_type());
-            write_to_file();
-            return;
+        item_indices[items[idx].get_file_path().raw()] = idx;
+    }
+
+    // items already in the database are replaced in place
+    for (const TagDb::Item &item : new_items) {
+        auto iter = item_indices.find(item.get_file_path().raw());
+        if (iter != item_indices.end()) {
+            // keep the hashes and the metadata of the file if the new item has none
+            TagDb::Item old_item = items[iter->second];
+            index_item(old_item, false);
+
+            items[iter->second] = item;
+            if (item.metadata_row == MetadataTable::npos) {
+                items[iter->second].metadata_row = old_item.metadata_row;
+            }
+            update_implied_tags(items[iter->second]);
+            index_item(items[iter->second], true);
+            if (!item.hashed && old_item.hashed) {
+                items[iter->second].set_hash(old_item.hash);
+            }
+            if (!item.perceptual_hashed && old_item.perceptual_hashed) {
+                items[iter->second].set_perceptual_hash(old_item.perceptual_hash);
+            }
+        }
+        else {
+            item_indices[item.get_file_path().raw()] = items.size();
+            items.push_back(item);
+            update_implied_tags(items.back());
+            index_item(items.back(), true);
         }
     }
 
-    throw ItemNotFoundException(prefix + item.get_file_path());
+    invalidate_indices();
+    write_to_file();
 }
 
-void TagDb::delete_item(const Glib::ustring &file_path, bool delete_file) {
-    // remove the prefix from the argument
-    Glib::ustring rel_path = file_path.substr(prefix.size());
+void TagDb::set_hashes(const std::vector<std::pair<Glib::ustring, uint64_t>> &hashes) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
 
-    bool found = false;
+    if (hashes.size() == 0) { return; }
 
+    std::unordered_map<std::string, size_t> item_indices;
     for (size_t idx = 0; idx < items.size(); idx++) {
-        if (items[idx].get_file_path() == rel_path) {
-            items.erase(items.begin() + idx);
-            found = true;
-            write_to_file();
-            break;
-        }
+        item_indices[items[idx].get_file_path().raw()] = idx;
     }
 
-    if (!found) { throw ItemNotFoundException(file_path); }
-
-    if (delete_file) {
-        try {
-            std::filesystem::remove(file_path.raw());
+    for (const auto &entry : hashes) {
+        auto iter = item_indices.find(entry.first.raw());
+        if (iter != item_indices.end()) {
+            items[iter->second].set_hash(entry.second);
         }
-        catch (...) {}
     }
 
-}
-
-void TagDb::set_directories(const std::set<Glib::ustring> &dirs) {
-    directories = dirs;
+    invalidate_indices();
     write_to_file();
 }
 
-void TagDb::set_default_excluded_tags(const std::set<Glib::ustring> &exclude_tags) {
-    default_excluded_tags = exclude_tags;
-    write_to_file();
-}
+void TagDb::set_perceptual_hashes(const std::vector<std::pair<Glib::ustring, uint64_t>> &hashes) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
 
-void TagDb::set_query_type(TagDb::QueryType query_type) {
-    this->query_type = query_type;
-}
+    if (hashes.size() == 0) { return; }
 
-std::set<Glib::ustring> TagDb::get_all_tags() const {
-    std::set<Glib::ustring> result;
+    std::unordered_map<std::string, size_t> item_indices;
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        item_indices[items[idx].get_file_path().raw()] = idx;
+    }
+
+    bool changed = false;
+    for (const auto &entry : hashes) {
+        auto iter = item_indices.find(entry.first.raw());
+        if (iter == item_indices.end()) { continue; }
 
-    for (TagDb::Item item : items) {
-        for (Glib::ustring tag : item.get_tags()) {
-            result.insert(tag);
+        TagDb::Item &item = items[iter->second];
+        if (!item.perceptual_hashed || item.perceptual_hash != entry.second) {
+            item.set_perceptual_hash(entry.second);
+            changed = true;
         }
     }
 
-    return result;
-}
+    if (!changed) { return; }
 
-const std::set<Glib::ustring> &TagDb::get_default_excluded_tags() const {
-    return default_excluded_tags;
+    invalidate_indices();
+    unwritten_changes = true;
 }
 
-const std::set<Glib::ustring> &TagDb::get_directories() const {
-    return directories;
-}
+void TagDb::set_metadata(const std::vector<std::pair<std::string, MetadataTable::Record>> &records) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
 
-const std::string &TagDb::get_prefix() const {
-    return prefix;
-}
+    if (records.size() == 0) { return; }
+    MetadataTable &metadata = get_mutable_metadata();
 
-const std::set<Glib::ustring> &TagDb::get_tags_for_item(const Glib::ustring &file_path) const {
-    // remove the prefix from the argument
-    Glib::ustring rel_path = file_path.substr(prefix.size());
+    std::unordered_map<std::string, size_t> item_indices;
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        item_indices[items[idx].get_file_path().raw()] = idx;
+    }
 
-    for (const TagDb::Item &item : items) {
-        if (item.get_file_path() == rel_path) {
-            return item.tags;
+    for (const auto &entry : records) {
+        auto iter = item_indices.find(entry.first);
+        if (iter == item_indices.end()) { continue; }
+
+        // albums may query the metadata
+        TagDb::Item &item = items[iter->second];
+        index_album_item(item, false);
+        if (item.metadata_row == MetadataTable::npos) {
+            item.metadata_row = metadata.add(entry.second);
+        }
+        else {
+            metadata.set(item.metadata_row, entry.second);
         }
+        index_album_item(item, true);
     }
-    throw ItemNotFoundException(file_path);
+
+    query_snapshot.reset();
+    unwritten_changes = true;
 }
 
-const TagDb::Item &TagDb::get_item(const Glib::ustring &file_path) const {
-    // remove the prefix from the argument
-    Glib::ustring rel_path = file_path.substr(prefix.size());
+std::vector<std::string> TagDb::get_items_without_metadata() const {
+    const std::vector<TagDb::Item> &items = *item_storage;
 
+    std::vector<std::string> result;
     for (const TagDb::Item &item : items) {
-        if (item.get_file_path() == rel_path) {
-            return item;
+        // videos have no headers that MetadataReader understands
+        if (item.metadata_row == MetadataTable::npos && item.type == TagDb::Item::Type::image) {
+            result.push_back(item.get_file_path().raw());
         }
     }
 
-    throw ItemNotFoundException(file_path);
+    return result;
 }
 
-std::vector<Glib::ustring> TagDb::query(const std::set<Glib::ustring> &tags_include,
-                                        const std::set<Glib::ustring> &tags_exclude) const
-{
-    switch(query_type) {
-        case TagDb::QueryType::OR: return query_or(tags_include, tags_exclude);
-        case TagDb::QueryType::AND: return query_and(tags_include, tags_exclude);
-        default: return query_or(tags_include, tags_exclude);
-    }
-}
+bool TagDb::get_metadata(const Glib::ustring &file_path, MetadataTable::Record &record) const {
+    const TagDb::Item &item = get_item(file_path);
+    if (item.metadata_row == MetadataTable::npos) { return false; }
 
-std::vector<Glib::ustring> TagDb::query_or(const std::set<Glib::ustring> &tags_include,
-                                           const std::set<Glib::ustring> &tags_exclude) const
-{
-    std::vector<Glib::ustring> result;
-    std::vector<const TagDb::Item *> result_items;
+    record = metadata_storage->get(item.metadata_row);
+    return true;
+}
 
-    for (const TagDb::Item &item : items) {
-        // if item is tagged with a tag that is
-        // excluded from the query, then continue
-        // the loop, ignoring the item
-        if (item.is_tagged(tags_exclude)) {
-            continue;
-        }
+size_t TagDb::merge_tags(const std::set<Glib::ustring> &tags, const Glib::ustring &target) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
 
-        // if item is tagged with a tag that is
-        // included in the query, add its file path
-        // to the result
-        if (item.is_tagged(tags_include)) {
-            result_items.push_back(&item);
+    // tags that were never interned are not on any item
+    std::unordered_set<const Glib::ustring *> merged_tags;
+    for (const Glib::ustring &tag : tags) {
+        const Glib::ustring *interned = TagDictionary::find(tag.raw());
+        if (interned != nullptr && interned->raw() != target.raw()) {
+            merged_tags.insert(interned);
         }
     }
 
-    // sort the items before extracting the file paths
-    // the items sort favorites first by their overloaded operator
-    std::sort(result_items.begin(), result_items.end(),
-              [](const TagDb::Item *a, const TagDb::Item *b){ return (*a) < (*b); });
+    if (merged_tags.size() == 0) { return 0; }
+    const Glib::ustring *interned_target = TagDictionary::intern(target.raw());
 
-    for (const TagDb::Item *item : result_items) {
-        result.push_back(prefix + item->get_file_path());
-    }
+    size_t changed = 0;
+    for (TagDb::Item &item : items) {
+        auto is_merged = [&merged_tags](const Glib::ustring *tag){ return merged_tags.count(tag) != 0; };
+        if (std::none_of(item.tags.begin(), item.tags.end(), is_merged)) { continue; }
 
-    return result;
-}
+        index_item(item, false);
+        item.tags.erase(std::remove_if(item.tags.begin(), item.tags.end(), is_merged), item.tags.end());
 
-std::vector<Glib::ustring> TagDb::query_and(const std::set<Glib::ustring> &tags_include,
-                                           const std::set<Glib::ustring> &tags_exclude) const
-{
-    std::vector<Glib::ustring> result;
-    std::vector<const TagDb::Item *> result_items;
+        auto iter = std::lower_bound(item.tags.begin(), item.tags.end(), interned_target, TagDictionary::less);
+        if (iter == item.tags.end() || *iter != interned_target) {
+            item.tags.insert(iter, interned_target);
+        }
+        update_implied_tags(item);
+        index_item(item, true);
+        changed += 1;
+    }
 
-    for (const TagDb::Item &item : items) {
-        // if item is tagged with a tag that is
-        // excluded from the query, then continue
-        // the loop, ignoring the item
-        if (item.is_tagged(tags_exclude)) {
-            continue;
+    bool excluded_changed = false;
+    for (const Glib::ustring *tag : merged_tags) {
+        if (default_excluded_tags.erase(*tag) != 0) {
+            excluded_changed = true;
         }
+    }
+    if (excluded_changed) {
+        default_excluded_tags.insert(target);
+    }
 
-        // if item is tagged with all tags that are
-        // included in the query, add its file path
-        // to the result
-        bool has_all = true;
-        for (const Glib::ustring &tag : tags_include) {
-            if (!item.is_tagged(tag)) {
-                has_all = false;
-                break;
+    // albums query the new tag instead, their items are found again
+    bool albums_changed = false;
+    for (TagDb::AlbumIndex &index : albums) {
+        bool album_changed = false;
+        for (const Glib::ustring *tag : merged_tags) {
+            if (index.album.tags_include.erase(*tag) != 0) {
+                index.album.tags_include.insert(target);
+                album_changed = true;
+            }
+            if (index.album.tags_exclude.erase(*tag) != 0) {
+                index.album.tags_exclude.insert(target);
+                album_changed = true;
             }
         }
-        if (has_all) {
-            result_items.push_back(&item);
+        if (album_changed) {
+            resolve_album(index);
+            fill_album(index);
+            albums_changed = true;
         }
     }
 
-    // sort the items before extracting the file paths
-    // the items sort favorites first by their overloaded operator
-    std::sort(result_items.begin(), result_items.end(),
-              [](const TagDb::Item *a, const TagDb::Item *b){ return (*a) < (*b); });
+    if (changed != 0 || excluded_changed || albums_changed) {
+        write_to_file();
+    }
 
-    for (const TagDb::Item *item : result_items) {
-        result.push_back(prefix + item->get_file_path());
+    return changed;
+}
+
+size_t TagDb::add_tags_to_items(const std::vector<Glib::ustring> &file_paths,
+                                const std::set<Glib::ustring> &tags)
+{
+    std::vector<TagDb::Item> &items = get_mutable_items();
+
+    size_t changed = 0;
+    for (size_t idx : find_items(file_paths)) {
+        bool item_changed = false;
+        for (const Glib::ustring &tag : tags) {
+            if (!items[idx].is_tagged(tag)) {
+                item_changed = true;
+                break;
+            }
+        }
+        if (!item_changed) { continue; }
+
+        // the implied tags of the item change along with its tags
+        index_item(items[idx], false);
+        for (const Glib::ustring &tag : tags) {
+            if (!items[idx].is_tagged(tag)) {
+                items[idx].add_tag(tag);
+            }
+        }
+        update_implied_tags(items[idx]);
+        index_item(items[idx], true);
+        changed += 1;
+    }
+
+    if (changed != 0) {
+        write_to_file();
+    }
+
+    return changed;
+}
+
+size_t TagDb::add_item_tags(const std::vector<std::pair<std::string, std::set<Glib::ustring>>> &item_tags) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
+
+    std::unordered_map<std::string, size_t> item_indices;
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        item_indices[items[idx].get_file_path().raw()] = idx;
+    }
+
+    size_t changed = 0;
+    for (const auto &entry : item_tags) {
+        auto iter = item_indices.find(entry.first);
+        if (iter == item_indices.end()) { continue; }
+
+        TagDb::Item &item = items[iter->second];
+        bool item_changed = false;
+        for (const Glib::ustring &tag : entry.second) {
+            if (!item.is_tagged(tag)) {
+                item_changed = true;
+                break;
+            }
+        }
+        if (!item_changed) { continue; }
+
+        index_item(item, false);
+        for (const Glib::ustring &tag : entry.second) {
+            item.add_tag(tag);
+        }
+        update_implied_tags(item);
+        index_item(item, true);
+        changed += 1;
+    }
+
+    if (changed != 0) {
+        write_to_file();
+    }
+
+    return changed;
+}
+
+size_t TagDb::remove_tags_from_items(const std::vector<Glib::ustring> &file_paths,
+                                     const std::set<Glib::ustring> &tags,
+                                     std::vector<std::string> &skipped)
+{
+    std::vector<TagDb::Item> &items = get_mutable_items();
+
+    size_t changed = 0;
+    for (size_t idx : find_items(file_paths)) {
+        // an item without tags would not be kept in the file
+        bool keeps_a_tag = false;
+        for (const Glib::ustring *tag : items[idx].tags) {
+            if (tags.count(*tag) == 0) {
+                keeps_a_tag = true;
+                break;
+            }
+        }
+        if (!items[idx].is_tagged(tags)) { continue; }
+        if (!keeps_a_tag) {
+            skipped.push_back(items[idx].get_file_path().raw());
+            continue;
+        }
+
+        index_item(items[idx], false);
+        for (const Glib::ustring &tag : tags) {
+            if (items[idx].is_tagged(tag)) {
+                items[idx].remove_tag(tag);
+            }
+        }
+        update_implied_tags(items[idx]);
+        index_item(items[idx], true);
+        changed += 1;
+    }
+
+    if (changed != 0) {
+        write_to_file();
+    }
+
+    return changed;
+}
+
+void TagDb::edit_item(const Item &item) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
+
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        if (items[idx].get_file_path() == item.get_file_path()) {
+            index_item(items[idx], false);
+            items[idx].set_favorite(item.get_favorite());
+            items[idx].set_tags(item.get_tags());
+            update_implied_tags(items[idx]);
+            index_item(items[idx], true);
+            items[idx].set_type(item.get_type());
+
+            // the favorite flag changes the order of query results
+            query_snapshot.reset();
+            write_to_file();
+            return;
+        }
+    }
+
+    throw ItemNotFoundException(prefix + item.get_file_path());
+}
+
+void TagDb::delete_item(const Glib::ustring &file_path, bool delete_file) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
+
+    // remove the prefix from the argument
+    Glib::ustring rel_path = file_path.substr(prefix.size());
+
+    bool found = false;
+
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        if (items[idx].get_file_path() == rel_path) {
+            index_item(items[idx], false);
+            items.erase(items.begin() + idx);
+            found = true;
+            invalidate_indices();
+            write_to_file();
+            break;
+        }
+    }
+
+    if (!found) { throw ItemNotFoundException(file_path); }
+
+    if (delete_file) {
+        try {
+            std::filesystem::remove(file_path.raw());
+        }
+        catch (...) {}
+    }
+
+}
+
+size_t TagDb::move_items(const std::vector<std::pair<Glib::ustring, Glib::ustring>> &moves,
+                        std::vector<std::string> &skipped)
+{
+    std::vector<TagDb::Item> &items = get_mutable_items();
+
+    if (moves.size() == 0) { return 0; }
+
+    std::unordered_map<std::string, size_t> item_indices;
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        item_indices[items[idx].get_file_path().raw()] = idx;
+    }
+
+    size_t moved = 0;
+    for (const auto &move : moves) {
+        // the item may have been removed since the move was found
+        auto iter = item_indices.find(move.first.raw());
+        if (iter == item_indices.end()) {
+            skipped.push_back(move.first.raw());
+            continue;
+        }
+
+        TagDb::Item &item = items[iter->second];
+        index_album_item(item, false);
+        item.set_file_path(move.second);
+        index_album_item(item, true);
+        moved += 1;
+    }
+
+    if (moved != 0) {
+        invalidate_indices();
+        write_to_file();
+    }
+
+    return moved;
+}
+
+bool TagDb::apply_path_changes(const TagDb::PathChanges &changes, std::vector<std::string> &missing) {
+    std::vector<TagDb::Item> &items = get_mutable_items();
+
+    std::unordered_map<std::string, size_t> item_indices;
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        item_indices[items[idx].get_file_path().raw()] = idx;
+    }
+
+    bool changed = false;
+    std::vector<bool> replaced_items(items.size(), false);
+
+    for (const auto &move : changes.moved) {
+        auto iter = item_indices.find(move.first);
+        if (iter == item_indices.end()) { continue; }
+        size_t idx = iter->second;
+        item_indices.erase(iter);
+
+        // the file of another item was replaced by the moved file, it
+        // leaves the albums now, since the moved item takes over its path
+        auto target = item_indices.find(move.second);
+        if (target != item_indices.end()) {
+            replaced_items[target->second] = true;
+            index_album_item(items[target->second], false);
+        }
+
+        index_album_item(items[idx], false);
+        items[idx].set_file_path(move.second);
+        index_album_item(items[idx], true);
+        item_indices[move.second] = idx;
+        changed = true;
+    }
+
+    for (const auto &move : changes.moved_dirs) {
+        std::string old_dir = move.first + "/";
+        for (size_t idx = 0; idx < items.size(); idx++) {
+            const std::string &file_path = items[idx].get_file_path().raw();
+            if (file_path.compare(0, old_dir.size(), old_dir) == 0) {
+                index_album_item(items[idx], false);
+                items[idx].set_file_path(move.second + "/" + file_path.substr(old_dir.size()));
+                index_album_item(items[idx], true);
+                changed = true;
+            }
+        }
+    }
+
+    // moving directories changed the paths, look them up again
+    if (changes.moved_dirs.size() > 0) {
+        item_indices.clear();
+        for (size_t idx = 0; idx < items.size(); idx++) {
+            if (!replaced_items[idx]) {
+                item_indices[items[idx].get_file_path().raw()] = idx;
+            }
+        }
+    }
+
+    // removed files may come back, such as from a drive that was
+    // unmounted, so like the missing items of a scan they keep their tags
+    for (const std::string &file_path : changes.removed) {
+        if (item_indices.count(file_path) != 0) {
+            missing.push_back(file_path);
+        }
+    }
+
+    for (const std::string &dir : changes.removed_dirs) {
+        std::string removed_dir = dir + "/";
+        for (size_t idx = 0; idx < items.size(); idx++) {
+            const std::string &file_path = items[idx].get_file_path().raw();
+            if (!replaced_items[idx] && file_path.compare(0, removed_dir.size(), removed_dir) == 0) {
+                missing.push_back(file_path);
+            }
+        }
+    }
+
+    // the replaced items are removed in a single pass, keeping the order of the rest
+    size_t kept = 0;
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        if (replaced_items[idx]) {
+            count_tags(items[idx], false);
+            changed = true;
+            continue;
+        }
+        if (kept != idx) {
+            items[kept] = std::move(items[idx]);
+        }
+        kept += 1;
+    }
+    items.erase(items.begin() + kept, items.end());
+
+    if (changed) {
+        invalidate_indices();
+        write_to_file();
+    }
+
+    return changed;
+}
+
+void TagDb::set_directories(const std::set<Glib::ustring> &dirs) {
+    directories = dirs;
+    write_to_file();
+}
+
+void TagDb::set_default_excluded_tags(const std::set<Glib::ustring> &exclude_tags) {
+    default_excluded_tags = exclude_tags;
+    query_snapshot.reset();
+    write_to_file();
+}
+
+void TagDb::set_rules(const std::set<TagRules::Rule> &rules) {
+    apply_rules(rules);
+    write_to_file();
+}
+
+const TagRules &TagDb::get_rules() const {
+    return *rules;
+}
+
+void TagDb::set_album(const TagDb::Album &album) {
+    auto iter = std::find_if(albums.begin(), albums.end(),
+                             [&album](const TagDb::AlbumIndex &index){ return index.album.name == album.name; });
+    if (iter == albums.end()) {
+        albums.emplace_back();
+        iter = albums.end() - 1;
+    }
+
+    iter->album = album;
+    resolve_album(*iter);
+    fill_album(*iter);
+    write_to_file();
+}
+
+void TagDb::remove_album(const Glib::ustring &name) {
+    auto iter = std::find_if(albums.begin(), albums.end(),
+                             [&name](const TagDb::AlbumIndex &index){ return index.album.name == name; });
+    if (iter == albums.end()) { return; }
+
+    albums.erase(iter);
+    write_to_file();
+}
+
+std::vector<TagDb::Album> TagDb::get_albums() const {
+    std::vector<TagDb::Album> result;
+    for (const TagDb::AlbumIndex &index : albums) {
+        result.push_back(index.album);
+    }
+
+    return result;
+}
+
+std::vector<std::pair<Glib::ustring, size_t>> TagDb::get_album_sizes() const {
+    std::vector<std::pair<Glib::ustring, size_t>> result;
+    for (const TagDb::AlbumIndex &index : albums) {
+        result.push_back(std::make_pair(index.album.name, index.items.size()));
+    }
+
+    return result;
+}
+
+std::vector<Glib::ustring> TagDb::get_album_items(const Glib::ustring &name) const {
+    std::vector<Glib::ustring> result;
+    for (const TagDb::AlbumIndex &index : albums) {
+        if (index.album.name != name) { continue; }
+
+        // the keys are already in the order of query results
+        result.reserve(index.items.size());
+        for (const auto &key : index.items) {
+            result.push_back(prefix + std::get<2>(key));
+        }
+        break;
+    }
+
+    return result;
+}
+
+void TagDb::set_query_type(TagDb::QueryType query_type) {
+    this->query_type = query_type;
+    query_snapshot.reset();
+}
+
+TagDb::QueryType TagDb::get_query_type() const {
+    return query_type;
+}
+
+std::set<Glib::ustring> TagDb::get_all_tags() const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    // interned tags can be told apart by their address
+    std::unordered_set<const Glib::ustring *> unique_tags;
+    for (const TagDb::Item &item : items) {
+        unique_tags.insert(item.tags.begin(), item.tags.end());
+    }
+
+    std::set<Glib::ustring> result;
+    for (const Glib::ustring *tag : unique_tags) {
+        result.insert(*tag);
+    }
+
+    return result;
+}
+
+std::vector<std::pair<Glib::ustring, size_t>> TagDb::get_tag_counts() const {
+    std::vector<std::pair<const Glib::ustring *, size_t>> sorted(tag_counts.begin(), tag_counts.end());
+    std::sort(sorted.begin(), sorted.end(),
+              [](const std::pair<const Glib::ustring *, size_t> &a, const std::pair<const Glib::ustring *, size_t> &b)
+              {
+                  return TagDictionary::less(a.first, b.first);
+              });
+
+    std::vector<std::pair<Glib::ustring, size_t>> result;
+    result.reserve(sorted.size());
+    for (const auto &entry : sorted) {
+        result.push_back(std::make_pair(*entry.first, entry.second));
     }
 
     return result;
 }
 
-std::vector<Glib::ustring> TagDb::suggestions(const std::set<Glib::ustring> &tags_include) {
-    // perform a query and collect each tag every time it occurs in an item
-    std::vector<Glib::ustring> input_tags;
+std::vector<std::pair<Glib::ustring, size_t>> TagDb::take_tag_changes() {
+    std::vector<std::pair<Glib::ustring, size_t>> result;
+    result.reserve(changed_tags.size());
+    for (const Glib::ustring *tag : changed_tags) {
+        auto iter = tag_counts.find(tag);
+        result.push_back(std::make_pair(*tag, iter == tag_counts.end() ? 0 : iter->second));
+    }
+
+    changed_tags.clear();
+    return result;
+}
+
+const std::set<Glib::ustring> &TagDb::get_default_excluded_tags() const {
+    return default_excluded_tags;
+}
+
+const std::set<Glib::ustring> &TagDb::get_directories() const {
+    return directories;
+}
+
+const std::string &TagDb::get_prefix() const {
+    return prefix;
+}
+
+const std::string &TagDb::get_db_file_path() const {
+    return db_file_path;
+}
+
+std::set<Glib::ustring> TagDb::get_tags_for_item(const Glib::ustring &file_path) const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    // remove the prefix from the argument
+    Glib::ustring rel_path = file_path.substr(prefix.size());
+
     for (const TagDb::Item &item : items) {
-        // for exclude use the default exclude list
-        if (item.is_tagged(default_excluded_tags)) {
+        if (item.get_file_path() == rel_path) {
+            return item.get_tags();
+        }
+    }
+    throw ItemNotFoundException(file_path);
+}
+
+std::vector<std::pair<std::string, std::set<Glib::ustring>>> TagDb::get_tags_for_items(
+        const std::vector<Glib::ustring> &file_paths) const
+{
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    std::vector<std::pair<std::string, std::set<Glib::ustring>>> result;
+    for (size_t idx : find_items(file_paths)) {
+        result.push_back(std::make_pair(items[idx].get_file_path().raw(), items[idx].get_tags()));
+    }
+
+    return result;
+}
+
+const TagDb::Item &TagDb::get_item(const Glib::ustring &file_path) const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    // remove the prefix from the argument
+    Glib::ustring rel_path = file_path.substr(prefix.size());
+
+    for (const TagDb::Item &item : items) {
+        if (item.get_file_path() == rel_path) {
+            return item;
+        }
+    }
+
+    throw ItemNotFoundException(file_path);
+}
+
+std::vector<Glib::ustring> TagDb::get_item_paths() const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    std::vector<Glib::ustring> result;
+    result.reserve(items.size());
+
+    for (const TagDb::Item &item : items) {
+        result.push_back(item.get_file_path());
+    }
+
+    return result;
+}
+
+const std::unordered_map<uint64_t, std::string> &TagDb::get_hash_index() const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    if (!hash_index_valid) {
+        hash_index.clear();
+        for (const TagDb::Item &item : items) {
+            if (item.hashed) {
+                hash_index.emplace(item.hash, item.get_file_path().raw());
+            }
+        }
+        hash_index_valid = true;
+    }
+
+    return hash_index;
+}
+
+std::unordered_map<std::string, uint64_t> TagDb::get_item_hashes() const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    std::unordered_map<std::string, uint64_t> result;
+    for (const TagDb::Item &item : items) {
+        if (item.hashed) {
+            result.emplace(item.get_file_path().raw(), item.hash);
+        }
+    }
+
+    return result;
+}
+
+std::vector<TagDb::Item> &TagDb::get_mutable_items() {
+    // queries that are still running keep the items they started
+    // with, otherwise the snapshots are gone and nothing is copied
+    query_snapshot.reset();
+    if (item_storage.use_count() > 1) {
+        item_storage = std::make_shared<std::vector<TagDb::Item>>(*item_storage);
+    }
+
+    return *item_storage;
+}
+
+MetadataTable &TagDb::get_mutable_metadata() {
+    query_snapshot.reset();
+    if (metadata_storage.use_count() > 1) {
+        metadata_storage = std::make_shared<MetadataTable>(*metadata_storage);
+    }
+
+    return *metadata_storage;
+}
+
+void TagDb::invalidate_indices() {
+    hash_index_valid = false;
+    similarity_index_valid = false;
+    query_snapshot.reset();
+}
+
+void TagDb::apply_rules(const std::set<TagRules::Rule> &new_rules) {
+    if (new_rules == rules->get_rules()) { return; }
+
+    std::vector<TagDb::Item> &items = get_mutable_items();
+
+    // the tags of the rules that were added or removed
+    std::vector<TagRules::Rule> changed_rules;
+    std::set_symmetric_difference(rules->get_rules().begin(), rules->get_rules().end(),
+                                  new_rules.begin(), new_rules.end(),
+                                  std::back_inserter(changed_rules));
+    std::vector<const Glib::ustring *> changed_tags;
+    for (const TagRules::Rule &rule : changed_rules) {
+        changed_tags.push_back(TagDictionary::intern(rule.tag.raw()));
+    }
+
+    // items with a tag that reached a changed rule before or reaches one
+    // now, the rules are replaced since snapshots may still use the old ones
+    std::unordered_set<const Glib::ustring *> affected = rules->get_sources(changed_tags);
+    std::shared_ptr<TagRules> changed = std::make_shared<TagRules>();
+    changed->set_rules(new_rules);
+    rules = changed;
+    for (const Glib::ustring *tag : rules->get_sources(changed_tags)) {
+        affected.insert(tag);
+    }
+
+    // albums that query a changed alias are filled again afterwards
+    std::vector<bool> albums_resolved(albums.size(), false);
+    for (size_t idx = 0; idx < albums.size(); idx++) {
+        albums_resolved[idx] = resolve_album(albums[idx]);
+    }
+
+    for (TagDb::Item &item : items) {
+        for (const Glib::ustring *tag : item.tags) {
+            if (affected.count(tag) != 0) {
+                index_item(item, false);
+                update_implied_tags(item);
+                index_item(item, true);
+                break;
+            }
+        }
+    }
+
+    for (size_t idx = 0; idx < albums.size(); idx++) {
+        if (albums_resolved[idx]) {
+            fill_album(albums[idx]);
+        }
+    }
+
+    query_snapshot.reset();
+}
+
+void TagDb::update_implied_tags(TagDb::Item &item) const {
+    item.implied_tags = rules->get_implied(item.tags);
+}
+
+void TagDb::add_albums(const std::vector<TagDb::Album> &new_albums) {
+    for (const TagDb::Album &album : new_albums) {
+        auto iter = std::find_if(albums.begin(), albums.end(),
+                                 [&album](const TagDb::AlbumIndex &index){ return index.album.name == album.name; });
+        if (iter == albums.end()) {
+            albums.emplace_back();
+            iter = albums.end() - 1;
+        }
+
+        iter->album = album;
+        resolve_album(*iter);
+        fill_album(*iter);
+    }
+}
+
+bool TagDb::resolve_album(TagDb::AlbumIndex &index) const {
+    std::set<Glib::ustring> tags_include = index.album.tags_include;
+    std::set<Glib::ustring> tags_exclude = index.album.tags_exclude;
+    std::vector<MetadataTable::Predicate> predicates_include;
+    std::vector<MetadataTable::Predicate> predicates_exclude;
+    split_predicates(tags_include, predicates_include);
+    split_predicates(tags_exclude, predicates_exclude);
+
+    tags_include = rules->resolve(tags_include);
+    tags_exclude = rules->resolve(tags_exclude);
+    if (tags_include == index.tags_include && tags_exclude == index.tags_exclude &&
+        predicates_include == index.predicates_include && predicates_exclude == index.predicates_exclude)
+    {
+        return false;
+    }
+
+    index.tags_include.swap(tags_include);
+    index.tags_exclude.swap(tags_exclude);
+    index.predicates_include.swap(predicates_include);
+    index.predicates_exclude.swap(predicates_exclude);
+    return true;
+}
+
+void TagDb::fill_album(TagDb::AlbumIndex &index) const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+    const MetadataTable &metadata = *metadata_storage;
+
+    index.items.clear();
+    for (const TagDb::Item &item : items) {
+        if (!item.matches(index.tags_exclude) &&
+            !metadata.matches_any(item.metadata_row, index.predicates_exclude) &&
+            matches_included(item, metadata, index.album.query_type, index.tags_include, index.predicates_include))
+        {
+            index.items.insert(get_album_key(item));
+        }
+    }
+}
+
+std::tuple<bool, std::string, std::string> TagDb::get_album_key(const TagDb::Item &item) {
+    // the same order as Item::operator<, which collates the file names
+    const Glib::ustring &file_path = item.get_file_path();
+    Glib::ustring file_name = file_path.substr(file_path.find_last_of("/") + 1);
+    return std::make_tuple(!item.favorite, file_name.collate_key(), file_path.raw());
+}
+
+void TagDb::count_tag(const Glib::ustring *tag, bool added) {
+    changed_tags.insert(tag);
+
+    // every change of tags goes through here
+    query_snapshot.reset();
+
+    if (added) {
+        tag_counts[tag] += 1;
+        return;
+    }
+
+    auto iter = tag_counts.find(tag);
+    if (iter != tag_counts.end() && --iter->second == 0) {
+        tag_counts.erase(iter);
+    }
+}
+
+void TagDb::count_tags(const TagDb::Item &item, bool added) {
+    // implied tags are counted too, so they can be completed and queried
+    for (const Glib::ustring *tag : item.tags) {
+        count_tag(tag, added);
+    }
+    for (const Glib::ustring *tag : item.implied_tags) {
+        count_tag(tag, added);
+    }
+}
+
+void TagDb::index_item(const TagDb::Item &item, bool added) {
+    count_tags(item, added);
+    index_album_item(item, added);
+}
+
+void TagDb::index_album_item(const TagDb::Item &item, bool added) {
+    if (albums.empty()) { return; }
+
+    const MetadataTable &metadata = *metadata_storage;
+    std::tuple<bool, std::string, std::string> key = get_album_key(item);
+    for (TagDb::AlbumIndex &index : albums) {
+        if (!added) {
+            index.items.erase(key);
+        }
+        else if (!item.matches(index.tags_exclude) &&
+                 !metadata.matches_any(item.metadata_row, index.predicates_exclude) &&
+                 matches_included(item, metadata, index.album.query_type, index.tags_include, index.predicates_include))
+        {
+            index.items.insert(key);
+        }
+    }
+}
+
+std::vector<size_t> TagDb::find_items(const std::vector<Glib::ustring> &file_paths) const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    std::unordered_map<std::string, size_t> item_indices;
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        item_indices[items[idx].get_file_path().raw()] = idx;
+    }
+
+    std::vector<size_t> result;
+    for (const Glib::ustring &file_path : file_paths) {
+        // remove the prefix from the argument
+        if (file_path.raw().compare(0, prefix.size(), prefix) != 0) { continue; }
+
+        auto iter = item_indices.find(file_path.raw().substr(prefix.size()));
+        if (iter != item_indices.end()) {
+            result.push_back(iter->second);
+        }
+    }
+
+    return result;
+}
+
+std::vector<Glib::ustring> TagDb::query(const std::set<Glib::ustring> &tags_include,
+                                        const std::set<Glib::ustring> &tags_exclude) const
+{
+    switch(query_type) {
+        case TagDb::QueryType::OR: return query_or(tags_include, tags_exclude);
+        case TagDb::QueryType::AND: return query_and(tags_include, tags_exclude);
+        default: return query_or(tags_include, tags_exclude);
+    }
+}
+
+std::vector<Glib::ustring> TagDb::query_or(const std::set<Glib::ustring> &tags_include,
+                                           const std::set<Glib::ustring> &tags_exclude) const
+{
+    return query_items(*item_storage, *metadata_storage, prefix, TagDb::QueryType::OR, tags_include, tags_exclude, rules, nullptr, nullptr);
+}
+
+std::vector<Glib::ustring> TagDb::query_and(const std::set<Glib::ustring> &tags_include,
+                                           const std::set<Glib::ustring> &tags_exclude) const
+{
+    return query_items(*item_storage, *metadata_storage, prefix, TagDb::QueryType::AND, tags_include, tags_exclude, rules, nullptr, nullptr);
+}
+
+std::vector<Glib::ustring> TagDb::query_items(const std::vector<TagDb::Item> &items,
+                                              const MetadataTable &metadata,
+                                              const std::string &prefix,
+                                              TagDb::QueryType query_type,
+                                              const std::set<Glib::ustring> &query_include,
+                                              const std::set<Glib::ustring> &query_exclude,
+                                              const std::shared_ptr<const TagRules> &rules,
+                                              const std::atomic<bool> *cancelled,
+                                              TagDb::QueryCounts *counts)
+{
+    std::vector<Glib::ustring> result;
+    std::vector<const TagDb::Item *> result_items;
+
+    // aliases are resolved once for the query, the tags that
+    // rules imply are already stored with the items
+    std::set<Glib::ustring> tags_include = query_include;
+    std::set<Glib::ustring> tags_exclude = query_exclude;
+    std::vector<MetadataTable::Predicate> predicates_include;
+    std::vector<MetadataTable::Predicate> predicates_exclude;
+    split_predicates(tags_include, predicates_include);
+    split_predicates(tags_exclude, predicates_exclude);
+    tags_include = rules->resolve(tags_include);
+    tags_exclude = rules->resolve(tags_exclude);
+
+    // the tags and the implied tags of an item, merged in order
+    std::vector<const Glib::ustring *> all_tags;
+
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        // checking every item would slow down the loop
+        if (cancelled != nullptr && idx % 4096 == 0 && *cancelled) {
+            return result;
+        }
+
+        // if item is tagged with a tag that is
+        // excluded from the query, then continue
+        // the loop, ignoring the item
+        const TagDb::Item &item = items[idx];
+        if (item.matches(tags_exclude) || metadata.matches_any(item.metadata_row, predicates_exclude)) {
             continue;
         }
 
-        if (item.is_tagged(tags_include)) {
-            for (const Glib::ustring &tag : item.get_tags()) {
-                input_tags.push_back(tag);
+        bool in_result = matches_included(item, metadata, query_type, tags_include, predicates_include);
+        if (in_result) {
+            result_items.push_back(&item);
+        }
+
+        // no included tag brings an item into the result
+        // if it does not match the included predicates
+        if (counts != nullptr && (in_result || predicates_include.empty() ||
+                                  metadata.matches_all(item.metadata_row, predicates_include)))
+        {
+            // the tags of a namespace are next to each other, so
+            // each namespace of the item is counted once
+            const std::vector<const Glib::ustring *> *item_tags = &item.tags;
+            if (item.implied_tags.size() > 0) {
+                all_tags.clear();
+                std::merge(item.tags.begin(), item.tags.end(),
+                           item.implied_tags.begin(), item.implied_tags.end(),
+                           std::back_inserter(all_tags), TagDictionary::less);
+                item_tags = &all_tags;
+            }
+
+            std::string_view last_namespace;
+            for (const Glib::ustring *tag : *item_tags) {
+                std::pair<size_t, size_t> &tag_counts = counts->tags[tag];
+                if (!in_result) {
+                    tag_counts.second += 1;
+                    continue;
+                }
+                tag_counts.first += 1;
+
+                std::string_view tag_namespace = TagDictionary::get_namespace(
+                        std::string_view(tag->data(), tag->bytes()));
+                if (!tag_namespace.empty() && tag_namespace != last_namespace) {
+                    counts->namespaces[tag_namespace] += 1;
+                    last_namespace = tag_namespace;
+                }
             }
         }
     }
 
-    // count the occurances of each tag
-    std::map<Glib::ustring, size_t> map_tag_count;
-    for (const Glib::ustring &tag : input_tags) {
-        if (map_tag_count.count(tag) == 0) {
-            map_tag_count[tag] = 1;
+    if (counts != nullptr) {
+        counts->query_type = query_type;
+        counts->result_count = result_items.size();
+        counts->rules = rules;
+        counts->predicates_only = !predicates_include.empty() && tags_include.empty();
+    }
+
+    // sort the items before extracting the file paths
+    // the items sort favorites first by their overloaded operator
+    std::sort(result_items.begin(), result_items.end(),
+              [](const TagDb::Item *a, const TagDb::Item *b){ return (*a) < (*b); });
+
+    if (cancelled != nullptr && *cancelled) { return result; }
+
+    result.reserve(result_items.size());
+    for (const TagDb::Item *item : result_items) {
+        result.push_back(prefix + item->get_file_path());
+    }
+
+    return result;
+}
+
+void TagDb::split_predicates(std::set<Glib::ustring> &tags,
+                             std::vector<MetadataTable::Predicate> &predicates)
+{
+    for (auto iter = tags.begin(); iter != tags.end();) {
+        MetadataTable::Predicate predicate;
+        if (MetadataTable::Predicate::parse(iter->raw(), predicate)) {
+            predicates.push_back(predicate);
+            iter = tags.erase(iter);
         }
         else {
-            map_tag_count.find(tag)->second += 1;
+            ++iter;
         }
     }
+}
+
+bool TagDb::matches_included(const TagDb::Item &item,
+                             const MetadataTable &metadata,
+                             TagDb::QueryType query_type,
+                             const std::set<Glib::ustring> &tags_include,
+                             const std::vector<MetadataTable::Predicate> &predicates_include)
+{
+    // predicates narrow the result in both types of queries, without
+    // any included tags they select from all items that are not excluded
+    if (predicates_include.size() > 0) {
+        if (!metadata.matches_all(item.metadata_row, predicates_include)) { return false; }
+        if (tags_include.empty()) { return true; }
+    }
 
-    // copy the contents of the map into a vector for sorting
-    std::vector<std::tuple<Glib::ustring, size_t>> vec_tag_count;
-    for (const auto &item : map_tag_count) {
-        vec_tag_count.push_back(
-                std::tuple<Glib::ustring, size_t>(std::make_pair(item.first, item.second)));
+    if (query_type == TagDb::QueryType::AND) {
+        // if item is tagged with all tags that are
+        // included in the query, it is in the result
+        for (const Glib::ustring &tag : tags_include) {
+            if (!item.matches(tag)) { return false; }
+        }
+        return true;
+    }
+
+    // if item is tagged with a tag that is
+    // included in the query, it is in the result
+    return item.matches(tags_include);
+}
+
+std::vector<Glib::ustring> TagDb::QuerySnapshot::query(const std::set<Glib::ustring> &tags_include,
+                                                       const std::set<Glib::ustring> &tags_exclude,
+                                                       const std::atomic<bool> *cancelled,
+                                                       TagDb::QueryCounts *counts) const
+{
+    return query_items(*items, *metadata, prefix, query_type, tags_include, tags_exclude, rules, cancelled, counts);
+}
+
+std::vector<Glib::ustring> TagDb::QuerySnapshot::suggestions(const std::set<Glib::ustring> &tags_include,
+                                                             const std::atomic<bool> *cancelled) const
+{
+    return suggest_tags(*items, default_excluded_tags, tags_include, cancelled);
+}
+
+std::shared_ptr<const TagDb::QuerySnapshot> TagDb::get_query_snapshot() const {
+    if (!query_snapshot) {
+        std::shared_ptr<QuerySnapshot> snapshot = std::make_shared<QuerySnapshot>();
+        snapshot->items = item_storage;
+        snapshot->metadata = metadata_storage;
+        snapshot->prefix = prefix;
+        snapshot->query_type = query_type;
+        snapshot->rules = rules;
+        snapshot->default_excluded_tags = default_excluded_tags;
+        query_snapshot = snapshot;
+    }
+
+    return query_snapshot;
+}
+
+std::vector<Glib::ustring> TagDb::suggestions(const std::set<Glib::ustring> &tags_include) const {
+    return suggest_tags(*item_storage, default_excluded_tags, tags_include, nullptr);
+}
+
+std::vector<Glib::ustring> TagDb::suggest_tags(const std::vector<TagDb::Item> &items,
+                                               const std::set<Glib::ustring> &default_excluded_tags,
+                                               const std::set<Glib::ustring> &tags_include,
+                                               const std::atomic<bool> *cancelled)
+{
+    // perform a query and count each tag every time it occurs in an item
+    std::unordered_map<const Glib::ustring *, size_t> map_tag_count;
+    for (size_t idx = 0; idx < items.size(); idx++) {
+        if (cancelled != nullptr && idx % 4096 == 0 && *cancelled) {
+            return std::vector<Glib::ustring>();
+        }
+
+        // for exclude use the default exclude list
+        const TagDb::Item &item = items[idx];
+        if (item.is_tagged(default_excluded_tags)) {
+            continue;
+        }
+
+        if (item.is_tagged(tags_include)) {
+            for (const Glib::ustring *tag : item.tags) {
+                map_tag_count[tag] += 1;
+            }
+        }
     }
 
+    // copy the contents of the map into a vector for sorting
+    std::vector<std::tuple<const Glib::ustring *, size_t>> vec_tag_count(
+            map_tag_count.begin(), map_tag_count.end());
+
     // sort based on occurances so that the most frequent is at the beginning of the list
+    // ties are broken by the tag itself to keep the order stable
     std::sort(vec_tag_count.begin(), vec_tag_count.end(),
-            [](const std::tuple<Glib::ustring, size_t> &a, const std::tuple<Glib::ustring, size_t> &b)
-            { return std::get<1>(a) > std::get<1>(b); });
-
+            [](const std::tuple<const Glib::ustring *, size_t> &a,
+               const std::tuple<const Glib::ustring *, size_t> &b)
+            {
+                if (std::get<1>(a) != std::get<1>(b)) { return std::get<1>(a) > std::get<1>(b); }
+                return TagDictionary::less(std::get<0>(a), std::get<0>(b));
+            });
 
     // copy the sorted data into the final result
     std::vector<Glib::ustring> result;
     for (const auto &item : vec_tag_count) {
-        result.push_back(std::get<0>(item));
+        result.push_back(*std::get<0>(item));
     }
 
     return result;
 }
 
-std::set<Glib::ustring> TagDb::parse_tags(const std::string &line) {
-    std::set<Glib::ustring> result;
+std::vector<Glib::ustring> TagDb::find_similar(const Glib::ustring &file_path, int max_distance) const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    std::vector<Glib::ustring> result;
+
+    // remove the prefix from the argument
+    if (file_path.raw().compare(0, prefix.size(), prefix) != 0) { return result; }
+    std::string rel_path = file_path.raw().substr(prefix.size());
 
-    // strip whitespaces from the right
-    std::string str = line.substr(0, line.find_last_not_of("\t \n") + 1);
+    auto iter = std::find_if(items.begin(), items.end(),
+            [&rel_path](const TagDb::Item &item){ return item.get_file_path().raw() == rel_path; });
+    if (iter == items.end() || !iter->perceptual_hashed) { return result; }
 
-    // strip final comma if there
-    if (str[str.size() - 1] == ',') {
-        str.erase(str.size() - 1);
+    for (const SimilarityIndex::Match &match : get_similarity_index().find(iter->perceptual_hash, max_distance)) {
+        result.push_back(prefix + items[match.id].get_file_path());
     }
 
-    size_t last = 0;
-    size_t current = 0;
+    return result;
+}
+
+std::vector<Glib::ustring> TagDb::visual_suggestions(uint64_t perceptual_hash,
+                                                     size_t neighbour_count,
+                                                     int max_distance) const
+{
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    std::vector<SimilarityIndex::Match> neighbours =
+            get_similarity_index().find(perceptual_hash, max_distance, neighbour_count);
 
-    while ((current = str.find(',', last)) != std::string::npos) {
-        result.insert(str.substr(last, current - last));
-        last = current + 1;
+    // every neighbour votes for its tags, weighted by how many bits match
+    std::unordered_map<const Glib::ustring *, int> map_tag_weight;
+    for (const SimilarityIndex::Match &match : neighbours) {
+        const TagDb::Item &item = items[match.id];
+
+        // for exclude use the default exclude list
+        if (item.is_tagged(default_excluded_tags)) {
+            continue;
+        }
+
+        for (const Glib::ustring *tag : item.tags) {
+            map_tag_weight[tag] += 64 - match.distance;
+        }
+    }
+
+    std::vector<std::pair<const Glib::ustring *, int>> vec_tag_weight(
+            map_tag_weight.begin(), map_tag_weight.end());
+
+    // ties are broken by the tag itself to keep the order stable
+    std::sort(vec_tag_weight.begin(), vec_tag_weight.end(),
+            [](const std::pair<const Glib::ustring *, int> &a,
+               const std::pair<const Glib::ustring *, int> &b)
+            {
+                if (a.second != b.second) { return a.second > b.second; }
+                return TagDictionary::less(a.first, b.first);
+            });
+
+    std::vector<Glib::ustring> result;
+    for (const auto &entry : vec_tag_weight) {
+        result.push_back(*entry.first);
     }
-    result.insert(str.substr(last, current - last));
 
     return result;
 }
 
-bool TagDb::str_starts_with(const std::string &str, const std::string &argument) {
-    return str.rfind(argument, 0) == 0;
+const SimilarityIndex &TagDb::get_similarity_index() const {
+    const std::vector<TagDb::Item> &items = *item_storage;
+
+    // the index is built on first use after the items changed
+    if (!similarity_index_valid) {
+        similarity_index.clear();
+        similarity_index.reserve(items.size());
+        for (size_t idx = 0; idx < items.size(); idx++) {
+            if (items[idx].perceptual_hashed) {
+                similarity_index.add(idx, items[idx].perceptual_hash);
+            }
+        }
+        similarity_index_valid = true;
+    }
+
+    return similarity_index;
 }
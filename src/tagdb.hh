@@ -4,16 +4,30 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <utility>
+#include <tuple>
+#include <unordered_map>
+#include <unordered_set>
+#include <string_view>
 #include <fstream>
+#include <memory>
+#include <atomic>
+#include <cstdint>
 #include <exception>
 
 // gtkmm
 #include <glibmm/ustring.h>
 
+// project
+#include "similarityindex.hh"
+#include "tagrules.hh"
+#include "metadatatable.hh"
+
 class TagDb {
     public: class Item {
         public:
             friend class TagDb;
+            friend class DbFile;
             enum class Type { image, video };
 
             Item(const Glib::ustring &file_path, const Type &type);
@@ -27,7 +41,11 @@ class TagDb {
             void set_tags(const std::set<Glib::ustring> &tags);
             bool is_tagged(const Glib::ustring &tag) const;
             bool is_tagged(const std::set<Glib::ustring> &tags) const;
-            const std::set<Glib::ustring> &get_tags() const;
+            std::set<Glib::ustring> get_tags() const;
+
+            // whether the item has the tag itself or through a TagRules rule
+            bool matches(const Glib::ustring &tag) const;
+            bool matches(const std::set<Glib::ustring> &tags) const;
 
             void set_file_path(const Glib::ustring &file_path);
             const Glib::ustring &get_file_path() const;
@@ -38,6 +56,19 @@ class TagDb {
             bool get_favorite() const;
             void set_favorite(const bool &favorite);
 
+            // content hash of the item's file, see ContentHash
+            bool has_hash() const;
+            uint64_t get_hash() const;
+            void set_hash(uint64_t hash);
+
+            // perceptual hash of the item's image, see ImageHash
+            bool has_perceptual_hash() const;
+            uint64_t get_perceptual_hash() const;
+            void set_perceptual_hash(uint64_t hash);
+
+            // whether the metadata of the item's file was read, see MetadataReader
+            bool has_metadata() const;
+
             bool operator< (const Item &other) const;
             friend std::ostream& operator<<(std::ostream &os, Item item);
 
@@ -45,8 +76,21 @@ class TagDb {
         private:
             Glib::ustring file_path;
             Type type;
-            std::set<Glib::ustring> tags;
+
+            // interned tags sorted by TagDictionary::less
+            std::vector<const Glib::ustring *> tags;
+
+            // tags added by the rules of the database, sorted the same way
+            // they are not written to the file
+            std::vector<const Glib::ustring *> implied_tags;
             bool favorite;
+            bool hashed;
+            uint64_t hash;
+            bool perceptual_hashed;
+            uint64_t perceptual_hash;
+
+            // row in the metadata table of the database or MetadataTable::npos
+            size_t metadata_row;
     };
 
     public: class FileParseException : public std::exception {
@@ -76,31 +120,253 @@ class TagDb {
             Glib::ustring file_path;
     };
 
+    // changes made to files on disk outside of the program
+    // all paths are relative to the database prefix
+    public: class PathChanges {
+        public:
+            // pairs of old and new paths of files and directories
+            std::vector<std::pair<std::string, std::string>> moved;
+            std::vector<std::pair<std::string, std::string>> moved_dirs;
+
+            std::vector<std::string> removed;
+            std::vector<std::string> removed_dirs;
+    };
+
     public: enum class QueryType { OR, AND };
 
+    // a saved query shown as an album, the items in its result are kept
+    // up to date as the database changes, so opening it is a lookup
+    public: class Album {
+        public:
+            Album();
+
+            Glib::ustring name;
+            std::set<Glib::ustring> tags_include;
+            std::set<Glib::ustring> tags_exclude;
+            QueryType query_type;
+    };
+
+    // a namespace of tags in the result of a query, see TagDictionary::get_namespace
+    public: class Facet {
+        public:
+            std::string name;
+
+            // results with any tag of the namespace
+            size_t count;
+
+            // tags of the namespace with their number of results, most common first
+            std::vector<std::pair<Glib::ustring, size_t>> values;
+    };
+
+    // how the number of results of a query changes when a tag is
+    // added to its included or its excluded tags, for every tag at once
+    public: class QueryCounts {
+        public:
+            friend class TagDb;
+            QueryCounts();
+
+            size_t get_result_count() const;
+            size_t count_with_included(const Glib::ustring &tag) const;
+            size_t count_with_excluded(const Glib::ustring &tag) const;
+
+            // namespaces by their number of results, most common first
+            std::vector<Facet> get_facets(size_t max_values) const;
+
+        private:
+            QueryType query_type;
+            size_t result_count;
+            std::shared_ptr<const TagRules> rules;
+
+            // results with a tag of each namespace, the keys point into
+            // the interned tags, which are never freed
+            std::unordered_map<std::string_view, size_t> namespaces;
+
+            // items that are not excluded and carry the tag, split into
+            // those in the result of the query and those outside of it,
+            // which only count if they match the included predicates
+            std::unordered_map<const Glib::ustring *, std::pair<size_t, size_t>> tags;
+
+            // the query has included predicates but no included tags, so its
+            // result is every matching item and any included tag narrows it
+            bool predicates_only;
+    };
+
+    // the items as they were when it was taken, queries on it can run on
+    // another thread while the database keeps changing, the items, their
+    // metadata and the rules are shared with the database until it changes them
+    public: class QuerySnapshot {
+        public:
+            friend class TagDb;
+
+            // same as TagDb::query, returns nothing once cancelled is set
+            // the counts are filled in the same pass over the items if given
+            std::vector<Glib::ustring> query(const std::set<Glib::ustring> &tags_include,
+                                             const std::set<Glib::ustring> &tags_exclude,
+                                             const std::atomic<bool> *cancelled = nullptr,
+                                             QueryCounts *counts = nullptr) const;
+
+            // same as TagDb::suggestions, returns nothing once cancelled is set
+            std::vector<Glib::ustring> suggestions(const std::set<Glib::ustring> &tags_include,
+                                                   const std::atomic<bool> *cancelled = nullptr) const;
+
+        private:
+            std::shared_ptr<const std::vector<Item>> items;
+            std::shared_ptr<const MetadataTable> metadata;
+            std::string prefix;
+            QueryType query_type;
+            std::shared_ptr<const TagRules> rules;
+            std::set<Glib::ustring> default_excluded_tags;
+    };
+
+    // an album together with the items in its result
+    private: class AlbumIndex {
+        public:
+            Album album;
+
+            // the tags of the album with aliases resolved
+            // and its metadata predicates taken out of them
+            std::set<Glib::ustring> tags_include;
+            std::set<Glib::ustring> tags_exclude;
+            std::vector<MetadataTable::Predicate> predicates_include;
+            std::vector<MetadataTable::Predicate> predicates_exclude;
+
+            // relative paths keyed like query results are ordered, favorites
+            // first and then by the collation key of the file name
+            std::set<std::tuple<bool, std::string, std::string>> items;
+    };
+
     // main class implementation
     public:
         TagDb();
 
         void create_database(const std::string &db_file_path);
         void load_from_file(const std::string &db_file_path);
+        void clear();
+
+        // loading a file in steps, such as the sections of a DbLoader
+        void begin_load(const std::string &db_file_path);
+        void load_items(std::vector<Item> &new_items,
+                        const std::set<Glib::ustring> &new_directories,
+                        const std::set<Glib::ustring> &new_excluded_tags,
+                        const std::vector<TagRules::Rule> &new_rules,
+                        const std::vector<Album> &new_albums,
+                        const MetadataTable &new_metadata);
         void write_to_file() const;
 
+        // whether the items changed in ways that are only written with the
+        // next write, such as perceptual hashes and metadata
+        bool has_unwritten_changes() const;
+
         void add_item(Item &item);
+
+        // adds or replaces several items with a single write
+        void apply_batch(const std::vector<Item> &new_items);
+
+        // stores content hashes for items, the pairs are relative paths and hashes
+        void set_hashes(const std::vector<std::pair<Glib::ustring, uint64_t>> &hashes);
+
+        // same for perceptual hashes, they are found while browsing and
+        // arrive with every shown batch of previews, so the file is not
+        // written here, see has_unwritten_changes
+        void set_perceptual_hashes(const std::vector<std::pair<Glib::ustring, uint64_t>> &hashes);
+
+        // stores the metadata of items by their relative paths, the records
+        // arrive in many small batches, so the file is not written here
+        void set_metadata(const std::vector<std::pair<std::string, MetadataTable::Record>> &records);
+
+        // relative paths of the images whose metadata was not read yet
+        std::vector<std::string> get_items_without_metadata() const;
+
+        // returns false if the item has no metadata
+        bool get_metadata(const Glib::ustring &file_path, MetadataTable::Record &record) const;
+
+        // bulk tag edits, each is a single pass over the items and a single write
+        // renaming a tag is merging it into a new one, the default excluded
+        // tags are updated as well, the file paths are absolute like in queries
+        // return the number of changed items
+        size_t merge_tags(const std::set<Glib::ustring> &tags, const Glib::ustring &target);
+        size_t add_tags_to_items(const std::vector<Glib::ustring> &file_paths,
+                                 const std::set<Glib::ustring> &tags);
+
+        // items that would lose their last tag are not changed,
+        // their relative paths are appended to skipped
+        size_t remove_tags_from_items(const std::vector<Glib::ustring> &file_paths,
+                                      const std::set<Glib::ustring> &tags,
+                                      std::vector<std::string> &skipped);
+
+        // adds different tags to each item, such as imported keywords, the
+        // pairs are relative paths and tags, paths without an item are skipped
+        size_t add_item_tags(const std::vector<std::pair<std::string, std::set<Glib::ustring>>> &item_tags);
         void edit_item(const Item &item);
         void delete_item(const Glib::ustring &file_path, bool delete_file);
 
+        // changes the relative paths of items, the pairs are old and new paths,
+        // old paths without an item are not moved and are appended to skipped
+        size_t move_items(const std::vector<std::pair<Glib::ustring, Glib::ustring>> &moves,
+                          std::vector<std::string> &skipped);
+
+        // applies moved files, then moved directories, paths that do not
+        // belong to any item are ignored, an item whose file was replaced
+        // by a moved one is removed
+        // items of removed files keep their tags, their relative paths are
+        // appended to missing, as with the missing items of FsScanner
+        // returns whether any item changed, in which case the file is written
+        bool apply_path_changes(const PathChanges &changes, std::vector<std::string> &missing);
+
         void set_directories(const std::set<Glib::ustring> &dirs);
         void set_default_excluded_tags(const std::set<Glib::ustring> &exclude_tags);
         void set_query_type(QueryType query_type);
+        QueryType get_query_type() const;
+
+        // replaces the implication and alias rules, only the items
+        // with tags that reach a changed rule are updated
+        void set_rules(const std::set<TagRules::Rule> &rules);
+        const TagRules &get_rules() const;
+
+        // saved queries, setting an album replaces the one with the same name
+        void set_album(const Album &album);
+        void remove_album(const Glib::ustring &name);
+        std::vector<Album> get_albums() const;
+
+        // the names of the albums with their number of items, in the order
+        // they were added, the sizes are kept and not counted
+        std::vector<std::pair<Glib::ustring, size_t>> get_album_sizes() const;
+
+        // absolute paths of the items in the album, ordered like the
+        // result of its query, or nothing if there is no such album
+        std::vector<Glib::ustring> get_album_items(const Glib::ustring &name) const;
 
         std::set<Glib::ustring> get_all_tags() const;
+
+        // every tag with the number of items it is on, sorted by tag
+        std::vector<std::pair<Glib::ustring, size_t>> get_tag_counts() const;
+
+        // tags whose number of items changed since the last call, with the new
+        // number, tags that are no longer on any item are returned with zero
+        std::vector<std::pair<Glib::ustring, size_t>> take_tag_changes();
         const std::set<Glib::ustring> &get_default_excluded_tags() const;
         const std::set<Glib::ustring> &get_directories() const;
         const std::string &get_prefix() const;
-        const std::set<Glib::ustring> &get_tags_for_item(const Glib::ustring &file_path) const;
+        const std::string &get_db_file_path() const;
+        std::set<Glib::ustring> get_tags_for_item(const Glib::ustring &file_path) const;
+
+        // relative paths and tags of the items with the given absolute
+        // paths, in a single pass, paths without an item are skipped
+        std::vector<std::pair<std::string, std::set<Glib::ustring>>> get_tags_for_items(
+                const std::vector<Glib::ustring> &file_paths) const;
         const Item &get_item(const Glib::ustring &file_path) const;
+        std::vector<Glib::ustring> get_item_paths() const;
 
+        // relative paths of items by the content hash of their file
+        // the index is built on first use after the items changed
+        const std::unordered_map<uint64_t, std::string> &get_hash_index() const;
+
+        // content hashes by the relative path of the item, for items that have one
+        std::unordered_map<std::string, uint64_t> get_item_hashes() const;
+
+        // included and excluded tags may be metadata predicates such as
+        // width>=1920, see MetadataTable::Predicate, an item must match
+        // every included predicate and no excluded one
         std::vector<Glib::ustring> query(const std::set<Glib::ustring> &tags_include,
                                          const std::set<Glib::ustring> &tags_exclude) const;
         std::vector<Glib::ustring> query_or(const std::set<Glib::ustring> &tags_include,
@@ -108,18 +374,114 @@ class TagDb {
         std::vector<Glib::ustring> query_and(const std::set<Glib::ustring> &tags_include,
                                              const std::set<Glib::ustring> &tags_exclude) const;
 
-        std::vector<Glib::ustring> suggestions(const std::set<Glib::ustring> &tags_include);
+        std::vector<Glib::ustring> suggestions(const std::set<Glib::ustring> &tags_include) const;
+
+        // the snapshot is taken on first use after the database changed
+        // and shared until the next change
+        std::shared_ptr<const QuerySnapshot> get_query_snapshot() const;
+
+        // items that look like the given one, the most similar first
+        // the file paths are absolute like in queries, the item itself is included
+        // returns nothing if the item has no perceptual hash yet
+        std::vector<Glib::ustring> find_similar(const Glib::ustring &file_path, int max_distance = 10) const;
+
+        // the most common tags of the items that look most like an image
+        // with the given perceptual hash, nearer items count more
+        std::vector<Glib::ustring> visual_suggestions(uint64_t perceptual_hash,
+                                                      size_t neighbour_count = 16,
+                                                      int max_distance = 20) const;
 
     private:
+        // the query shared by TagDb and QuerySnapshot
+        static std::vector<Glib::ustring> query_items(const std::vector<Item> &items,
+                                                      const MetadataTable &metadata,
+                                                      const std::string &prefix,
+                                                      QueryType query_type,
+                                                      const std::set<Glib::ustring> &tags_include,
+                                                      const std::set<Glib::ustring> &tags_exclude,
+                                                      const std::shared_ptr<const TagRules> &rules,
+                                                      const std::atomic<bool> *cancelled,
+                                                      QueryCounts *counts);
+
+        // the suggestions shared by TagDb and QuerySnapshot
+        static std::vector<Glib::ustring> suggest_tags(const std::vector<Item> &items,
+                                                       const std::set<Glib::ustring> &default_excluded_tags,
+                                                       const std::set<Glib::ustring> &tags_include,
+                                                       const std::atomic<bool> *cancelled);
+
+        // takes the metadata predicates out of the tags of a query
+        static void split_predicates(std::set<Glib::ustring> &tags,
+                                     std::vector<MetadataTable::Predicate> &predicates);
+
+        // whether an item that is not excluded is in the result of a
+        // query, the tags have their aliases resolved already
+        static bool matches_included(const Item &item,
+                                     const MetadataTable &metadata,
+                                     QueryType query_type,
+                                     const std::set<Glib::ustring> &tags_include,
+                                     const std::vector<MetadataTable::Predicate> &predicates_include);
+
+        // the items and the metadata for changing them, each
+        // copied first if a snapshot still uses it
+        std::vector<Item> &get_mutable_items();
+        MetadataTable &get_mutable_metadata();
+
+        // indices of the given absolute paths that belong to items
+        std::vector<size_t> find_items(const std::vector<Glib::ustring> &file_paths) const;
+        void invalidate_indices();
+        const SimilarityIndex &get_similarity_index() const;
+
+        // rules without writing the file, as found while loading
+        void apply_rules(const std::set<TagRules::Rule> &new_rules);
+        void update_implied_tags(Item &item) const;
+
+        // albums without writing the file, as found while loading
+        void add_albums(const std::vector<Album> &new_albums);
+
+        // resolves the tags of the album again, returns whether they changed
+        bool resolve_album(AlbumIndex &index) const;
+        void fill_album(AlbumIndex &index) const;
+        static std::tuple<bool, std::string, std::string> get_album_key(const Item &item);
+
+        // adds or removes a tag or the tags of an item from the tag counts
+        void count_tag(const Glib::ustring *tag, bool added);
+        void count_tags(const Item &item, bool added);
+
+        // adds or removes an item from the tag counts and the albums, every
+        // change of the tags of an item is surrounded by these two calls
+        void index_item(const Item &item, bool added);
+        void index_album_item(const Item &item, bool added);
+
         // member variables
         std::string db_file_path;
+        mutable bool unwritten_changes;
         std::string prefix;
-        std::vector<Item> items;
+        std::shared_ptr<std::vector<Item>> item_storage;
         std::set<Glib::ustring> directories;
         std::set<Glib::ustring> default_excluded_tags;
         QueryType query_type;
+        std::vector<AlbumIndex> albums;
+
+        // replaced as a whole when the rules change, so snapshots and
+        // query counts share them instead of copying
+        std::shared_ptr<const TagRules> rules;
+
+        // metadata of the items, rows are only added and
+        // the file is written without the unused ones
+        std::shared_ptr<MetadataTable> metadata_storage;
+
+        // number of items every tag is on, kept up to date by every change
+        std::unordered_map<const Glib::ustring *, size_t> tag_counts;
+        std::unordered_set<const Glib::ustring *> changed_tags;
+
+        // cache for get_hash_index
+        mutable std::unordered_map<uint64_t, std::string> hash_index;
+        mutable bool hash_index_valid;
+
+        // perceptual hashes by item index, for find_similar
+        mutable SimilarityIndex similarity_index;
+        mutable bool similarity_index_valid;
 
-        // functions
-        std::set<Glib::ustring> parse_tags(const std::string &str);
-        bool str_starts_with(const std::string &str, const std::string &argument);
+        // cache for get_query_snapshot, reset by every change to the items
+        mutable std::shared_ptr<const QuerySnapshot> query_snapshot;
 };
@@ -0,0 +1,65 @@
+// standard library
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+
+// project
+#include "tagdictionary.hh"
+
+namespace {
+    // the keys are views into the stored strings, which never move
+    // because they are owned through pointers and never erased
+    using Storage = std::unordered_map<std::string_view, std::unique_ptr<const Glib::ustring>>;
+
+    Storage &get_storage() {
+        static Storage storage;
+        return storage;
+    }
+
+    std::mutex &get_mutex() {
+        static std::mutex mutex;
+        return mutex;
+    }
+}
+
+const Glib::ustring *TagDictionary::intern(std::string_view tag) {
+    std::lock_guard<std::mutex> lock(get_mutex());
+    Storage &storage = get_storage();
+
+    auto iter = storage.find(tag);
+    if (iter != storage.end()) {
+        return iter->second.get();
+    }
+
+    auto stored = std::make_unique<const Glib::ustring>(tag.data(), tag.data() + tag.size());
+    const Glib::ustring *result = stored.get();
+    storage.emplace(std::string_view(result->data(), result->bytes()), std::move(stored));
+
+    return result;
+}
+
+const Glib::ustring *TagDictionary::find(std::string_view tag) {
+    std::lock_guard<std::mutex> lock(get_mutex());
+    Storage &storage = get_storage();
+
+    auto iter = storage.find(tag);
+    if (iter != storage.end()) {
+        return iter->second.get();
+    }
+
+    return nullptr;
+}
+
+bool TagDictionary::less(const Glib::ustring *a, const Glib::ustring *b) {
+    return a->raw() < b->raw();
+}
+
+std::string_view TagDictionary::get_namespace(std::string_view tag) {
+    // a colon at either end does not separate a name and a value
+    size_t pos = tag.find(':');
+    if (pos == std::string_view::npos || pos == 0 || pos + 1 == tag.size()) {
+        return std::string_view();
+    }
+
+    return tag.substr(0, pos);
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+// standard library
+#include <string_view>
+
+// gtkmm
+#include <glibmm/ustring.h>
+
+// Every distinct tag is stored exactly once for the lifetime of the program.
+// Items refer to the stored tags by pointer, so two interned tags are equal
+// if and only if their pointers are equal. Interning is thread safe.
+class TagDictionary {
+    public:
+        // returns the stored tag, adding it first if it was not seen before
+        static const Glib::ustring *intern(std::string_view tag);
+
+        // returns the stored tag or nullptr if it was never interned
+        static const Glib::ustring *find(std::string_view tag);
+
+        // strict weak ordering of interned tags by their bytes
+        static bool less(const Glib::ustring *a, const Glib::ustring *b);
+
+        // the namespace of a tag like person:alice, which is the part before
+        // the first colon, empty if the tag has no namespace
+        // the tags of a namespace are next to each other in the order of less
+        static std::string_view get_namespace(std::string_view tag);
+};
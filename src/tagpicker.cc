@@ -1,11 +1,17 @@
 // project
 #include "tagpicker.hh"
 
+namespace {
+    // tags shown for every namespace in the facets
+    const size_t max_facet_values = 20;
+}
+
 TagPicker::TagPicker()
 :
     TagPickerBase(true),
     tags_exclude(ItemList::Type::INSIDE),
-    tags_current_item(ItemList::Type::OUTSIDE_WITH_EXCLUDE)
+    tags_current_item(ItemList::Type::OUTSIDE_WITH_EXCLUDE),
+    setting_query(false)
 {
     // filter setup
     filter_box.set_orientation(Gtk::Orientation::HORIZONTAL);
@@ -23,6 +29,8 @@ TagPicker::TagPicker()
     lbl_tags.set_markup("<span weight=\"bold\" size=\"large\">Include</span>");
     lbl_tags_exclude.set_markup("<span weight=\"bold\" size=\"large\">Exclude</span>");
     lbl_tags_current_item.set_markup("<span weight=\"bold\" size=\"large\">Image tags</span>");
+    lbl_facets.set_markup("<span weight=\"bold\" size=\"large\">Facets</span>");
+    lbl_albums.set_markup("<span weight=\"bold\" size=\"large\">Albums</span>");
 
     // button setup
     btn_reload_default_exclude.set_icon_name("view-refresh-symbolic");
@@ -38,6 +46,12 @@ TagPicker::TagPicker()
     append(sep2);
     append(lbl_tags_current_item);
     append(tags_current_item);
+    append(sep3);
+    append(lbl_facets);
+    append(facets);
+    append(sep4);
+    append(lbl_albums);
+    append(albums);
 
     set_allow_create_new_tag(false);
 
@@ -54,6 +68,8 @@ TagPicker::TagPicker()
             sigc::mem_fun(*this, &TagPicker::on_signal_add));
     tags_current_item.signal_exclude().connect(
             sigc::mem_fun(*this, &TagPicker::on_signal_exclude));
+    facets.signal_tag_chosen().connect(
+            sigc::mem_fun(*this, &TagPicker::on_signal_add));
 }
 
 TagQuery TagPicker::get_current_query() const {
@@ -65,12 +81,48 @@ void TagPicker::add_excluded_tag(const Glib::ustring &tag) {
 }
 
 void TagPicker::set_current_item_tags(const std::set<Glib::ustring> &tags) {
-    tags_current_item.clear();
-    for (const Glib::ustring &tag : tags) {
-        tags_current_item.append(tag);
+    tags_current_item.set_content(tags);
+}
+
+void TagPicker::set_result_counts(std::shared_ptr<const TagDb::QueryCounts> counts) {
+    ResultCountFunction get_counts;
+    if (counts) {
+        get_counts = [counts](const Glib::ustring &tag, ResultCounts &result){
+            result.included = counts->count_with_included(tag);
+            result.excluded = counts->count_with_excluded(tag);
+            return true;
+        };
+    }
+
+    tags_current_item.set_counts(get_counts);
+    set_completion_counts(get_counts);
+
+    if (counts) {
+        facets.set_facets(counts->get_facets(max_facet_values));
+    }
+    else {
+        facets.clear();
     }
 }
 
+void TagPicker::set_query(const TagQuery &query, TagDb::QueryType query_type) {
+    // neither setting the lists nor the filter notifies
+    setting_query = true;
+    tags.set_content(query.tags_include);
+    tags_exclude.set_content(query.tags_exclude);
+    if (query_type == TagDb::QueryType::AND) {
+        chk_filter_and.set_active(true);
+    }
+    else {
+        chk_filter_or.set_active(true);
+    }
+    setting_query = false;
+}
+
+void TagPicker::set_albums(const std::vector<std::pair<Glib::ustring, size_t>> &albums) {
+    this->albums.set_albums(albums);
+}
+
 void TagPicker::clear_excluded_tags() {
     tags_exclude.clear();
 }
@@ -91,7 +143,21 @@ Glib::SignalProxy<void ()> TagPicker::signal_reload_default_exclude_required() {
     return btn_reload_default_exclude.signal_clicked();
 }
 
+sigc::signal<void (const Glib::ustring &)> TagPicker::signal_album_chosen() {
+    return albums.signal_album_chosen();
+}
+
+sigc::signal<void (const Glib::ustring &)> TagPicker::signal_album_saved() {
+    return albums.signal_album_saved();
+}
+
+sigc::signal<void (const Glib::ustring &)> TagPicker::signal_album_removed() {
+    return albums.signal_album_removed();
+}
+
 void TagPicker::on_filter_toggled() {
+    if (setting_query) { return; }
+
     if (chk_filter_or.get_active()) {
         private_filter_toggled.emit(TagDb::QueryType::OR);
     }
@@ -2,6 +2,7 @@
 
 // standard library
 #include <set>
+#include <memory>
 
 // gtkmm
 #include <gtkmm/box.h>
@@ -13,6 +14,8 @@
 // project
 #include "tagutils.hh"
 #include "tagdb.hh"
+#include "facetpanel.hh"
+#include "albumpanel.hh"
 
 class TagPicker : public TagPickerBase {
     public:
@@ -24,10 +27,22 @@ class TagPicker : public TagPickerBase {
         void clear_excluded_tags();
         void clear_current_item_tags();
 
+        // shows how many results adding or excluding a tag would give
+        // for the image tags and the completions, and the namespaces
+        // of the tags in the result
+        void set_result_counts(std::shared_ptr<const TagDb::QueryCounts> counts);
+
+        // shows the query of an album without notifying about the change
+        void set_query(const TagQuery &query, TagDb::QueryType query_type);
+        void set_albums(const std::vector<std::pair<Glib::ustring, size_t>> &albums);
+
         // signal forwarding
         sigc::signal<void (TagDb::QueryType)> signal_filter_toggled();
         sigc::signal<void (TagQuery)> signal_query_changed();
         Glib::SignalProxy<void ()> signal_reload_default_exclude_required();
+        sigc::signal<void (const Glib::ustring &)> signal_album_chosen();
+        sigc::signal<void (const Glib::ustring &)> signal_album_saved();
+        sigc::signal<void (const Glib::ustring &)> signal_album_removed();
 
     private:
         // widgets
@@ -40,9 +55,18 @@ class TagPicker : public TagPickerBase {
         ItemList tags_exclude;
         Gtk::Label lbl_tags_current_item;
         ItemList tags_current_item;
+        Gtk::Label lbl_facets;
+        FacetPanel facets;
+        Gtk::Label lbl_albums;
+        AlbumPanel albums;
 
         Gtk::Separator sep1;
         Gtk::Separator sep2;
+        Gtk::Separator sep3;
+        Gtk::Separator sep4;
+
+        // set while the query of an album is shown
+        bool setting_query;
 
         // signal handlers
         void on_filter_toggled();
@@ -0,0 +1,144 @@
+// standard library
+#include <algorithm>
+
+// project
+#include "tagrules.hh"
+#include "tagdictionary.hh"
+
+namespace {
+    Glib::ustring strip(const Glib::ustring &text) {
+        size_t begin = text.find_first_not_of("\t \n");
+        if (begin == Glib::ustring::npos) { return Glib::ustring(); }
+        size_t end = text.find_last_not_of("\t \n");
+        return text.substr(begin, end - begin + 1);
+    }
+}
+
+// TagRules::Rule implementation
+Glib::ustring TagRules::Rule::to_string() const {
+    return tag + (type == Type::IMPLIES ? " => " : " = ") + target;
+}
+
+bool TagRules::Rule::parse(const Glib::ustring &text, TagRules::Rule &rule) {
+    // tags cannot contain commas, the file stores rules as tag lists
+    if (text.find(',') != Glib::ustring::npos) { return false; }
+
+    size_t pos = text.find("=>");
+    size_t length = 2;
+    rule.type = Type::IMPLIES;
+    if (pos == Glib::ustring::npos) {
+        pos = text.find('=');
+        length = 1;
+        rule.type = Type::ALIAS;
+    }
+    if (pos == Glib::ustring::npos) { return false; }
+
+    rule.tag = strip(text.substr(0, pos));
+    rule.target = strip(text.substr(pos + length));
+    return !rule.tag.empty() && !rule.target.empty() && rule.tag.raw() != rule.target.raw();
+}
+
+bool TagRules::Rule::operator< (const TagRules::Rule &other) const {
+    if (type != other.type) { return type < other.type; }
+    if (tag.raw() != other.tag.raw()) { return tag.raw() < other.tag.raw(); }
+    return target.raw() < other.target.raw();
+}
+
+bool TagRules::Rule::operator== (const TagRules::Rule &other) const {
+    return type == other.type && tag.raw() == other.tag.raw() && target.raw() == other.target.raw();
+}
+
+// TagRules implementation
+void TagRules::set_rules(const std::set<TagRules::Rule> &rules) {
+    this->rules = rules;
+    implications.clear();
+    reverse_implications.clear();
+    aliases.clear();
+
+    for (const Rule &rule : rules) {
+        const Glib::ustring *tag = TagDictionary::intern(rule.tag.raw());
+        const Glib::ustring *target = TagDictionary::intern(rule.target.raw());
+        implications[tag].push_back(target);
+        reverse_implications[target].push_back(tag);
+
+        if (rule.type == Rule::Type::ALIAS) {
+            aliases[rule.tag.raw()] = rule.target;
+        }
+    }
+}
+
+const std::set<TagRules::Rule> &TagRules::get_rules() const {
+    return rules;
+}
+
+bool TagRules::empty() const {
+    return rules.empty();
+}
+
+Glib::ustring TagRules::resolve(const Glib::ustring &tag) const {
+    // aliases of aliases are followed, a cycle ends where it started
+    Glib::ustring result = tag;
+    for (size_t steps = 0; steps < aliases.size(); steps++) {
+        auto iter = aliases.find(result.raw());
+        if (iter == aliases.end() || iter->second.raw() == tag.raw()) { break; }
+        result = iter->second;
+    }
+
+    return result;
+}
+
+std::set<Glib::ustring> TagRules::resolve(const std::set<Glib::ustring> &tags) const {
+    if (aliases.empty()) { return tags; }
+
+    std::set<Glib::ustring> result;
+    for (const Glib::ustring &tag : tags) {
+        result.insert(resolve(tag));
+    }
+
+    return result;
+}
+
+std::vector<const Glib::ustring *> TagRules::get_implied(const std::vector<const Glib::ustring *> &tags) const {
+    std::vector<const Glib::ustring *> result;
+    if (implications.empty()) { return result; }
+
+    std::unordered_set<const Glib::ustring *> visited(tags.begin(), tags.end());
+    std::vector<const Glib::ustring *> stack(tags.begin(), tags.end());
+    while (!stack.empty()) {
+        const Glib::ustring *tag = stack.back();
+        stack.pop_back();
+
+        auto iter = implications.find(tag);
+        if (iter == implications.end()) { continue; }
+
+        for (const Glib::ustring *implied : iter->second) {
+            if (visited.insert(implied).second) {
+                result.push_back(implied);
+                stack.push_back(implied);
+            }
+        }
+    }
+
+    std::sort(result.begin(), result.end(), TagDictionary::less);
+    return result;
+}
+
+std::unordered_set<const Glib::ustring *> TagRules::get_sources(const std::vector<const Glib::ustring *> &tags) const {
+    std::unordered_set<const Glib::ustring *> result(tags.begin(), tags.end());
+    std::vector<const Glib::ustring *> stack(tags.begin(), tags.end());
+    while (!stack.empty()) {
+        const Glib::ustring *tag = stack.back();
+        stack.pop_back();
+
+        auto iter = reverse_implications.find(tag);
+        if (iter == reverse_implications.end()) { continue; }
+
+        for (const Glib::ustring *source : iter->second) {
+            if (result.insert(source).second) {
+                stack.push_back(source);
+            }
+        }
+    }
+
+    return result;
+}
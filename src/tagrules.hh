@@ -0,0 +1,61 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <vector>
+#include <set>
+#include <unordered_map>
+#include <unordered_set>
+
+// gtkmm
+#include <glibmm/ustring.h>
+
+// Rules between tags that are kept in the database header. An implication
+// like cat => animal gives every item tagged cat the tag animal as well, an
+// alias like kitty = cat makes kitty another name for cat. The database
+// stores the tags that rules add with every item, so queries do not have
+// to expand them, and only the items whose tags reach a changed rule are
+// updated when the rules change.
+class TagRules {
+    public: class Rule {
+        public:
+            enum class Type { IMPLIES, ALIAS };
+
+            Type type;
+            Glib::ustring tag;
+            Glib::ustring target;
+
+            // the form rules are entered in, cat => animal or kitty = cat
+            Glib::ustring to_string() const;
+            static bool parse(const Glib::ustring &text, Rule &rule);
+
+            bool operator< (const Rule &other) const;
+            bool operator== (const Rule &other) const;
+    };
+
+    public:
+        void set_rules(const std::set<Rule> &rules);
+        const std::set<Rule> &get_rules() const;
+        bool empty() const;
+
+        // the tag an alias stands for, or the tag itself
+        Glib::ustring resolve(const Glib::ustring &tag) const;
+        std::set<Glib::ustring> resolve(const std::set<Glib::ustring> &tags) const;
+
+        // interned tags the rules add to the given ones, without the
+        // given ones, sorted by TagDictionary::less
+        std::vector<const Glib::ustring *> get_implied(const std::vector<const Glib::ustring *> &tags) const;
+
+        // interned tags that reach any of the given tags through the rules,
+        // including the given tags, these are the tags whose implied tags
+        // change when rules of the given tags change
+        std::unordered_set<const Glib::ustring *> get_sources(const std::vector<const Glib::ustring *> &tags) const;
+
+    private:
+        std::set<Rule> rules;
+
+        // an alias implies the tag it stands for
+        std::unordered_map<const Glib::ustring *, std::vector<const Glib::ustring *>> implications;
+        std::unordered_map<const Glib::ustring *, std::vector<const Glib::ustring *>> reverse_implications;
+        std::unordered_map<std::string, Glib::ustring> aliases;
+};
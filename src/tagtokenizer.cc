@@ -0,0 +1,36 @@
+// project
+#include "tagtokenizer.hh"
+
+TagTokenizer::TagTokenizer(std::string_view line)
+:
+    line(line),
+    pos(0)
+{
+    // strip whitespaces from the right
+    size_t last_char = line.find_last_not_of("\t \n");
+    if (last_char == std::string_view::npos) {
+        this->line = std::string_view();
+    }
+    else {
+        this->line = line.substr(0, last_char + 1);
+    }
+}
+
+bool TagTokenizer::next(std::string_view &tag) {
+    while (pos < line.size()) {
+        size_t comma = line.find(',', pos);
+        if (comma == std::string_view::npos) {
+            comma = line.size();
+        }
+
+        tag = line.substr(pos, comma - pos);
+        pos = comma + 1;
+
+        // skip empty tags, such as the one after a final comma
+        if (tag.size() != 0) {
+            return true;
+        }
+    }
+
+    return false;
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+// standard library
+#include <string_view>
+
+// Splits a comma separated list of tags, such as the contents of a
+// [tags] or [exclude] line, into slices of the original string.
+// Whitespace at the end of the line, a trailing comma and empty
+// tags are skipped. Nothing is copied or allocated.
+class TagTokenizer {
+    public:
+        TagTokenizer(std::string_view line);
+
+        // stores the next tag in the argument and returns true
+        // returns false once there are no tags left
+        bool next(std::string_view &tag);
+
+    private:
+        std::string_view line;
+        size_t pos;
+};
@@ -1,5 +1,15 @@
 // project
 #include "tagutils.hh"
+#include "metadatatable.hh"
+
+namespace {
+    // the completion popup only ever shows this many tags
+    const size_t max_completions = 10;
+
+    Glib::ustring format_counts(const ResultCounts &counts) {
+        return "<small>" + std::to_string(counts.included) + " / " + std::to_string(counts.excluded) + "</small>";
+    }
+}
 
 // TagQuery implementation
 TagQuery::TagQuery(std::set<Glib::ustring> tags_to_include,
@@ -50,8 +60,12 @@ ItemOutsideQuery::ItemOutsideQuery(const Glib::ustring &tag_name, bool exclude_b
         exclude.set_halign(Gtk::Align::END);
     }
 
+    counts.add_css_class("dim-label");
+    counts.set_margin_start(10);
+
     set_orientation(Gtk::Orientation::HORIZONTAL);
     append(name);
+    append(counts);
     append(add);
     if (exclude_button) {
         append(exclude);
@@ -62,6 +76,18 @@ void ItemOutsideQuery::set_tag(const Glib::ustring &tag) {
     name.set_text(tag);
 }
 
+void ItemOutsideQuery::set_counts(const ResultCounts &counts) {
+    this->counts.set_markup(format_counts(counts));
+    add.set_tooltip_text("Include: " + std::to_string(counts.included) + " results");
+    exclude.set_tooltip_text("Exclude: " + std::to_string(counts.excluded) + " results");
+}
+
+void ItemOutsideQuery::clear_counts() {
+    counts.set_text("");
+    add.set_tooltip_text("");
+    exclude.set_tooltip_text("");
+}
+
 Glib::ustring ItemOutsideQuery::get_text() const {
     return name.get_text();
 }
@@ -78,13 +104,21 @@ ItemList::ItemList(ItemList::Type type)
 :
     type(type)
 {
-    // box setup
-    box.set_orientation(Gtk::Orientation::VERTICAL);
+    // rows are created by the factory when they become visible
+    model = Gtk::StringList::create(std::vector<Glib::ustring>());
+    factory = Gtk::SignalListItemFactory::create();
+    factory->signal_setup().connect(sigc::mem_fun(*this, &ItemList::on_setup_row));
+    factory->signal_bind().connect(sigc::mem_fun(*this, &ItemList::on_bind_row));
+    factory->signal_unbind().connect(sigc::mem_fun(*this, &ItemList::on_unbind_row));
+
+    // view setup, the rows are not selectable
+    view.set_model(Gtk::NoSelection::create(model));
+    view.set_factory(factory);
 
     // scrolled window setup
     set_propagate_natural_height(true);
     set_propagate_natural_width(true);
-    set_child(box);
+    set_child(view);
 }
 
 void ItemList::append(const Glib::ustring &text) {
@@ -97,35 +131,7 @@ void ItemList::append(const Glib::ustring &text) {
     // register item in string based database
     items.insert(text);
 
-    // create the widget representing the tag and connect its signal
-    if (type == ItemList::Type::INSIDE) {
-        std::unique_ptr<ItemInQuery> tag_widget = std::make_unique<ItemInQuery>(text);
-        tag_widget->signal_remove().connect(
-                sigc::bind(sigc::mem_fun(*this, &ItemList::on_signal_remove), text));
-
-        box.append(*tag_widget);
-        widgets.push_back(std::move(tag_widget));
-    }
-
-    else if (type == ItemList::Type::OUTSIDE) {
-        std::unique_ptr<ItemOutsideQuery> tag_widget = std::make_unique<ItemOutsideQuery>(text);
-        tag_widget->signal_add().connect(
-                sigc::bind(sigc::mem_fun(*this, &ItemList::on_signal_add), text));
-
-        box.append(*tag_widget);
-        widgets.push_back(std::move(tag_widget));
-    }
-
-    else if (type == ItemList::Type::OUTSIDE_WITH_EXCLUDE) {
-        std::unique_ptr<ItemOutsideQuery> tag_widget = std::make_unique<ItemOutsideQuery>(text, true);
-        tag_widget->signal_add().connect(
-                sigc::bind(sigc::mem_fun(*this, &ItemList::on_signal_add), text));
-        tag_widget->signal_exclude().connect(
-                sigc::bind(sigc::mem_fun(*this, &ItemList::on_signal_exclude), text));
-
-        box.append(*tag_widget);
-        widgets.push_back(std::move(tag_widget));
-    }
+    model->append(text);
 }
 
 void ItemList::append_and_notify(const Glib::ustring &text) {
@@ -136,10 +142,33 @@ void ItemList::append_and_notify(const Glib::ustring &text) {
 }
 void ItemList::clear() {
     items.clear();
-    for (std::unique_ptr<Gtk::Widget> &item : widgets) {
-        box.remove(*item);
+
+    // a single change of the model instead of one per row
+    model->splice(0, model->get_n_items(), std::vector<Glib::ustring>());
+}
+
+void ItemList::set_content(const std::set<Glib::ustring> &texts) {
+    items.clear();
+
+    std::vector<Glib::ustring> rows;
+    rows.reserve(texts.size());
+    for (const Glib::ustring &text : texts) {
+        // same checks as append, the set has no duplicates
+        if (text.size() == 1) { continue; }
+        items.insert(text);
+        rows.push_back(text);
+    }
+
+    model->splice(0, model->get_n_items(), rows);
+}
+
+void ItemList::set_counts(ResultCountFunction get_counts) {
+    this->get_counts = get_counts;
+
+    // rows that are not shown get their counts when they are bound
+    for (Gtk::ListItem *list_item : bound_rows) {
+        update_row_counts(list_item, get_row_text(list_item));
     }
-    widgets.clear();
 }
 
 const std::set<Glib::ustring> &ItemList::get_content() const {
@@ -151,7 +180,7 @@ bool ItemList::contains(const Glib::ustring &item) const {
 }
 
 size_t ItemList::size() const {
-    return widgets.size();
+    return model->get_n_items();
 }
 
 sigc::signal<void (const std::set<Glib::ustring> &)> ItemList::signal_contents_changed() {
@@ -166,20 +195,72 @@ sigc::signal<void (const Glib::ustring &)> ItemList::signal_exclude() {
     return private_exclude;
 }
 
-void ItemList::on_signal_remove(const Glib::ustring &text) {
-    // find tag widget
-    size_t idx;
-    for (idx = 0; idx < widgets.size(); idx++) {
-        if (static_cast<ItemInQuery *>(widgets[idx].get())->get_text() == text ) {
-            break;
+Glib::ustring ItemList::get_row_text(const Gtk::ListItem *list_item) const {
+    return model->get_string(list_item->get_position());
+}
+
+void ItemList::update_row_counts(Gtk::ListItem *list_item, const Glib::ustring &text) {
+    // tags in the query have no counts
+    if (type == ItemList::Type::INSIDE) { return; }
+
+    ItemOutsideQuery *tag_widget = static_cast<ItemOutsideQuery *>(list_item->get_child());
+    ResultCounts counts;
+    if (get_counts && get_counts(text, counts)) {
+        tag_widget->set_counts(counts);
+    }
+    else {
+        tag_widget->clear_counts();
+    }
+}
+
+void ItemList::on_setup_row(const Glib::RefPtr<Gtk::ListItem> &list_item) {
+    // the buttons look up the tag of the row when they are clicked,
+    // since the row widget is reused for other tags
+    // the list item owns the widget, so the raw pointer stays valid
+    Gtk::ListItem *item = list_item.get();
+
+    if (type == ItemList::Type::INSIDE) {
+        ItemInQuery *tag_widget = Gtk::make_managed<ItemInQuery>("");
+        tag_widget->signal_remove().connect(
+                sigc::bind(sigc::mem_fun(*this, &ItemList::on_signal_remove), item));
+        list_item->set_child(*tag_widget);
+    }
+    else {
+        bool exclude_button = type == ItemList::Type::OUTSIDE_WITH_EXCLUDE;
+        ItemOutsideQuery *tag_widget = Gtk::make_managed<ItemOutsideQuery>("", exclude_button);
+        tag_widget->signal_add().connect(
+                sigc::bind(sigc::mem_fun(*this, &ItemList::on_signal_add), item));
+        if (exclude_button) {
+            tag_widget->signal_exclude().connect(
+                    sigc::bind(sigc::mem_fun(*this, &ItemList::on_signal_exclude), item));
         }
+        list_item->set_child(*tag_widget);
+    }
+}
+
+void ItemList::on_bind_row(const Glib::RefPtr<Gtk::ListItem> &list_item) {
+    Glib::ustring text = get_row_text(list_item.get());
+
+    if (type == ItemList::Type::INSIDE) {
+        static_cast<ItemInQuery *>(list_item->get_child())->set_tag(text);
+    }
+    else {
+        static_cast<ItemOutsideQuery *>(list_item->get_child())->set_tag(text);
     }
 
-    // remove the widget from the box
-    box.remove(*(widgets[idx].get()));
+    bound_rows.insert(list_item.get());
+    update_row_counts(list_item.get(), text);
+}
+
+void ItemList::on_unbind_row(const Glib::RefPtr<Gtk::ListItem> &list_item) {
+    bound_rows.erase(list_item.get());
+}
 
-    // also remove it from the owning vector
-    widgets.erase(widgets.begin() + idx);
+void ItemList::on_signal_remove(const Gtk::ListItem *list_item) {
+    // the row knows its position, no need to search for the tag
+    guint position = list_item->get_position();
+    Glib::ustring text = model->get_string(position);
+    model->remove(position);
 
     // remove the item's text from the text based database
     items.erase(text);
@@ -187,32 +268,39 @@ void ItemList::on_signal_remove(const Glib::ustring &text) {
     private_contents_changed.emit(items);
 }
 
-void ItemList::on_signal_add(const Glib::ustring &text) {
-    private_add.emit(text);
+void ItemList::on_signal_add(const Gtk::ListItem *list_item) {
+    private_add.emit(get_row_text(list_item));
 }
 
-void ItemList::on_signal_exclude(const Glib::ustring &text) {
-    private_exclude.emit(text);
+void ItemList::on_signal_exclude(const Gtk::ListItem *list_item) {
+    private_exclude.emit(get_row_text(list_item));
 }
 
 // TagPickerBase implementation
 TagPickerBase::TagPickerBase(bool label_below_entry)
 :
     tags(ItemList::Type::INSIDE),
+    context_generation(0),
     allow_create_new_tag(true)
 {
     // setup smart pointers with data
     completer = Gtk::EntryCompletion::create();
+    completion_store = Gtk::ListStore::create(list_model);
 
-    // configure completion
+    // configure completion, the model only holds the matches
+    // of the current text and is filled when the text changes
     entry.set_completion(completer);
+    completer->set_model(completion_store);
     completer->set_text_column(list_model.tag);
+    completer->pack_end(count_renderer, false);
+    completer->add_attribute(count_renderer.property_markup(), list_model.counts);
     completer->set_match_func(sigc::mem_fun(*this, &TagPickerBase::on_completion_match));
     completer->signal_match_selected().connect(
             sigc::mem_fun(*this, &TagPickerBase::on_match_selected), false);
 
     // the entry's activate signal is not implemented in glibmm 4.6, use C API instead
     g_signal_connect(entry.gobj(), "activate", G_CALLBACK(tag_editor_on_entry_activate), this);
+    entry.signal_changed().connect(sigc::mem_fun(*this, &TagPickerBase::on_entry_changed));
 
     // box setup (self)
     if (label_below_entry) {
@@ -234,8 +322,24 @@ const std::set<Glib::ustring> &TagPickerBase::get_content() const {
     return tags.get_content();
 }
 
-void TagPickerBase::set_completer_model(Glib::RefPtr<Gtk::ListStore> completer_list) {
-    completer->set_model(completer_list);
+void TagPickerBase::set_completion_index(std::shared_ptr<const CompletionIndex> completion_index) {
+    this->completion_index = completion_index;
+    update_context_ranks();
+}
+
+void TagPickerBase::set_completion_context(const std::vector<Glib::ustring> &ranked_tags) {
+    context_tags = ranked_tags;
+    update_context_ranks();
+}
+
+void TagPickerBase::set_completion_counts(ResultCountFunction get_counts) {
+    get_completion_counts = get_counts;
+
+    for (auto row : completion_store->children()) {
+        ResultCounts counts;
+        bool found = get_completion_counts && get_completion_counts(row.get_value(list_model.tag), counts);
+        row[list_model.counts] = found ? format_counts(counts) : Glib::ustring();
+    }
 }
 
 void TagPickerBase::set_allow_create_new_tag(bool allow_create_new_tag) {
@@ -281,6 +385,7 @@ void tag_editor_on_entry_activate(GtkEntry *c_entry, gpointer data) {
 
     // get the inserted text
     Glib::ustring text = entry->get_text();
+    MetadataTable::Predicate predicate;
 
     // exit if string contains only whitespaces
     // or if it contains a comma
@@ -300,16 +405,20 @@ void tag_editor_on_entry_activate(GtkEntry *c_entry, gpointer data) {
         tag_picker->add_tag_notify(text);
         entry->get_buffer()->delete_text(0, -1);
     }
-    // else search tag database for a match on text first
-    else {
-        for (auto item : tag_picker->completer->get_model()->children()) {
-            if (text == item.get_value(tag_picker->list_model.tag)) {
-                // in case of a match add it to included tags
-                tag_picker->add_tag_notify(text);
-
-                //clear the entry's text buffer
-                entry->get_buffer()->delete_text(0, -1);
-            }
+    // metadata predicates such as width>=1920 are not tags, but queries accept them
+    else if (MetadataTable::Predicate::parse(text.raw(), predicate)) {
+        tag_picker->add_tag_notify(text);
+        entry->get_buffer()->delete_text(0, -1);
+    }
+    // else only accept tags that are in the database
+    else if (tag_picker->completion_index) {
+        size_t id = tag_picker->completion_index->find_typed_id(text);
+        if (id != CompletionIndex::npos) {
+            // add the tag as it is spelled in the database
+            tag_picker->add_tag_notify(tag_picker->completion_index->get_tag(id));
+
+            //clear the entry's text buffer
+            entry->get_buffer()->delete_text(0, -1);
         }
     }
 }
@@ -339,13 +448,43 @@ bool TagPickerBase::on_match_selected(const Gtk::TreeModel::iterator &iter) {
     return true;
 }
 
-bool TagPickerBase::on_completion_match(const Glib::ustring &key,
-                                        const Gtk::TreeModel::const_iterator &iter) {
-    Glib::ustring filter_str = iter->get_value(list_model.tag);
+void TagPickerBase::update_context_ranks() {
+    context_ranks.clear();
+    context_generation = 0;
+    if (!completion_index) { return; }
+
+    for (size_t rank = 0; rank < context_tags.size(); rank++) {
+        size_t id = completion_index->find_id(context_tags[rank]);
+        if (id != CompletionIndex::npos) {
+            context_ranks.emplace(id, rank);
+        }
+    }
+    context_generation = completion_index->get_generation();
+}
+
+void TagPickerBase::on_entry_changed() {
+    completion_store->clear();
+    if (!completion_index) { return; }
+
+    // the ids of the context are those of the index it was ranked against
+    if (context_generation != completion_index->get_generation()) {
+        update_context_ranks();
+    }
+
+    for (size_t id : completion_index->find(entry.get_text(), max_completions, &context_ranks)) {
+        auto row = *(completion_store->append());
+        row[list_model.tag] = completion_index->get_tag(id);
+        row[list_model.id] = id;
 
-    if (filter_str.lowercase().find(key.lowercase()) != Glib::ustring::npos) {
-        return true;
+        ResultCounts counts;
+        if (get_completion_counts && get_completion_counts(completion_index->get_tag(id), counts)) {
+            row[list_model.counts] = format_counts(counts);
+        }
     }
+}
 
-    return false;
+bool TagPickerBase::on_completion_match(const Glib::ustring &key,
+                                        const Gtk::TreeModel::const_iterator &iter) {
+    // the model only holds matches
+    return true;
 }
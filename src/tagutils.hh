@@ -4,6 +4,10 @@
 #include <vector>
 #include <set>
 #include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <functional>
 
 // gtkmm
 #include <gtkmm/box.h>
@@ -13,10 +17,19 @@
 #include <gtkmm/entry.h>
 #include <gtkmm/entrycompletion.h>
 #include <gtkmm/liststore.h>
+#include <gtkmm/listview.h>
+#include <gtkmm/listitem.h>
+#include <gtkmm/stringlist.h>
+#include <gtkmm/noselection.h>
+#include <gtkmm/signallistitemfactory.h>
+#include <gtkmm/cellrenderertext.h>
 #include <glibmm/refptr.h>
 #include <glibmm/ustring.h>
 #include <sigc++/signal.h>
 
+// project
+#include "completionindex.hh"
+
 // the data structure provided by this widget
 // contains a dynamic list for both tags to include
 // and exclude from a search in the database
@@ -28,6 +41,17 @@ class TagQuery {
         std::set<Glib::ustring> tags_exclude;
 };
 
+// the number of results the query would have with a tag
+// added to its included or to its excluded tags
+class ResultCounts {
+    public:
+        size_t included;
+        size_t excluded;
+};
+
+// looks up the counts of a tag, returns false if there are none
+typedef std::function<bool (const Glib::ustring &, ResultCounts &)> ResultCountFunction;
+
 // class to be placed in a vertical Gtk::Box showing tags
 // that are either currently in the query or are currently
 // being excluded from the query.
@@ -51,17 +75,22 @@ class ItemOutsideQuery : public Gtk::Box {
     public:
         ItemOutsideQuery(const Glib::ustring &tag_name, bool exclude_button = false);
         void set_tag(const Glib::ustring &tag);
+        void set_counts(const ResultCounts &counts);
+        void clear_counts();
         Glib::ustring get_text() const;
         Glib::SignalProxy<void()> signal_add();
         Glib::SignalProxy<void()> signal_exclude();
 
     private:
         Gtk::Label name;
+        Gtk::Label counts;
         Gtk::Button add;
         Gtk::Button exclude;
 };
 
 // class to hold a dynamic list of ItemInQuery or ItemOutsideQuery widgets
+// the tags are kept in a string list shown by a list view, which only
+// creates widgets for the visible rows and reuses them while scrolling
 class ItemList : public Gtk::ScrolledWindow {
     public: enum class Type { INSIDE, OUTSIDE, OUTSIDE_WITH_EXCLUDE };
     public:
@@ -70,6 +99,13 @@ class ItemList : public Gtk::ScrolledWindow {
         void append(const Glib::ustring &text);
         void append_and_notify(const Glib::ustring &text);
         void clear();
+
+        // replaces all items with a single change of the model
+        void set_content(const std::set<Glib::ustring> &texts);
+
+        // counts shown next to tags outside of the query, the
+        // visible rows are updated right away, others when shown
+        void set_counts(ResultCountFunction get_counts);
         const std::set<Glib::ustring> &get_content() const;
         bool contains(const Glib::ustring &item) const;
         size_t size() const;
@@ -82,18 +118,30 @@ class ItemList : public Gtk::ScrolledWindow {
 
     private:
         Type type;
-        Gtk::Box box;
-        std::vector<std::unique_ptr<Gtk::Widget>> widgets;
+        Gtk::ListView view;
+        Glib::RefPtr<Gtk::StringList> model;
+        Glib::RefPtr<Gtk::SignalListItemFactory> factory;
         std::set<Glib::ustring> items;
 
+        // rows that currently show a tag
+        std::unordered_set<Gtk::ListItem *> bound_rows;
+        ResultCountFunction get_counts;
+
         sigc::signal<void (const std::set<Glib::ustring> &)> private_contents_changed;
         sigc::signal<void (const Glib::ustring &)> private_add;
         sigc::signal<void (const Glib::ustring &)> private_exclude;
 
+        // functions
+        Glib::ustring get_row_text(const Gtk::ListItem *list_item) const;
+        void update_row_counts(Gtk::ListItem *list_item, const Glib::ustring &text);
+
         // signal handlers
-        void on_signal_remove(const Glib::ustring &text);
-        void on_signal_add(const Glib::ustring &text);
-        void on_signal_exclude(const Glib::ustring &text);
+        void on_setup_row(const Glib::RefPtr<Gtk::ListItem> &list_item);
+        void on_bind_row(const Glib::RefPtr<Gtk::ListItem> &list_item);
+        void on_unbind_row(const Glib::RefPtr<Gtk::ListItem> &list_item);
+        void on_signal_remove(const Gtk::ListItem *list_item);
+        void on_signal_add(const Gtk::ListItem *list_item);
+        void on_signal_exclude(const Gtk::ListItem *list_item);
 };
 
 void tag_editor_on_entry_activate(GtkEntry *c_entry, gpointer data);
@@ -104,15 +152,32 @@ class TagPickerBase : public Gtk::Box {
         public:
             ListModel() {
                 add(tag);
+                add(id);
+                add(counts);
             }
             Gtk::TreeModelColumn<Glib::ustring> tag;
+
+            // markup of the result counts, empty without counts
+            Gtk::TreeModelColumn<Glib::ustring> counts;
+
+            // the id of the tag in the CompletionIndex
+            Gtk::TreeModelColumn<size_t> id;
     };
 
     public:
         TagPickerBase(bool label_below_entry = false);
 
         const std::set<Glib::ustring> &get_content() const;
-        void set_completer_model(Glib::RefPtr<Gtk::ListStore> completer_list);
+        // the index is shared between pickers, each fills its own small
+        // completion model with the best matches of what was typed
+        void set_completion_index(std::shared_ptr<const CompletionIndex> completion_index);
+
+        // tags ranked by how well they fit, such as the suggestions for
+        // the tags already entered, they complete before other tags
+        void set_completion_context(const std::vector<Glib::ustring> &ranked_tags);
+
+        // counts shown next to the completions
+        void set_completion_counts(ResultCountFunction get_counts);
         void set_allow_create_new_tag(bool allow_create_new_tag);
         bool get_allow_create_new_tag() const;
         void set_label_markup(const Glib::ustring &markup);
@@ -141,11 +206,24 @@ class TagPickerBase : public Gtk::Box {
         Gtk::Entry entry;
         Glib::RefPtr<Gtk::EntryCompletion> completer;
         ListModel list_model;
+        Glib::RefPtr<Gtk::ListStore> completion_store;
+        Gtk::CellRendererText count_renderer;
+        std::shared_ptr<const CompletionIndex> completion_index;
+        ResultCountFunction get_completion_counts;
+
+        // ranks of the context tags by their id in the index
+        std::vector<Glib::ustring> context_tags;
+        std::unordered_map<size_t, size_t> context_ranks;
+        size_t context_generation;
 
         // bool whether creating new tags is allowed with this widget
         bool allow_create_new_tag;
 
+        // functions
+        void update_context_ranks();
+
         // signal handlers
+        void on_entry_changed();
         bool on_match_selected(const Gtk::TreeModel::iterator &iter);
         bool on_completion_match(const Glib::ustring &key,
                                  const Gtk::TreeModel::const_iterator &iter);
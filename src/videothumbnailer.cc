@@ -0,0 +1,121 @@
+// standard library
+#include <cstring>
+#include <mutex>
+
+// GStreamer
+#include <gst/gst.h>
+#include <gst/app/gstappsink.h>
+
+// project
+#include "videothumbnailer.hh"
+
+namespace {
+    // the playbin flag for decoding only the video stream,
+    // GstPlayFlags is not part of the public headers
+    const guint play_flag_video = 1 << 0;
+
+    // a file that takes longer than this to preroll is taken as broken
+    const GstClockTime state_timeout = 5 * GST_SECOND;
+
+    // the still is taken this far into the video, past black intros
+    const double still_position = 0.1;
+
+    // frames are converted to packed RGB with square pixels
+    const char *sink_description = "videoconvert ! videoscale ! "
+                                   "appsink name=sink caps=video/x-raw,format=RGB,pixel-aspect-ratio=1/1";
+
+    std::once_flag init_flag;
+
+    bool wait_for_preroll(GstElement *pipeline) {
+        return gst_element_get_state(pipeline, nullptr, nullptr, state_timeout) == GST_STATE_CHANGE_SUCCESS;
+    }
+
+    // returns nullptr if no frame was prerolled
+    GstSample *pull_still(GstElement *pipeline, GstElement *sink) {
+        gst_element_set_state(pipeline, GST_STATE_PAUSED);
+        if (!wait_for_preroll(pipeline)) { return nullptr; }
+
+        // videos without a known duration keep their first frame
+        gint64 duration = 0;
+        if (gst_element_query_duration(pipeline, GST_FORMAT_TIME, &duration) && duration > 0) {
+            // the keyframe before the position is decoded instead
+            // of every frame between it and the position
+            GstSeekFlags flags = GstSeekFlags(GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT | GST_SEEK_FLAG_SNAP_BEFORE);
+            if (gst_element_seek_simple(pipeline, GST_FORMAT_TIME, flags, gint64(duration * still_position))) {
+                if (!wait_for_preroll(pipeline)) { return nullptr; }
+            }
+        }
+
+        return gst_app_sink_try_pull_preroll(GST_APP_SINK(sink), state_timeout);
+    }
+
+    // returns an empty pointer if the sample is not a complete RGB frame
+    Glib::RefPtr<Gdk::Pixbuf> create_pixbuf(GstSample *sample) {
+        Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+
+        GstCaps *caps = gst_sample_get_caps(sample);
+        GstBuffer *buffer = gst_sample_get_buffer(sample);
+        if (caps == nullptr || buffer == nullptr || gst_caps_get_size(caps) == 0) { return pixbuf; }
+
+        int width = 0;
+        int height = 0;
+        GstStructure *structure = gst_caps_get_structure(caps, 0);
+        if (!gst_structure_get_int(structure, "width", &width) ||
+            !gst_structure_get_int(structure, "height", &height) ||
+            width <= 0 || height <= 0)
+        {
+            return pixbuf;
+        }
+
+        GstMapInfo map;
+        if (!gst_buffer_map(buffer, &map, GST_MAP_READ)) { return pixbuf; }
+
+        // rows of packed RGB are padded to four bytes
+        size_t stride = GST_ROUND_UP_4(width * 3);
+        if (map.size >= stride * height) {
+            pixbuf = Gdk::Pixbuf::create(Gdk::Colorspace::RGB, false, 8, width, height);
+            for (int y = 0; y < height; y++) {
+                std::memcpy(pixbuf->get_pixels() + y * pixbuf->get_rowstride(), map.data + y * stride, width * 3);
+            }
+        }
+
+        gst_buffer_unmap(buffer, &map);
+        return pixbuf;
+    }
+}
+
+Glib::RefPtr<Gdk::Pixbuf> VideoThumbnailer::create_thumbnail(const std::string &file_path) {
+    std::call_once(init_flag, [](){ gst_init(nullptr, nullptr); });
+
+    gchar *uri = g_filename_to_uri(file_path.c_str(), nullptr, nullptr);
+    if (uri == nullptr) { throw ThumbnailException(); }
+
+    GstElement *pipeline = gst_element_factory_make("playbin", nullptr);
+    GstElement *video_sink = gst_parse_bin_from_description(sink_description, TRUE, nullptr);
+    if (pipeline == nullptr || video_sink == nullptr) {
+        g_free(uri);
+        if (pipeline != nullptr) { gst_object_unref(pipeline); }
+        if (video_sink != nullptr) { gst_object_unref(video_sink); }
+        throw ThumbnailException();
+    }
+
+    // the playbin owns the sink bin afterwards
+    GstElement *sink = gst_bin_get_by_name(GST_BIN(video_sink), "sink");
+    g_object_set(pipeline, "uri", uri, "video-sink", video_sink, "flags", play_flag_video, nullptr);
+    g_free(uri);
+
+    GstSample *sample = pull_still(pipeline, sink);
+
+    Glib::RefPtr<Gdk::Pixbuf> pixbuf;
+    if (sample != nullptr) {
+        pixbuf = create_pixbuf(sample);
+        gst_sample_unref(sample);
+    }
+
+    gst_object_unref(sink);
+    gst_element_set_state(pipeline, GST_STATE_NULL);
+    gst_object_unref(pipeline);
+
+    if (!pixbuf) { throw ThumbnailException(); }
+    return pixbuf;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <exception>
+
+// gtkmm
+#include <gdkmm/pixbuf.h>
+
+// A still of a video for its preview, decoded with GStreamer. The pipeline
+// seeks to the keyframe before a position a little into the video and only
+// that frame is decoded, never the whole stream. The function is thread
+// safe, so previews of videos can be made wherever those of images are.
+class VideoThumbnailer {
+    public: class ThumbnailException : public std::exception {
+        public:
+            const char *what() const noexcept override {
+                return "No frame could be decoded from the video";
+            }
+    };
+
+    public:
+        // the frame in its full size and with square pixels
+        // throws ThumbnailException if the file cannot be decoded
+        static Glib::RefPtr<Gdk::Pixbuf> create_thumbnail(const std::string &file_path);
+};
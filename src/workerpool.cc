@@ -0,0 +1,58 @@
+// project
+#include "workerpool.hh"
+
+WorkerPool::WorkerPool(size_t thread_count)
+:
+    stopping(false)
+{
+    if (thread_count == 0) {
+        thread_count = std::thread::hardware_concurrency();
+    }
+
+    // hardware_concurrency may return 0 if it cannot tell
+    if (thread_count == 0) {
+        thread_count = 1;
+    }
+
+    for (size_t idx = 0; idx < thread_count; idx++) {
+        threads.emplace_back(&WorkerPool::run, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    condition.notify_all();
+
+    // remaining jobs are still executed before the threads exit
+    for (std::thread &thread : threads) {
+        thread.join();
+    }
+}
+
+size_t WorkerPool::size() const {
+    return threads.size();
+}
+
+void WorkerPool::run() {
+    while (true) {
+        std::function<void ()> job;
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            condition.wait(lock, [this](){ return stopping || !jobs.empty(); });
+
+            if (jobs.empty()) {
+                // only reached when stopping
+                return;
+            }
+
+            job = std::move(jobs.front());
+            jobs.pop();
+        }
+
+        job();
+    }
+}
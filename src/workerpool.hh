@@ -0,0 +1,54 @@
+#pragma once
+
+// standard library
+#include <vector>
+#include <queue>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+
+// A fixed number of worker threads executing jobs from a shared queue.
+// Jobs must not touch any widgets, results are handed back through futures.
+class WorkerPool {
+    public:
+        // by default use one thread per available core
+        WorkerPool(size_t thread_count = 0);
+        ~WorkerPool();
+
+        WorkerPool(const WorkerPool &) = delete;
+        WorkerPool &operator=(const WorkerPool &) = delete;
+
+        template <typename Job>
+        std::future<decltype(std::declval<Job>()())> submit(Job job);
+
+        size_t size() const;
+
+    private:
+        std::vector<std::thread> threads;
+        std::queue<std::function<void ()>> jobs;
+        std::mutex mutex;
+        std::condition_variable condition;
+        bool stopping;
+
+        void run();
+};
+
+template <typename Job>
+std::future<decltype(std::declval<Job>()())> WorkerPool::submit(Job job) {
+    using Result = decltype(std::declval<Job>()());
+
+    // std::function requires a copyable target, so the task is shared
+    auto task = std::make_shared<std::packaged_task<Result ()>>(std::move(job));
+    std::future<Result> result = task->get_future();
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push([task](){ (*task)(); });
+    }
+    condition.notify_one();
+
+    return result;
+}
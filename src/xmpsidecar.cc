@@ -0,0 +1,243 @@
+// standard library
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+
+// POSIX
+#include <unistd.h>
+
+// glib
+#include <glib.h>
+
+// project
+#include "xmpsidecar.hh"
+
+namespace {
+    const char *dc_namespace = "xmlns:dc=\"http://purl.org/dc/elements/1.1/\"";
+
+    // larger files are not sidecars
+    const std::streamsize max_sidecar_size = 16 << 20;
+
+    bool file_exists(const std::string &path) {
+        return access(path.c_str(), F_OK) == 0;
+    }
+
+    std::string unescape(std::string_view text) {
+        std::string result;
+        for (size_t pos = 0; pos < text.size(); pos++) {
+            size_t end = text[pos] == '&' ? text.find(';', pos) : std::string_view::npos;
+            if (end == std::string_view::npos || end - pos > 10) {
+                result += text[pos];
+                continue;
+            }
+
+            std::string entity(text.substr(pos + 1, end - pos - 1));
+            if (entity == "amp") { result += '&'; }
+            else if (entity == "lt") { result += '<'; }
+            else if (entity == "gt") { result += '>'; }
+            else if (entity == "quot") { result += '"'; }
+            else if (entity == "apos") { result += '\''; }
+            else if (entity.size() > 1 && entity[0] == '#') {
+                // character references are written in decimal or hexadecimal
+                bool hex = entity[1] == 'x' || entity[1] == 'X';
+                gunichar c = std::strtoul(entity.c_str() + (hex ? 2 : 1), nullptr, hex ? 16 : 10);
+                char buffer[6];
+                result.append(buffer, g_unichar_to_utf8(c, buffer));
+            }
+            else {
+                result += text[pos];
+                continue;
+            }
+            pos = end;
+        }
+
+        return result;
+    }
+
+    std::string escape(const std::string &text) {
+        std::string result;
+        for (char c : text) {
+            switch (c) {
+                case '&': result += "&amp;"; break;
+                case '<': result += "&lt;"; break;
+                case '>': result += "&gt;"; break;
+                case '"': result += "&quot;"; break;
+                default: result += c;
+            }
+        }
+
+        return result;
+    }
+
+    std::string subject_element(const std::set<Glib::ustring> &keywords, const std::string &indent) {
+        std::string result = indent + "<dc:subject>\n" + indent + " <rdf:Bag>\n";
+        for (const Glib::ustring &keyword : keywords) {
+            result += indent + "  <rdf:li>" + escape(keyword.raw()) + "</rdf:li>\n";
+        }
+        result += indent + " </rdf:Bag>\n" + indent + "</dc:subject>";
+
+        return result;
+    }
+
+    // the keywords are put in place of the old ones or into the first
+    // description, returns false if the packet has neither
+    bool replace_subject(std::string &xmp, const std::set<Glib::ustring> &keywords) {
+        size_t begin = xmp.find("<dc:subject");
+        if (begin != std::string::npos) {
+            size_t end = xmp.find("</dc:subject>", begin);
+            if (end == std::string::npos) {
+                // an empty property closes itself
+                end = xmp.find("/>", begin);
+                if (end == std::string::npos) { return false; }
+                end += 2;
+            }
+            else {
+                end += 13;
+            }
+
+            // the new element is indented like the old one
+            size_t line_begin = xmp.rfind('\n', begin);
+            line_begin = line_begin == std::string::npos ? 0 : line_begin + 1;
+            std::string indent = xmp.substr(line_begin, begin - line_begin);
+            if (indent.find_first_not_of(" \t") != std::string::npos) {
+                indent.clear();
+            }
+
+            xmp.replace(begin, end - begin, subject_element(keywords, indent).substr(indent.size()));
+            return true;
+        }
+
+        size_t description = xmp.find("<rdf:Description");
+        if (description == std::string::npos) { return false; }
+        size_t tag_end = xmp.find('>', description);
+        if (tag_end == std::string::npos) { return false; }
+
+        // properties written as elements need the namespace of their prefix
+        std::string start_tag = xmp.substr(description, tag_end - description);
+        bool closed = start_tag.size() > 0 && start_tag.back() == '/';
+        if (closed) {
+            start_tag.pop_back();
+        }
+        if (start_tag.find("xmlns:dc=") == std::string::npos) {
+            start_tag += std::string("\n    ") + dc_namespace;
+        }
+
+        // the end of the start tag is replaced as well, a description
+        // that closed itself is closed by the '>' that follows instead
+        std::string element = ">\n" + subject_element(keywords, "   ");
+        if (closed) {
+            element += "\n  </rdf:Description";
+        }
+        else {
+            tag_end += 1;
+        }
+        xmp.replace(description, tag_end - description, start_tag + element);
+        return true;
+    }
+}
+
+std::string XmpSidecar::get_path(const std::string &file_path) {
+    std::string full_path = file_path + ".xmp";
+    if (file_exists(full_path)) { return full_path; }
+
+    // the extension of the image is replaced by some programs
+    size_t slash = file_path.find_last_of('/');
+    size_t dot = file_path.find_last_of('.');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        std::string stem_path = file_path.substr(0, dot) + ".xmp";
+        if (file_exists(stem_path)) { return stem_path; }
+    }
+
+    return full_path;
+}
+
+std::vector<Glib::ustring> XmpSidecar::parse_keywords(std::string_view xmp) {
+    std::vector<Glib::ustring> result;
+
+    size_t begin = xmp.find("<dc:subject");
+    if (begin == std::string_view::npos) { return result; }
+    size_t end = xmp.find("</dc:subject>", begin);
+    if (end == std::string_view::npos) { return result; }
+
+    std::string_view subject = xmp.substr(begin, end - begin);
+    for (size_t pos = subject.find("<rdf:li"); pos != std::string_view::npos; pos = subject.find("<rdf:li", pos)) {
+        size_t value_begin = subject.find('>', pos);
+        if (value_begin == std::string_view::npos) { break; }
+        value_begin += 1;
+
+        size_t value_end = subject.find("</rdf:li>", value_begin);
+        if (value_end == std::string_view::npos) { break; }
+
+        std::string keyword = unescape(subject.substr(value_begin, value_end - value_begin));
+        if (g_utf8_validate(keyword.data(), keyword.size(), nullptr)) {
+            result.push_back(keyword);
+        }
+        pos = value_end;
+    }
+
+    return result;
+}
+
+bool XmpSidecar::read_keywords(const std::string &file_path, std::vector<Glib::ustring> &keywords) {
+    std::ifstream input(get_path(file_path), std::ios::binary | std::ios::ate);
+    if (!input.good()) { return false; }
+
+    // opened at the end, so the position is the size of the file
+    std::streamsize size = input.tellg();
+    if (size < 0) { return false; }
+    input.seekg(0);
+
+    std::string xmp(std::min(size, max_sidecar_size), '\0');
+    input.read(&xmp[0], xmp.size());
+    xmp.resize(input.gcount());
+
+    keywords = parse_keywords(xmp);
+    return true;
+}
+
+bool XmpSidecar::write_keywords(const std::string &file_path, const std::set<Glib::ustring> &keywords) {
+    std::string sidecar_path = get_path(file_path);
+
+    std::string xmp;
+    std::ifstream input(sidecar_path, std::ios::binary);
+    if (input.good()) {
+        std::ostringstream content;
+        content << input.rdbuf();
+        xmp = content.str();
+
+        // a file that is not XMP is never overwritten
+        if (!replace_subject(xmp, keywords)) { return false; }
+    }
+    else {
+        xmp = "<?xpacket begin=\"\xEF\xBB\xBF\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n"
+              "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">\n"
+              " <rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">\n"
+              "  <rdf:Description rdf:about=\"\"\n"
+              "    " + std::string(dc_namespace) + ">\n" +
+              subject_element(keywords, "   ") + "\n"
+              "  </rdf:Description>\n"
+              " </rdf:RDF>\n"
+              "</x:xmpmeta>\n"
+              "<?xpacket end=\"w\"?>\n";
+    }
+    input.close();
+
+    // other programs never see a partially written sidecar
+    std::string temp_path = sidecar_path + ".tmp";
+    std::ofstream output(temp_path, std::ios::binary | std::ios::trunc);
+    output << xmp;
+    output.close();
+    if (!output.good()) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+
+    if (std::rename(temp_path.c_str(), sidecar_path.c_str()) != 0) {
+        std::remove(temp_path.c_str());
+        return false;
+    }
+
+    return true;
+}
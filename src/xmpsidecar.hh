@@ -0,0 +1,32 @@
+#pragma once
+
+// standard library
+#include <string>
+#include <string_view>
+#include <vector>
+#include <set>
+
+// gtkmm
+#include <glibmm/ustring.h>
+
+// Keywords of an image in an XMP sidecar, a file next to the image that
+// programs such as darktable or Lightroom keep their metadata in. The
+// keywords are the dc:subject property, where embedded XMP keeps them too.
+// The functions are thread safe.
+class XmpSidecar {
+    public:
+        // the sidecar of an image, photo.jpg.xmp or photo.xmp
+        // if only the second one exists
+        static std::string get_path(const std::string &file_path);
+
+        // keywords in the dc:subject property of an XMP packet
+        static std::vector<Glib::ustring> parse_keywords(std::string_view xmp);
+
+        // returns false if the image has no sidecar
+        static bool read_keywords(const std::string &file_path, std::vector<Glib::ustring> &keywords);
+
+        // replaces the keywords in the sidecar of an image, the other
+        // properties of an existing sidecar are kept
+        // returns false if the sidecar could not be written
+        static bool write_keywords(const std::string &file_path, const std::set<Glib::ustring> &keywords);
+};
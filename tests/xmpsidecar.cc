@@ -0,0 +1,155 @@
+// standard library
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <set>
+
+// POSIX
+#include <unistd.h>
+
+// project
+#include "xmpsidecar.hh"
+
+// Writes keywords to existing sidecars and reads them back. The sidecars
+// are written by other programs, so everything else in them is kept.
+namespace {
+    int failures = 0;
+
+    void check(bool condition, const std::string &description) {
+        if (!condition) {
+            std::fprintf(stderr, "FAILED: %s\n", description.c_str());
+            failures += 1;
+        }
+    }
+
+    void write_file(const std::string &path, const std::string &content) {
+        std::ofstream output(path, std::ios::binary | std::ios::trunc);
+        output << content;
+    }
+
+    std::string read_file(const std::string &path) {
+        std::ifstream input(path, std::ios::binary);
+        std::ostringstream content;
+        content << input.rdbuf();
+        return content.str();
+    }
+
+    std::string packet(const std::string &description) {
+        return "<?xpacket begin=\"\xEF\xBB\xBF\" id=\"W5M0MpCehiHzreSzNTczkc9d\"?>\n"
+               "<x:xmpmeta xmlns:x=\"adobe:ns:meta/\">\n"
+               " <rdf:RDF xmlns:rdf=\"http://www.w3.org/1999/02/22-rdf-syntax-ns#\">\n" +
+               description +
+               " </rdf:RDF>\n"
+               "</x:xmpmeta>\n"
+               "<?xpacket end=\"w\"?>\n";
+    }
+
+    // writes the keywords to a sidecar with the given content and reads them back
+    std::string round_trip(const std::string &image_path, const std::string &sidecar,
+                           const std::set<Glib::ustring> &keywords, const std::string &name)
+    {
+        std::string sidecar_path = image_path + ".xmp";
+        write_file(sidecar_path, sidecar);
+
+        check(XmpSidecar::write_keywords(image_path, keywords), name + ": write");
+
+        std::vector<Glib::ustring> read;
+        check(XmpSidecar::read_keywords(image_path, read), name + ": read");
+        check(std::set<Glib::ustring>(read.begin(), read.end()) == keywords, name + ": keywords");
+
+        std::string result = read_file(sidecar_path);
+        std::remove(sidecar_path.c_str());
+        return result;
+    }
+}
+
+int main() {
+    char directory[] = "/tmp/tagview-xmpsidecar-XXXXXX";
+    if (mkdtemp(directory) == nullptr) {
+        std::perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+    std::string image_path = std::string(directory) + "/photo.jpg";
+    std::set<Glib::ustring> keywords = {"cat", "tom & jerry", "Ünïcode"};
+
+    // the old keywords are replaced, the rating is kept
+    std::string result = round_trip(image_path, packet(
+            "  <rdf:Description rdf:about=\"\"\n"
+            "    xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\"\n"
+            "    xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
+            "    xmp:Rating=\"4\">\n"
+            "   <dc:subject>\n"
+            "    <rdf:Bag>\n"
+            "     <rdf:li>dog</rdf:li>\n"
+            "    </rdf:Bag>\n"
+            "   </dc:subject>\n"
+            "  </rdf:Description>\n"), keywords, "existing keywords");
+    check(result == packet(
+            "  <rdf:Description rdf:about=\"\"\n"
+            "    xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\"\n"
+            "    xmlns:dc=\"http://purl.org/dc/elements/1.1/\"\n"
+            "    xmp:Rating=\"4\">\n"
+            "   <dc:subject>\n"
+            "    <rdf:Bag>\n"
+            "     <rdf:li>cat</rdf:li>\n"
+            "     <rdf:li>tom &amp; jerry</rdf:li>\n"
+            "     <rdf:li>Ünïcode</rdf:li>\n"
+            "    </rdf:Bag>\n"
+            "   </dc:subject>\n"
+            "  </rdf:Description>\n"), "existing keywords: content");
+
+    // the keywords are added before the other properties of the description
+    result = round_trip(image_path, packet(
+            "  <rdf:Description rdf:about=\"\"\n"
+            "    xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\">\n"
+            "   <xmp:Rating>4</xmp:Rating>\n"
+            "  </rdf:Description>\n"), {"cat"}, "open description");
+    check(result == packet(
+            "  <rdf:Description rdf:about=\"\"\n"
+            "    xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\"\n"
+            "    xmlns:dc=\"http://purl.org/dc/elements/1.1/\">\n"
+            "   <dc:subject>\n"
+            "    <rdf:Bag>\n"
+            "     <rdf:li>cat</rdf:li>\n"
+            "    </rdf:Bag>\n"
+            "   </dc:subject>\n"
+            "   <xmp:Rating>4</xmp:Rating>\n"
+            "  </rdf:Description>\n"), "open description: content");
+
+    // a description without properties as elements closes itself
+    result = round_trip(image_path, packet(
+            "  <rdf:Description rdf:about=\"\"\n"
+            "    xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\"\n"
+            "    xmp:Rating=\"4\"/>\n"), {"cat"}, "closed description");
+    check(result == packet(
+            "  <rdf:Description rdf:about=\"\"\n"
+            "    xmlns:xmp=\"http://ns.adobe.com/xap/1.0/\"\n"
+            "    xmp:Rating=\"4\"\n"
+            "    xmlns:dc=\"http://purl.org/dc/elements/1.1/\">\n"
+            "   <dc:subject>\n"
+            "    <rdf:Bag>\n"
+            "     <rdf:li>cat</rdf:li>\n"
+            "    </rdf:Bag>\n"
+            "   </dc:subject>\n"
+            "  </rdf:Description>\n"), "closed description: content");
+
+    // writing the same keywords again does not change the sidecar
+    std::string sidecar_path = image_path + ".xmp";
+    check(XmpSidecar::write_keywords(image_path, keywords), "new sidecar: write");
+    std::string written = read_file(sidecar_path);
+    check(XmpSidecar::write_keywords(image_path, keywords), "new sidecar: write again");
+    check(read_file(sidecar_path) == written, "new sidecar: unchanged");
+
+    // files that are not XMP are left alone
+    write_file(sidecar_path, "not a sidecar\n");
+    check(!XmpSidecar::write_keywords(image_path, keywords), "not xmp: write");
+    check(read_file(sidecar_path) == "not a sidecar\n", "not xmp: unchanged");
+
+    std::remove(sidecar_path.c_str());
+    rmdir(directory);
+
+    return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}